@@ -7,6 +7,7 @@
 #define SRC_CONFIGURATION_H_
 
 #include <string>
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 
@@ -18,6 +19,7 @@ class ConfigFilePrivate
 
     friend class ConfigFile;
     friend class ConfigFileBrowser;
+    friend class ConfigFileSection;
 
   protected:
     boost::property_tree::ptree pt;
@@ -74,12 +76,11 @@ class ConfigFile
     template<typename T>
     int getOptionalValue(const std::string key, T &value)
     {
-      try {
-        value = dPtr->pt.get<T>(key);
-      }
-      catch (...) {
+      boost::optional<T> v = dPtr->pt.get_optional<T>(key);
+      if (!v) {
         return 1;
       }
+      value = *v;
       return 0;
     }
 
@@ -93,17 +94,27 @@ class ConfigFile
     template<typename T>
     int getOptionalValue(const std::string key, T &value, T defaultValue)
     {
-      try {
-        value = dPtr->pt.get<T>(key);
-      }
-      catch (...) {
+      boost::optional<T> v = dPtr->pt.get_optional<T>(key);
+      if (!v) {
         value = defaultValue;
         return 1;
       }
+      value = *v;
       return 0;
     }
 
 
+    /// Get the configuration value for given key path (by result), failure does not cause exception.
+    /// \param key   Key name (possibly hierarchical)
+    /// \returns     Result value found (possible types: int, float, std::string), or none if not found or not convertible to requested type
+    /// \exception   Does not throw exception if value not found
+    template<typename T>
+    boost::optional<T> getOptional(const std::string key)
+    {
+      return dPtr->pt.get_optional<T>(key);
+    }
+
+
     /// Get the configuration value for given key path (by result)
     /// \param key   Key name (possibly hierarchical)
     /// \returns     Result value found (possible types: int, float, std::string)
@@ -124,6 +135,71 @@ class ConfigFile
     ConfigFilePrivate *dPtr;
 
   friend class ConfigFileBrowser;
+  friend class ConfigFileSection;
+};
+
+
+
+
+/// Helper class to read the values of a section (1st level sub-tree) of config file, e.g. to fill a structure of parameters in one go.
+/// The section is looked up once, keys are then searched directly in it. Lookups do not cause exceptions.
+///
+/// \example        To fill parameters from section [equipment-1], with defaults for missing keys:
+/// \example          ConfigFileSection s(myConfigFile,"equipment-1");
+/// \example          s.bind("name",p.name,std::string("dummy")).bind("rate",p.rate,-1.0);
+class ConfigFileSection {
+
+public:
+  /// Constructor
+  /// \param cfg       ConfigFile object
+  /// \param section   Name of the section. If it does not exist, all lookups fail.
+  ConfigFileSection(ConfigFile &cfg, const std::string section);
+  ~ConfigFileSection();
+
+  /// \returns     1 if section exists, 0 otherwise
+  int isFound();
+
+  /// Get the configuration value for given key of the section (by result).
+  /// \param key   Key name in section
+  /// \returns     Result value found, or none if not found or not convertible to requested type
+  template<typename T>
+  boost::optional<T> getOptional(const std::string &key)
+  {
+    if (ptPtr == nullptr) {
+      return boost::none;
+    }
+    return ptPtr->get_optional<T>(key);
+  }
+
+  /// Get the configuration value for given key of the section (by reference). Variable is not modified if value not found.
+  /// \param key   Key name in section
+  /// \param value Result value found, by reference
+  /// \returns     This object, so that calls can be chained
+  template<typename T>
+  ConfigFileSection & bind(const std::string &key, T &value)
+  {
+    boost::optional<T> v = getOptional<T>(key);
+    if (v) {
+      value = *v;
+    }
+    return *this;
+  }
+
+  /// Get the configuration value for given key of the section (by reference), default value is assigned if value not found.
+  /// \param key   Key name in section
+  /// \param value Result value found, by reference
+  /// \param defaultValue Default value to be assigned in case of failure
+  /// \returns     This object, so that calls can be chained
+  template<typename T>
+  ConfigFileSection & bind(const std::string &key, T &value, T defaultValue)
+  {
+    boost::optional<T> v = getOptional<T>(key);
+    value = v ? *v : defaultValue;
+    return *this;
+  }
+
+private:
+  boost::property_tree::ptree *ptPtr; // section sub-tree, or nullptr if section not found
 };
 
 
@@ -0,0 +1,115 @@
+///
+/// \file    Executor.h
+/// \brief   Class to run many looping callbacks on a fixed pool of threads
+
+#ifndef COMMON_EXECUTOR_H
+#define COMMON_EXECUTOR_H
+
+#include <Common/Thread.h>
+
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace AliceO2 {
+namespace Common {
+
+struct ExecutorTask;
+struct ExecutorWorker;
+
+/// \brief   Class to run many looping callbacks on a fixed pool of threads
+/// Each task is a callback with the same semantics as the loop function of a Thread: it is called repeatedly,
+/// immediately again when it returns Ok or Error, with a backoff when it returns Idle, and not anymore once it returns Done.
+/// A task is never executed by two workers at the same time.
+///
+/// Each worker thread has its own queue of runnable tasks, and tasks sleeping after Idle.
+/// A worker with nothing to run takes tasks from the queues of the other workers (work stealing),
+/// so that load is balanced without central queue. Workers can be pinned, see setWorkerPlacement().
+class Executor {
+  public:
+
+    /// Constructor
+    /// \param[in]   numberOfWorkers   Number of worker threads.
+    /// \param[in]   name              Name of the executor, used to name the worker threads.
+    Executor(int numberOfWorkers, std::string name="executor");
+
+    /// Destructor. Stops workers.
+    ~Executor();
+
+    /// define CPU affinity and scheduling of a worker thread. To be called before start().
+    /// \param[in]   worker      Worker index (0 to numberOfWorkers-1).
+    /// \param[in]   placement   Parameters to be applied.
+    void setWorkerPlacement(int worker, const ThreadPlacement &placement);
+
+    /// pin each worker to a CPU of the given list, in order (round-robin if more workers than CPUs). To be called before start().
+    /// \param[in]   cpus   CPU list, e.g. "0-3,8"
+    /// \return      0 on success, -1 if list invalid
+    int pinWorkers(const std::string &cpus);
+
+    /// add a task. Can be called before or after start().
+    /// \param[in]   loopCallback   Function called repeatedly, see Thread.
+    /// \param[in]   loopArg        Argument passed to function.
+    /// \param[in]   name           Name of the task.
+    /// \param[in]   backoff        Behavior when callback returns Idle: spinCount calls retried immediately, then sleeps (not blocking the worker) from sleepMin to sleepMax. yieldCount is ignored.
+    /// \return      task identifier
+    int addTask(Thread::CallbackResult (*loopCallback)(void *), void *loopArg, std::string name, const ThreadIdleBackoff &backoff=ThreadIdleBackoff());
+
+    /// remove a task. Once returned, the callback is not running and will not be called anymore.
+    /// \param[in]   id   Task identifier, as returned by addTask().
+    /// \return      0 on success, -1 if task unknown
+    int removeTask(int id);
+
+    /// start worker threads
+    void start();
+    /// stop worker threads, and wait their termination. Tasks are kept, and resumed on start().
+    void stop();
+
+    /// get activity of a task
+    /// \param[in]   id      Task identifier.
+    /// \param[out]  stats   Counters of task callback calls: busy (Ok, Error) and idle. Time is the time spent in callback.
+    /// \return      0 on success, -1 if task unknown
+    int getTaskStats(int id, ThreadStats &stats);
+
+    /// get activity of a worker thread
+    /// \param[in]   worker   Worker index.
+    /// \param[out]  stats    Counters of worker thread, see Thread::getStats().
+    void getWorkerStats(int worker, ThreadStats &stats);
+
+    /// \return   effective placement of worker thread, see Thread::getPlacement()
+    std::string getWorkerPlacement(int worker);
+
+    /// \return   number of worker threads
+    int getNumberOfWorkers();
+
+    /// \return   number of tasks stolen from other workers
+    unsigned long long getNumberOfSteals();
+
+  private:
+    static Thread::CallbackResult workerCallback(void *arg); // loop function of worker threads
+    Thread::CallbackResult runOnce(int worker); // run next task available for the given worker. Returns Idle if none.
+    std::shared_ptr<ExecutorTask> takeTask(int worker); // get next task to be run by the given worker, from its queues or from other workers
+    std::shared_ptr<ExecutorTask> takeTaskFrom(int worker, int isSteal); // get a task from the queues of the given worker
+    void reschedule(int worker, std::shared_ptr<ExecutorTask> task, Thread::CallbackResult result); // put back task in queue after execution
+    void dropTask(std::shared_ptr<ExecutorTask> task); // task not to be run anymore
+
+    std::string name;
+    std::vector<std::unique_ptr<ExecutorWorker>> workers;
+
+    std::mutex tasksLock; // lock for tasks
+    std::condition_variable taskDropped; // signaled when a task is not in any queue anymore
+    std::map<int, std::shared_ptr<ExecutorTask>> tasks; // all tasks, by id
+    int lastTaskId;
+
+    std::atomic<unsigned long long> nSteals; // number of tasks stolen
+};
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_EXECUTOR_H
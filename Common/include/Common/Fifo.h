@@ -9,7 +9,15 @@
 
 #include <vector>
 #include <atomic>
+#include <chrono>
+#include <utility>
 #include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 namespace AliceO2 {
 namespace Common {
@@ -17,6 +25,15 @@ namespace Common {
 /// \brief   Class to implement a lock-free 1-to-1 FIFO (1 writer, 1 reader)
 /// Two threads can safely work concurrently on the two sides of the FIFO (one using push(), the other using pop()).
 /// External protection is needed for other types of concurrent access, functions are not re-entrant. (e.g. 2 threads calling push(), or 2 threads calling pop())
+///
+/// Writer and reader indexes are on separate cache lines, and each side keeps a private copy of the index of the other side,
+/// refreshed only when the FIFO looks full (writer) or empty (reader): most calls do not touch the cache line of the other thread.
+/// pushBulk() and popBulk() transfer several elements with a single update of the shared index.
+///
+/// push() and pop() can optionally wait for space/data, with a timeout: the caller first spins for a few microseconds,
+/// and then sleeps until woken up by the other side (futex on the index of the other side).
+/// When enableBlockingWait() has been called, the other side signals only when a thread is actually sleeping,
+/// otherwise waiting is done by polling with short sleeps.
 /// \author   Sylvain Chapeland
 template <class T>
 class Fifo {
@@ -33,17 +50,57 @@ class Fifo {
     /// \param[in]  data   Element to be added to FIFO.
     /// \return   0 on success
     int push(const T &data);    // push an element in FIFO. Returns 0 on success.
+
+    /// Push an element in FIFO, moving it instead of copying it.
+    /// \param[in]  data   Element to be added to FIFO. Left unchanged if FIFO full.
+    /// \return   0 on success
+    int push(T &&data);
     
+    /// Push an element in FIFO, waiting for a free slot if FIFO is full.
+    /// \param[in]  data     Element to be added to FIFO.
+    /// \param[in]  timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until space available.
+    /// \return   0 on success, -1 if FIFO still full after timeout
+    int push(const T &data, int timeout);
+
+    /// Push an element in FIFO, moving it, and waiting for a free slot if FIFO is full.
+    /// \param[in]  data     Element to be added to FIFO. Left unchanged if FIFO still full after timeout.
+    /// \param[in]  timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until space available.
+    /// \return   0 on success, -1 if FIFO still full after timeout
+    int push(T &&data, int timeout);
+
+    /// Push several elements in FIFO, moving them, with a single update visible to the reader.
+    /// \param[in]  items   Array of elements to be added to FIFO. Elements pushed are moved, the others are left unchanged.
+    /// \param[in]  n       Number of elements in array.
+    /// \return   number of elements pushed (less than n if FIFO full)
+    int pushBulk(T *items, int n);
+
     /// Retrieve first element of FIFO.
     /// \param[in,out]  data   Element read from FIFO (by reference).
     /// \return   0 on success   
     int pop(T &data);
 
+    /// Retrieve first element of FIFO, waiting for one if FIFO is empty.
+    /// \param[in,out]  data     Element read from FIFO (by reference).
+    /// \param[in]      timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until data available.
+    /// \return   0 on success, -1 if FIFO still empty after timeout
+    int pop(T &data, int timeout);
+
+    /// Retrieve several elements from FIFO, with a single update visible to the writer.
+    /// \param[out]  items     Array where elements read from FIFO are moved to.
+    /// \param[in]   maxItems  Maximum number of elements to be retrieved.
+    /// \return   number of elements retrieved (0 if FIFO empty)
+    int popBulk(T *items, int maxItems);
+
     /// Retrieve first element from FIFO, without removing it from FIFO.
     /// \param[in,out]  data   Element read from FIFO (by reference).
     /// \return   0 on success
     int front(T &data);
 
+    /// Access first element of FIFO, without removing it from FIFO nor copying it.
+    /// To be called from the reader side only. Pointer is valid until element is removed with pop().
+    /// \return   pointer to first element, or NULL if FIFO empty
+    T *frontPtr();
+
     /// Check if Fifo is full.
     /// \return   non-zero if FIFO full
     int isFull();
@@ -60,7 +117,11 @@ class Fifo {
     /// \return   number of pending items in FIFO
     int getNumberOfUsedSlots();
     
-    /// clears FIFO content
+    /// Enable wake-up of threads sleeping in push(timeout) / pop(timeout) as soon as possible.
+    /// This adds a memory fence to each push() and pop(). To be called before FIFO is used.
+    void enableBlockingWait();
+
+    /// clears FIFO content. Not thread-safe: to be called when no other thread uses the FIFO.
     void clear();
     
 
@@ -74,12 +135,31 @@ class Fifo {
     
   private:
 
+    int nextIndex(int index); // index following the given one in circular buffer
+
+    // wait for the value of an index of the other side to change, used by push(timeout) and pop(timeout)
+    // returns 0 if changed, -1 on timeout
+    int waitIndexChange(std::atomic<int> &index, int value, std::atomic<int> &waiting, int timeout);
+    void wakeUp(std::atomic<int> &index, std::atomic<int> &waiting); // wake up thread sleeping on index, if any
+    template <class U> int pushWait(U &&data, int timeout); // common implementation of push(timeout), for copy or move
+
+    // constant after construction, shared read-only by both sides
     int size; // size of FIFO (number of elements it can store)
-    std::atomic<int> indexStart; // index of latest element poped
-    std::atomic<int> indexEnd; // index of latest element pushed
     std::vector<T> data;  // array storing FIFO elements (circular buffer - has one more item than max number of elements stored)
-    
+
+    // blocking wait, rarely modified
+    alignas(64) int isBlockingWaitEnabled; // set when other side should be woken up
+    std::atomic<int> readerWaiting; // set when reader sleeps until indexEnd changes
+    std::atomic<int> writerWaiting; // set when writer sleeps until indexStart changes
+
+    // writer side
+    alignas(64) std::atomic<int> indexEnd; // index of latest element pushed
+    int cachedIndexStart; // last value of indexStart seen by writer
     unsigned long long nIn; // statistics - number of elements pushed to FIFO
+
+    // reader side
+    alignas(64) std::atomic<int> indexStart; // index of latest element poped
+    int cachedIndexEnd; // last value of indexEnd seen by reader
     unsigned long long nOut; // statistics - number of elements retrieved from FIFO
 };
 
@@ -89,6 +169,11 @@ template <class T>
 Fifo<T>::Fifo(int s) {
   indexStart=0;
   indexEnd=0;
+  cachedIndexStart=0;
+  cachedIndexEnd=0;
+  isBlockingWaitEnabled=0;
+  readerWaiting=0;
+  writerWaiting=0;
   size=s;
   data.resize(size+1); // keep one extra slot to mark separation between begin/end of circular buffer
   resetStats();
@@ -105,72 +190,287 @@ Fifo<T>::~Fifo() {
   */
 }
 
+template <class T>
+inline int Fifo<T>::nextIndex(int index) {
+  index++;
+  if (index>size) {
+    index=0;
+  }
+  return index;
+}
+
 template <class T>
 int Fifo<T>::push(const T &item) {
-  int indexEndNew;
+  int indexEndNew=nextIndex(indexEnd.load(std::memory_order_relaxed));
 
-//  printf("push : start=%d end=%d\n",(int)indexStart,(int)indexEnd);
+  // append new item only if some space left
+  if (indexEndNew==cachedIndexStart) {
+    cachedIndexStart=indexStart.load(std::memory_order_acquire);
+    if (indexEndNew==cachedIndexStart) {
+      return -1;
+    }
+  }
 
-  indexEndNew=this->indexEnd+1;
-  if (indexEndNew>this->size) {
-    indexEndNew=0;
+  data[indexEndNew]=item;
+  indexEnd.store(indexEndNew,std::memory_order_release);
+  nIn++;
+  if (isBlockingWaitEnabled) {
+    wakeUp(indexEnd,readerWaiting);
   }
+  return 0;
+}
+
+template <class T>
+int Fifo<T>::push(T &&item) {
+  int indexEndNew=nextIndex(indexEnd.load(std::memory_order_relaxed));
 
   // append new item only if some space left
-  if (indexEndNew==this->indexStart) {
-    return -1;
+  if (indexEndNew==cachedIndexStart) {
+    cachedIndexStart=indexStart.load(std::memory_order_acquire);
+    if (indexEndNew==cachedIndexStart) {
+      return -1;
+    }
   }
-  
-  //printf("push \ %d = %p\n",indexEndNew,item);  
-  data[indexEndNew]=item;
-  this->indexEnd=indexEndNew;
+
+  data[indexEndNew]=std::move(item);
+  indexEnd.store(indexEndNew,std::memory_order_release);
   nIn++;
+  if (isBlockingWaitEnabled) {
+    wakeUp(indexEnd,readerWaiting);
+  }
   return 0;
 }
 
 template <class T>
-int Fifo<T>::pop(T &item) {
+void Fifo<T>::enableBlockingWait() {
+  isBlockingWaitEnabled=1;
+}
 
-  //printf("pop : start=%d end=%d\n",(int)indexStart,(int)indexEnd);
+template <class T>
+void Fifo<T>::wakeUp(std::atomic<int> &index, std::atomic<int> &waiting) {
+  // pairs with the fence in waitIndexChange(): either the sleeping thread sees the new index, or we see it waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed)) {
+#ifdef __linux__
+    syscall(SYS_futex,(int *)&index,FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+#endif
+  }
+}
 
-  // check if FIFO empty
-  if (isEmpty()) {
-    return -1;
+template <class T>
+int Fifo<T>::waitIndexChange(std::atomic<int> &index, int value, std::atomic<int> &waiting, int timeout) {
+  using namespace std::chrono;
+  static_assert(sizeof(std::atomic<int>)==sizeof(int),"atomic used as futex word");
+  const int spinTime=5; // time spent polling before going to sleep, in microseconds
+  const int pollTime=100; // sleep time between checks, when blocking wait not enabled, in microseconds
+
+  auto t0=steady_clock::now();
+  for (;;) {
+    if (index.load(std::memory_order_acquire)!=value) {
+      return 0;
+    }
+    int elapsed=(int)duration_cast<microseconds>(steady_clock::now()-t0).count();
+    if ((timeout>=0)&&(elapsed>=timeout)) {
+      return -1;
+    }
+    if (elapsed<spinTime) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      continue;
+    }
+    int sleepTime=(timeout>=0) ? timeout-elapsed : -1;
+#ifdef __linux__
+    if (isBlockingWaitEnabled) {
+      waiting.store(1,std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (index.load(std::memory_order_relaxed)==value) {
+        struct timespec ts;
+        ts.tv_sec=sleepTime/1000000;
+        ts.tv_nsec=(sleepTime%1000000)*1000;
+        syscall(SYS_futex,(int *)&index,FUTEX_WAIT_PRIVATE,value,(sleepTime>=0) ? &ts : NULL,NULL,0);
+      }
+      waiting.store(0,std::memory_order_relaxed);
+      continue;
+    }
+#endif
+    if ((sleepTime<0)||(sleepTime>pollTime)) {
+      sleepTime=pollTime;
+    }
+    usleep(sleepTime);
   }
+}
 
-  int new_indexStart;
-  new_indexStart=this->indexStart+1;
-  if (new_indexStart>this->size) {
-    new_indexStart=0;
+template <class T>
+template <class U>
+int Fifo<T>::pushWait(U &&item, int timeout) {
+  for (;;) {
+    if (push(std::forward<U>(item))==0) {
+      return 0;
+    }
+    if (timeout==0) {
+      return -1;
+    }
+    // FIFO full: wait for reader to move
+    auto t0=std::chrono::steady_clock::now();
+    if (waitIndexChange(indexStart,cachedIndexStart,writerWaiting,timeout)) {
+      return -1;
+    }
+    if (timeout>0) {
+      timeout-=(int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-t0).count();
+      if (timeout<=0) {
+        timeout=0;
+      }
+    }
   }
-  this->indexStart=new_indexStart;
-  
-  item=data[this->indexStart];
-  data[this->indexStart]=0; // reset value, in case it is a shared_ptr
-  //printf("pop \ %d = %p\n",new_indexStart,item);  
-  nOut++;
-  return 0;
 }
 
 template <class T>
-int Fifo<T>::front(T &item) {
+int Fifo<T>::push(const T &item, int timeout) {
+  return pushWait(item,timeout);
+}
+
+template <class T>
+int Fifo<T>::push(T &&item, int timeout) {
+  return pushWait(std::move(item),timeout);
+}
+
+template <class T>
+int Fifo<T>::pop(T &item, int timeout) {
+  for (;;) {
+    if (pop(item)==0) {
+      return 0;
+    }
+    if (timeout==0) {
+      return -1;
+    }
+    // FIFO empty: wait for writer to move
+    auto t0=std::chrono::steady_clock::now();
+    if (waitIndexChange(indexEnd,cachedIndexEnd,readerWaiting,timeout)) {
+      return -1;
+    }
+    if (timeout>0) {
+      timeout-=(int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-t0).count();
+      if (timeout<=0) {
+        timeout=0;
+      }
+    }
+  }
+}
+
+template <class T>
+int Fifo<T>::pushBulk(T *items, int n) {
+  int index=indexEnd.load(std::memory_order_relaxed);
+  int nPushed=0;
+  int isRefreshed=0;
+  for (;nPushed<n;nPushed++) {
+    int indexNew=nextIndex(index);
+    if (indexNew==cachedIndexStart) {
+      // refresh reader index once only
+      if (isRefreshed) {
+        break;
+      }
+      cachedIndexStart=indexStart.load(std::memory_order_acquire);
+      isRefreshed=1;
+      if (indexNew==cachedIndexStart) {
+        break;
+      }
+    }
+    data[indexNew]=std::move(items[nPushed]);
+    index=indexNew;
+  }
+  if (nPushed) {
+    indexEnd.store(index,std::memory_order_release);
+    nIn+=nPushed;
+    if (isBlockingWaitEnabled) {
+      wakeUp(indexEnd,readerWaiting);
+    }
+  }
+  return nPushed;
+}
 
-  //printf("front : start=%d end=%d\n",(int)indexStart,(int)indexEnd);
+template <class T>
+int Fifo<T>::pop(T &item) {
 
   // check if FIFO empty
-  if (isEmpty()) {
-    return -1;
+  int index=indexStart.load(std::memory_order_relaxed);
+  if (index==cachedIndexEnd) {
+    cachedIndexEnd=indexEnd.load(std::memory_order_acquire);
+    if (index==cachedIndexEnd) {
+      return -1;
+    }
   }
 
-  item=data[(this->indexStart+1)%(this->size+1)];
+  index=nextIndex(index);
+  item=std::move(data[index]);
+  data[index]=T(); // reset value, in case it is a shared_ptr
+  indexStart.store(index,std::memory_order_release);
+  nOut++;
+  if (isBlockingWaitEnabled) {
+    wakeUp(indexStart,writerWaiting);
+  }
   return 0;
 }
 
+template <class T>
+int Fifo<T>::popBulk(T *items, int maxItems) {
+  int index=indexStart.load(std::memory_order_relaxed);
+  int nPopped=0;
+  int isRefreshed=0;
+  while (nPopped<maxItems) {
+    if (index==cachedIndexEnd) {
+      // refresh writer index once only
+      if (isRefreshed) {
+        break;
+      }
+      cachedIndexEnd=indexEnd.load(std::memory_order_acquire);
+      isRefreshed=1;
+      if (index==cachedIndexEnd) {
+        break;
+      }
+    }
+    index=nextIndex(index);
+    items[nPopped]=std::move(data[index]);
+    data[index]=T(); // reset value, in case it is a shared_ptr
+    nPopped++;
+  }
+  if (nPopped) {
+    indexStart.store(index,std::memory_order_release);
+    nOut+=nPopped;
+    if (isBlockingWaitEnabled) {
+      wakeUp(indexStart,writerWaiting);
+    }
+  }
+  return nPopped;
+}
+
+template <class T>
+int Fifo<T>::front(T &item) {
+  T *p=frontPtr();
+  if (p==NULL) {
+    return -1;
+  }
+  item=*p;
+  return 0;
+}
+
+template <class T>
+T *Fifo<T>::frontPtr() {
+  int index=indexStart.load(std::memory_order_relaxed);
+  if (index==cachedIndexEnd) {
+    cachedIndexEnd=indexEnd.load(std::memory_order_acquire);
+    if (index==cachedIndexEnd) {
+      return NULL;
+    }
+  }
+  return &data[nextIndex(index)];
+}
+
 
 
 template <class T>
 int Fifo<T>::isEmpty() {
-  if (indexEnd==indexStart) {
+  if (indexEnd.load(std::memory_order_acquire)==indexStart.load(std::memory_order_acquire)) {
     return 1;
   }
   return 0;
@@ -178,7 +478,7 @@ int Fifo<T>::isEmpty() {
 
 template <class T>
 int Fifo<T>::isFull() {
-  if ( ((indexEnd+1)==indexStart) || ((indexEnd+1>size)&&(indexStart==0)) ) {
+  if (nextIndex(indexEnd.load(std::memory_order_acquire))==indexStart.load(std::memory_order_acquire)) {
     return 1;
   }
   return 0;
@@ -186,8 +486,8 @@ int Fifo<T>::isFull() {
 
 template <class T>
 int Fifo<T>::getNumberOfFreeSlots() {
-  int i1=indexEnd;
-  int i2=indexStart;
+  int i1=indexEnd.load(std::memory_order_acquire);
+  int i2=indexStart.load(std::memory_order_acquire);
   if (i1>=i2) {
     return size-i1+i2;
   }
@@ -201,9 +501,14 @@ int Fifo<T>::getNumberOfUsedSlots() {
 
 template <class T>
 void Fifo<T>::clear() {
-  data.clear();
+  // release elements, but keep buffer allocated
+  for (auto &item : data) {
+    item=T();
+  }
   indexStart=0;
   indexEnd=0;
+  cachedIndexStart=0;
+  cachedIndexEnd=0;
   return;
 }
 
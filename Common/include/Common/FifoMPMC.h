@@ -0,0 +1,346 @@
+///
+/// \file    FifoMPMC.h
+/// \brief   Class to implement a bounded lock-free N-to-M FIFO
+///
+
+#ifndef COMMON_FIFOMPMC_H
+#define COMMON_FIFOMPMC_H
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <stdint.h>
+
+namespace AliceO2 {
+namespace Common {
+
+/// \brief   Class to implement a bounded lock-free N-to-M FIFO (any number of writers and readers)
+/// Same interface as Fifo, but push() and pop() can be called concurrently from any number of threads.
+///
+/// Each slot of the circular buffer has a sequence number, telling whether it is ready to be written or read
+/// for a given position in the queue. Writers (resp. readers) reserve a position with an atomic update of the
+/// write (resp. read) counter, and then access the slot without lock.
+/// Writers and readers only contend on their own counter, and these are on separate cache lines.
+/// Queue size is rounded up to a power of 2.
+///
+/// push() and pop() can optionally wait for space/data, with a timeout. When enableBlockingWait() has been called,
+/// waiting threads sleep on a condition variable, signaled by the other side only when some threads are waiting.
+/// Otherwise, waiting is done by polling with short sleeps.
+template <class T>
+class FifoMPMC {
+  public:
+
+    /// Constructor
+    /// \param[in]  size   Size of the FIFO (number of elements it can hold). Rounded up to a power of 2.
+    FifoMPMC(int size);
+
+    /// Destructor
+    ~FifoMPMC();
+
+    /// Push an element in FIFO. Thread-safe.
+    /// \param[in]  data   Element to be added to FIFO.
+    /// \return   0 on success
+    int push(const T &data);
+
+    /// Push an element in FIFO, moving it instead of copying it. Thread-safe.
+    /// \param[in]  data   Element to be added to FIFO. Left unchanged if FIFO full.
+    /// \return   0 on success
+    int push(T &&data);
+
+    /// Push an element in FIFO, waiting for space if FIFO full. Thread-safe.
+    /// \param[in]  data     Element to be added to FIFO.
+    /// \param[in]  timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until space available.
+    /// \return   0 on success, -1 if FIFO still full after timeout
+    int push(const T &data, int timeout);
+
+    /// Push an element in FIFO, moving it, waiting for space if FIFO full. Thread-safe.
+    /// \param[in]  data     Element to be added to FIFO. Left unchanged if FIFO still full after timeout.
+    /// \param[in]  timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until space available.
+    /// \return   0 on success, -1 if FIFO still full after timeout
+    int push(T &&data, int timeout);
+
+    /// Retrieve first element of FIFO. Thread-safe.
+    /// \param[in,out]  data   Element read from FIFO (by reference).
+    /// \return   0 on success
+    int pop(T &data);
+
+    /// Retrieve first element of FIFO, waiting for data if FIFO empty. Thread-safe.
+    /// \param[in,out]  data     Element read from FIFO (by reference).
+    /// \param[in]      timeout  Maximum waiting time, in microseconds. 0 for no wait, -1 to wait until data available.
+    /// \return   0 on success, -1 if FIFO still empty after timeout
+    int pop(T &data, int timeout);
+
+    /// Enable wake-up of threads sleeping in push(timeout) / pop(timeout) as soon as possible.
+    /// This adds a memory fence to each push() and pop(). To be called before FIFO is used.
+    void enableBlockingWait();
+
+    /// Check if Fifo is full. Value may be outdated by concurrent calls.
+    /// \return   non-zero if FIFO full
+    int isFull();
+
+    /// Check if Fifo is empty. Value may be outdated by concurrent calls.
+    /// \return   non-zero if FIFO empty
+    int isEmpty();
+
+    /// Retrieve space available in FIFO. Value may be outdated by concurrent calls.
+    /// \return   number of free slots in FIFO
+    int getNumberOfFreeSlots();
+
+    /// Retrieve space used in FIFO. Value may be outdated by concurrent calls.
+    /// \return   number of pending items in FIFO
+    int getNumberOfUsedSlots();
+
+    /// \return   number of items written to FIFO
+    unsigned long long getNumberIn();
+    /// \return   number of items read from FIFO
+    unsigned long long getNumberOut();
+
+  protected:
+
+    struct Slot {
+      std::atomic<uint64_t> sequence; // position in queue for which slot is ready: to be written if equal to position, to be read if equal to position+1
+      T data;
+    };
+
+    template <class U> int pushItem(U &&item); // common implementation of push(), for copy or move
+    template <class U> int pushWait(U &&item, int timeout); // common implementation of push(timeout), for copy or move
+
+    // wait until FIFO is not full (isWriter=1) or not empty (isWriter=0), or timeout (at most the given deadline, if timeout>=0)
+    // returns 0 if condition met (may be outdated by concurrent calls), -1 on timeout
+    int waitSlot(int isWriter, int timeout, std::chrono::steady_clock::time_point deadline);
+    void wakeUp(std::atomic<int> &waiting, std::condition_variable &condition); // wake up threads sleeping on condition, if any
+
+    int size; // size of FIFO (number of elements it can store)
+    uint64_t mask; // size-1, to get slot index from position
+    std::vector<Slot> slots; // circular buffer
+
+    // blocking wait, rarely modified
+    int isBlockingWaitEnabled; // set when other side should be woken up
+    std::mutex waitLock; // lock for condition variables
+    std::condition_variable spaceAvailable; // signaled by readers when writers are waiting
+    std::condition_variable dataAvailable; // signaled by writers when readers are waiting
+    std::atomic<int> writersWaiting; // number of writers sleeping on spaceAvailable
+    std::atomic<int> readersWaiting; // number of readers sleeping on dataAvailable
+
+    alignas(64) std::atomic<uint64_t> writePosition; // next position to be written
+    alignas(64) std::atomic<uint64_t> readPosition; // next position to be read
+};
+
+
+
+template <class T>
+FifoMPMC<T>::FifoMPMC(int s) {
+  size=1;
+  while (size<s) {
+    size*=2;
+  }
+  mask=size-1;
+  slots=std::vector<Slot>(size);
+  for (int i=0;i<size;i++) {
+    slots[i].sequence.store(i,std::memory_order_relaxed);
+  }
+  writePosition=0;
+  readPosition=0;
+  isBlockingWaitEnabled=0;
+  writersWaiting=0;
+  readersWaiting=0;
+}
+
+template <class T>
+FifoMPMC<T>::~FifoMPMC() {
+}
+
+template <class T>
+template <class U>
+int FifoMPMC<T>::pushItem(U &&item) {
+  uint64_t position=writePosition.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot &slot=slots[position&mask];
+    uint64_t sequence=slot.sequence.load(std::memory_order_acquire);
+    int64_t diff=(int64_t)(sequence-position);
+    if (diff==0) {
+      // slot free for this position, try to reserve it
+      if (writePosition.compare_exchange_weak(position,position+1,std::memory_order_relaxed)) {
+        slot.data=std::forward<U>(item);
+        slot.sequence.store(position+1,std::memory_order_release);
+        if (isBlockingWaitEnabled) {
+          wakeUp(readersWaiting,dataAvailable);
+        }
+        return 0;
+      }
+    } else if (diff<0) {
+      // slot not yet read since previous round: FIFO full
+      return -1;
+    } else {
+      // another writer took this position
+      position=writePosition.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class T>
+int FifoMPMC<T>::push(const T &item) {
+  return pushItem(item);
+}
+
+template <class T>
+int FifoMPMC<T>::push(T &&item) {
+  return pushItem(std::move(item));
+}
+
+template <class T>
+int FifoMPMC<T>::pop(T &item) {
+  uint64_t position=readPosition.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot &slot=slots[position&mask];
+    uint64_t sequence=slot.sequence.load(std::memory_order_acquire);
+    int64_t diff=(int64_t)(sequence-(position+1));
+    if (diff==0) {
+      // slot written for this position, try to reserve it
+      if (readPosition.compare_exchange_weak(position,position+1,std::memory_order_relaxed)) {
+        item=std::move(slot.data);
+        slot.data=T(); // reset value, in case it is a shared_ptr
+        slot.sequence.store(position+size,std::memory_order_release);
+        if (isBlockingWaitEnabled) {
+          wakeUp(writersWaiting,spaceAvailable);
+        }
+        return 0;
+      }
+    } else if (diff<0) {
+      // slot not yet written: FIFO empty
+      return -1;
+    } else {
+      // another reader took this position
+      position=readPosition.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class T>
+void FifoMPMC<T>::enableBlockingWait() {
+  isBlockingWaitEnabled=1;
+}
+
+template <class T>
+void FifoMPMC<T>::wakeUp(std::atomic<int> &waiting, std::condition_variable &condition) {
+  // pairs with the fence in waitSlot(): either the waiting thread sees the new slot, or we see it waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(waitLock);
+    condition.notify_all();
+  }
+}
+
+template <class T>
+int FifoMPMC<T>::waitSlot(int isWriter, int timeout, std::chrono::steady_clock::time_point deadline) {
+  const int pollTime=100; // sleep time between checks, when blocking wait not enabled, in microseconds
+  auto isReady=[&]() {
+    return isWriter ? !isFull() : !isEmpty();
+  };
+  if ((timeout>=0)&&(std::chrono::steady_clock::now()>=deadline)) {
+    return -1;
+  }
+  if (!isBlockingWaitEnabled) {
+    auto wakeUpTime=std::chrono::steady_clock::now()+std::chrono::microseconds(pollTime);
+    if ((timeout>=0)&&(deadline<wakeUpTime)) {
+      wakeUpTime=deadline;
+    }
+    std::this_thread::sleep_until(wakeUpTime);
+    return 0;
+  }
+  std::atomic<int> &waiting=isWriter ? writersWaiting : readersWaiting;
+  std::condition_variable &condition=isWriter ? spaceAvailable : dataAvailable;
+  std::unique_lock<std::mutex> lock(waitLock);
+  waiting++;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!isReady()) {
+    if (timeout<0) {
+      condition.wait(lock);
+    } else {
+      condition.wait_until(lock,deadline);
+    }
+  }
+  waiting--;
+  return 0;
+}
+
+template <class T>
+template <class U>
+int FifoMPMC<T>::pushWait(U &&item, int timeout) {
+  auto deadline=std::chrono::steady_clock::now()+std::chrono::microseconds((timeout>0) ? timeout : 0);
+  for (;;) {
+    if (pushItem(std::forward<U>(item))==0) {
+      return 0;
+    }
+    if ((timeout==0)||(waitSlot(1,timeout,deadline))) {
+      return -1;
+    }
+  }
+}
+
+template <class T>
+int FifoMPMC<T>::push(const T &item, int timeout) {
+  return pushWait(item,timeout);
+}
+
+template <class T>
+int FifoMPMC<T>::push(T &&item, int timeout) {
+  return pushWait(std::move(item),timeout);
+}
+
+template <class T>
+int FifoMPMC<T>::pop(T &item, int timeout) {
+  auto deadline=std::chrono::steady_clock::now()+std::chrono::microseconds((timeout>0) ? timeout : 0);
+  for (;;) {
+    if (pop(item)==0) {
+      return 0;
+    }
+    if ((timeout==0)||(waitSlot(0,timeout,deadline))) {
+      return -1;
+    }
+  }
+}
+
+template <class T>
+int FifoMPMC<T>::isEmpty() {
+  return (getNumberOfUsedSlots()==0) ? 1 : 0;
+}
+
+template <class T>
+int FifoMPMC<T>::isFull() {
+  return (getNumberOfUsedSlots()>=size) ? 1 : 0;
+}
+
+template <class T>
+int FifoMPMC<T>::getNumberOfUsedSlots() {
+  // read position first, so that difference is not negative
+  uint64_t r=readPosition.load(std::memory_order_acquire);
+  uint64_t w=writePosition.load(std::memory_order_acquire);
+  if (w<=r) {
+    return 0;
+  }
+  if (w-r>(uint64_t)size) {
+    return size;
+  }
+  return (int)(w-r);
+}
+
+template <class T>
+int FifoMPMC<T>::getNumberOfFreeSlots() {
+  return size-getNumberOfUsedSlots();
+}
+
+template <class T> unsigned long long FifoMPMC<T>::getNumberIn() {return writePosition.load(std::memory_order_relaxed);}
+
+template <class T> unsigned long long FifoMPMC<T>::getNumberOut() {return readPosition.load(std::memory_order_relaxed);}
+
+
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_FIFOMPMC_H
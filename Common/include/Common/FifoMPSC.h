@@ -0,0 +1,69 @@
+///
+/// \file    FifoMPSC.h
+/// \brief   Class to implement a bounded lock-free N-to-1 FIFO
+///
+
+#ifndef COMMON_FIFOMPSC_H
+#define COMMON_FIFOMPSC_H
+
+#include <Common/FifoMPMC.h>
+
+namespace AliceO2 {
+namespace Common {
+
+/// \brief   Class to implement a bounded lock-free N-to-1 FIFO (any number of writers, 1 reader)
+/// push() can be called concurrently from any number of threads, pop() from a single thread at a time.
+/// Same algorithm as FifoMPMC, but the reader updates the read position without atomic read-modify-write.
+/// Typical use: several threads giving back resources to the thread owning them.
+/// Inherits privately from FifoMPMC, so that the multi-reader pop() is not reachable through a base class pointer or reference.
+template <class T>
+class FifoMPSC : private FifoMPMC<T> {
+  public:
+
+    /// Constructor
+    /// \param[in]  size   Size of the FIFO (number of elements it can hold). Rounded up to a power of 2.
+    FifoMPSC(int size) : FifoMPMC<T>(size) {
+    }
+
+    // same as FifoMPMC
+    using FifoMPMC<T>::push;
+    using FifoMPMC<T>::isFull;
+    using FifoMPMC<T>::isEmpty;
+    using FifoMPMC<T>::getNumberOfFreeSlots;
+    using FifoMPMC<T>::getNumberOfUsedSlots;
+    using FifoMPMC<T>::getNumberIn;
+    using FifoMPMC<T>::getNumberOut;
+    using FifoMPMC<T>::enableBlockingWait;
+
+    /// Retrieve first element of FIFO. To be called from the reader thread only.
+    /// \param[in,out]  data   Element read from FIFO (by reference).
+    /// \return   0 on success
+    int pop(T &data);
+};
+
+
+
+template <class T>
+int FifoMPSC<T>::pop(T &item) {
+  uint64_t position=this->readPosition.load(std::memory_order_relaxed);
+  typename FifoMPMC<T>::Slot &slot=this->slots[position&this->mask];
+  if (slot.sequence.load(std::memory_order_acquire)!=position+1) {
+    // slot not yet written: FIFO empty
+    return -1;
+  }
+  item=std::move(slot.data);
+  slot.data=T(); // reset value, in case it is a shared_ptr
+  slot.sequence.store(position+this->size,std::memory_order_release);
+  this->readPosition.store(position+1,std::memory_order_relaxed);
+  if (this->isBlockingWaitEnabled) {
+    this->wakeUp(this->writersWaiting,this->spaceAvailable);
+  }
+  return 0;
+}
+
+
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_FIFOMPSC_H
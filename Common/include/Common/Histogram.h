@@ -0,0 +1,129 @@
+///
+/// \file    Histogram.h
+/// \brief   Class to record the distribution of values, e.g. latencies
+///
+
+#ifndef COMMON_HISTOGRAM_H
+#define COMMON_HISTOGRAM_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+namespace AliceO2 {
+namespace Common {
+
+/// \brief   Class to record the distribution of values, e.g. latencies, with bounded relative error
+/// Values are counted in logarithmic buckets: each power of 2 is split in 32 linear sub-buckets,
+/// so that the relative error on a value is below 1/32 (about 3%) over the full 64-bit range. Values below 64 are exact.
+///
+/// Recording is wait-free and costs a few instructions. record() is meant to be called from a single thread
+/// (e.g. one histogram per thread), recordConcurrent() can be called from any thread.
+/// Statistics can be read at any time from other threads, and histograms can be merged.
+class Histogram {
+  public:
+
+    /// Constructor. Histogram is empty.
+    Histogram();
+
+    /// Copy constructor, copies current content of given histogram.
+    Histogram(const Histogram &h);
+
+    /// Destructor
+    ~Histogram();
+
+    /// Count a value. Not thread-safe with other calls of record().
+    /// \param[in]  value   Value to be counted.
+    inline void record(uint64_t value);
+
+    /// Count a value. Thread-safe.
+    /// \param[in]  value   Value to be counted.
+    inline void recordConcurrent(uint64_t value);
+
+    /// Add counts of another histogram to this one. Not thread-safe with record().
+    /// \param[in]  h   Histogram to be added.
+    void merge(const Histogram &h);
+
+    /// Empty histogram. Not thread-safe with record().
+    void reset();
+
+    /// \return   Number of values counted
+    uint64_t getCount() const;
+    /// \return   Smallest value counted (0 if none)
+    uint64_t getMin() const;
+    /// \return   Largest value counted (0 if none)
+    uint64_t getMax() const;
+    /// \return   Average of values counted (0 if none). Computed from buckets, so with the same precision as values.
+    double getMean() const;
+
+    /// Get a percentile of the distribution.
+    /// \param[in]  percentile   Percentile, between 0 and 100 (e.g. 99.9)
+    /// \return     Value below which the given percentage of values are found, i.e. the largest value of the corresponding bucket. 0 if histogram empty.
+    uint64_t getPercentile(double percentile) const;
+
+    /// Describe distribution on one line, e.g. for logs: count, min, mean, p50, p99, p99.9, max.
+    /// \param[in]  unit   Unit of values, appended to each of them.
+    /// \return     Formatted text.
+    std::string toString(const char *unit="") const;
+
+    /// Describe distribution in JSON format: same fields as toString(), and non-empty buckets as an array of [lowest value, count].
+    /// \return     JSON string.
+    std::string toJSON() const;
+
+    static const int subBucketBits=5; ///< log2 of number of sub-buckets per power of 2
+    static const int subBucketCount=1<<subBucketBits; ///< number of sub-buckets per power of 2
+    static const int numberOfBuckets=(65-subBucketBits)*subBucketCount; ///< total number of buckets, to cover 64-bit values
+
+    /// \return   Index of bucket counting the given value
+    static inline int getBucketIndex(uint64_t value);
+    /// \return   Lowest value counted in given bucket
+    static uint64_t getBucketLowestValue(int index);
+    /// \return   Largest value counted in given bucket
+    static uint64_t getBucketHighestValue(int index);
+
+  private:
+    std::atomic<uint64_t> buckets[numberOfBuckets]; // count of values in each bucket
+    std::atomic<uint64_t> count; // total number of values
+    std::atomic<uint64_t> minValue; // smallest value, UINT64_MAX if none
+    std::atomic<uint64_t> maxValue; // largest value
+};
+
+
+
+int Histogram::getBucketIndex(uint64_t value) {
+  if (value<(uint64_t)(2*subBucketCount)) {
+    return (int)value;
+  }
+  // position of most significant bit gives power of 2, next bits give sub-bucket
+  int shift=63-__builtin_clzll(value)-subBucketBits;
+  return shift*subBucketCount+(int)(value>>shift);
+}
+
+void Histogram::record(uint64_t value) {
+  // single writer: no need for atomic increments
+  std::atomic<uint64_t> &b=buckets[getBucketIndex(value)];
+  b.store(b.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+  count.store(count.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+  if (value<minValue.load(std::memory_order_relaxed)) {
+    minValue.store(value,std::memory_order_relaxed);
+  }
+  if (value>maxValue.load(std::memory_order_relaxed)) {
+    maxValue.store(value,std::memory_order_relaxed);
+  }
+}
+
+void Histogram::recordConcurrent(uint64_t value) {
+  buckets[getBucketIndex(value)].fetch_add(1,std::memory_order_relaxed);
+  count.fetch_add(1,std::memory_order_relaxed);
+  uint64_t v=minValue.load(std::memory_order_relaxed);
+  while ((value<v)&&(!minValue.compare_exchange_weak(v,value,std::memory_order_relaxed))) {
+  }
+  v=maxValue.load(std::memory_order_relaxed);
+  while ((value>v)&&(!maxValue.compare_exchange_weak(v,value,std::memory_order_relaxed))) {
+  }
+}
+
+} // namespace Common
+} // namespace AliceO2
+
+#endif // COMMON_HISTOGRAM_H
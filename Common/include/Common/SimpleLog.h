@@ -36,6 +36,19 @@ class SimpleLog {
   
   // Set output format based on (possibly OR-ed) format options from FormatOption enum
   void setOutputFormat(int opts);
+
+  // Enable asynchronous mode: messages are formatted by the caller and queued, a background thread writes them.
+  // Logging never blocks: when the queue is full, messages are dropped and counted.
+  // To be called before logging from multiple threads.
+  // \param queueSize Maximum number of messages pending. If 0, back to synchronous mode (pending messages are written first).
+  // \return 0 on success
+  int setAsynchronous(int queueSize=1024);
+
+  // Wait until pending messages are written (in asynchronous mode), including those being logged concurrently by other threads.
+  void flush();
+
+  // \return Number of messages dropped because asynchronous queue was full.
+  unsigned long long getNumberOfDroppedMessages();
   
   // Log an info message.
   // The message is formatted with timestamp and severity.
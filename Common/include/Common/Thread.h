@@ -11,10 +11,49 @@
 #include <string>
 #include <atomic>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 namespace AliceO2 {
 namespace Common {
 
+/// \brief   Placement and scheduling parameters of a thread, see Thread::setPlacement()
+struct ThreadPlacement {
+  std::string cpus="";      ///< list of CPUs the thread may run on, e.g. "0-3,8". Empty for no constraint.
+  int numaNode=-1;          ///< NUMA node: thread runs on the CPUs of this node (within cpus, if set), and allocates memory preferably from it. -1 for no constraint.
+  int realtimePriority=0;   ///< if >0, real-time scheduling priority (1-99). 0 for default time-sharing scheduling.
+  int realtimeRoundRobin=0; ///< if 1, real-time scheduling uses SCHED_RR, otherwise SCHED_FIFO.
+};
+
+
+/// \brief   Behavior of a thread when its loop function returns Idle, see Thread::setIdleBackoff()
+/// Consecutive idle iterations are first retried immediately (spin), then after a sched_yield(), then after a sleep
+/// starting at sleepMin and doubling at each iteration, up to sleepMax (see getThreadIdleSleepTime()).
+/// Back to spin after the first busy iteration.
+struct ThreadIdleBackoff {
+  int spinCount=0;  ///< number of idle iterations retried immediately
+  int yieldCount=0; ///< number of idle iterations retried after sched_yield(), once spin done
+  int sleepMin=1000;   ///< first sleep time, in microseconds
+  int sleepMax=1000;   ///< maximum sleep time, in microseconds
+};
+
+/// Get sleep time of a backoff: sleepMin (at least 1 if sleepMax>0) doubled at each sleep, up to sleepMax.
+/// \param[in]   backoff   Backoff policy.
+/// \param[in]   nSleep    Number of consecutive sleeps, including this one (1 for the first sleep).
+/// \return      Sleep time, in microseconds.
+int getThreadIdleSleepTime(const ThreadIdleBackoff &backoff, int nSleep);
+
+
+/// \brief   Thread activity counters, see Thread::getStats()
+struct ThreadStats {
+  unsigned long long busyIterations=0; ///< number of loop iterations which did some work (result not Idle)
+  unsigned long long idleIterations=0; ///< number of loop iterations which returned Idle
+  double busyTime=0;                   ///< time spent in busy iterations, in seconds
+  double idleTime=0;                   ///< time spent in idle iterations, including backoff, in seconds
+};
+
+
 /// \brief   Class to implement controllable looping threads
 /// User just needs to overload the "doLoop()" method  or to provide a callback function to the base class constructor
 /// \author   Sylvain Chapeland
@@ -26,13 +65,27 @@ class Thread {
     /// \param[in]   vLoopCallback    Pointer to user-defined function called periodically. (optional)
     /// \param[in]   vLoopArg         Pointer to argument passed to user-defined function, if any.
     /// \param[in]   vThreadName      Name to be used to identify this thread (for debug printouts)
-    /// \param[in]   loopSleepTime    Idle sleep time (in microseconds), when loop callback function/method returns idle. This is the maximum time between 2 calls.  
+    /// \param[in]   loopSleepTime    Idle sleep time (in microseconds), when loop callback function/method returns idle. This is the maximum time between 2 calls.
+    ///                               Used as default for setIdleBackoff(): no spin, fixed sleep time.
     Thread(Thread::CallbackResult (*vLoopCallback)(void *) = NULL , void *vLoopArg = NULL, std::string vThreadName = "", int loopSleepTime=1000);
 
     /// Destructor
     ~Thread();
 
-    /// start thread loop
+    /// define CPU affinity, NUMA node and scheduling policy of the thread. To be called before start().
+    /// Settings which can not be applied (e.g. missing privileges) are reported by getPlacement(), thread runs anyway.
+    /// \param[in]   placement   Parameters to be applied.
+    void setPlacement(const ThreadPlacement &placement);
+
+    /// define behavior when loop function returns Idle. To be called before start().
+    /// \param[in]   backoff   Backoff policy.
+    void setIdleBackoff(const ThreadIdleBackoff &backoff);
+
+    /// get activity counters. Can be called at any time from any thread.
+    /// \param[out]  stats   Counters since thread start.
+    void getStats(ThreadStats &stats);
+
+    /// start thread loop. Returns once thread is running, with name and placement applied.
     void start();
     /// request thread termination
     void stop();
@@ -42,7 +95,17 @@ class Thread {
     /// get thread name
     /// \returns   name of the thread, as defined at construct time.
     std::string getName();
- 
+
+    /// get effective placement of the thread
+    /// \returns   human-readable description of CPUs, NUMA node and scheduling policy of the thread, and of errors if any. Empty before start().
+    std::string getPlacement();
+
+    /// parse a list of CPUs, as used in ThreadPlacement
+    /// \param[in]   list   CPU list, e.g. "0-3,8,10-11"
+    /// \param[out]  cpus   CPU indexes
+    /// \returns     0 on success, -1 on syntax error
+    static int parseCpuList(const std::string &list, std::vector<int> &cpus);
+
     
   private:
     std::atomic<int> shutdown;    // flag set to 1 to request thread termination
@@ -57,6 +120,22 @@ class Thread {
    
     CallbackResult doLoop();   // function called at each thread iteration. Returns a result code.
     static void threadMain(Thread *e); // this is the (internal) thread entry point
+    void applyPlacement(); // set name and placement of the calling thread, and store effective placement
+
+    ThreadPlacement placement; // placement requested
+    std::string effectivePlacement; // placement applied, as reported by getPlacement()
+    std::mutex startLock; // lock used with startCondition
+    std::condition_variable startCondition; // signaled when thread started and placement applied
+    int isStarted; // set when thread started and placement applied
+
+    ThreadIdleBackoff idleBackoff; // policy used when loop is idle
+    void idleWait(int nIdle); // wait after the given number of consecutive idle iterations, according to idleBackoff
+
+    // activity counters, updated by running thread
+    std::atomic<unsigned long long> busyIterations;
+    std::atomic<unsigned long long> idleIterations;
+    std::atomic<unsigned long long> busyTime; // in nanoseconds
+    std::atomic<unsigned long long> idleTime; // in nanoseconds
     
   private:
     std::chrono::time_point<std::chrono::high_resolution_clock> t0; // time of reset
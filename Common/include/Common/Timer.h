@@ -8,12 +8,57 @@
 #define COMMON_TIMER_H
 
 
-#include <chrono>
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 
 namespace AliceO2 {
 namespace Common {
 
+/// \brief   Monotonic clock with low reading overhead, used by Timer.
+/// When the CPU has an invariant time stamp counter (constant rate, running in all power states),
+/// time is read from it and converted with a rate calibrated against CLOCK_MONOTONIC on first use (takes about 10ms).
+/// Otherwise, or if calibration is not consistent, CLOCK_MONOTONIC is used.
+class TimerClock {
+  public:
+
+    /// \return   Current time, in nanoseconds, same origin as CLOCK_MONOTONIC.
+    static inline uint64_t now();
+
+    /// \return   Current time, in nanoseconds, same origin as CLOCK_MONOTONIC.
+    /// Resolution is the kernel tick (a few milliseconds), but reading it is cheaper than now() in all cases.
+    static inline uint64_t coarseNow();
+
+    /// \return   1 if time stamp counter is used, 0 if CLOCK_MONOTONIC is used.
+    static int isTscEnabled();
+
+    /// \return   Calibrated time stamp counter frequency, in Hz (0 if not used).
+    static double getTscFrequency();
+
+    /// Select time source, e.g. for tests. Time stamp counter can be enabled only if available.
+    /// \param[in]   enabled   1 to use time stamp counter, 0 to use CLOCK_MONOTONIC.
+    /// \return      0 on success, -1 if time stamp counter not available.
+    static int setTscEnabled(int enabled);
+
+  private:
+    static uint64_t slowNow(); // calibrates on first call, and reads CLOCK_MONOTONIC
+    static inline uint64_t monotonicNow(clockid_t clockId);
+
+    // conversion from time stamp counter to nanoseconds, valid when isReady set
+    struct Calibration {
+      std::atomic<int> isReady; // set once calibration done and time stamp counter can be used
+      double nsPerTick; // duration of a counter increment
+      uint64_t tsc0; // counter value at reference time
+      uint64_t ns0; // CLOCK_MONOTONIC at reference time
+    };
+    static Calibration calibration;
+};
+
+
 /// \brief   Class to implement a high resolution timer function.
 /// All times in microseconds.
 /// Functionality: reset counter, set timeout value, get counter value, check timeout, fixed interval timeout.
@@ -39,15 +84,42 @@ class Timer {
     /// Check if time elapsed since timer reset (or last increment set) is bigger than timeout value set.
     /// \return Returns 1 if timeout, 0 otherwise.
     int isTimeout();
+
+    /// Same as isTimeout(), but using TimerClock::coarseNow(). Timeout may be detected a few milliseconds late.
+    /// Suited for periodic checks in hot loops, e.g. once per second.
+    /// \return Returns 1 if timeout, 0 otherwise.
+    int isTimeoutCoarse();
     
-    /// \return Returns time elapsed since reset, in microseconds.
+    /// \return Returns time elapsed since reset, in seconds.
     double getTime();    
     
   private:
-    std::chrono::time_point<std::chrono::high_resolution_clock> t0; // time of reset
-    double tmax; // duration between reset and timeout condition, in seconds
+    uint64_t t0; // time of reset, in nanoseconds
+    uint64_t t0Coarse; // time of reset from TimerClock::coarseNow(), used by isTimeoutCoarse() as clocks may drift apart
+    int64_t tmax; // duration between reset and timeout condition, in nanoseconds
 };
 
+
+
+uint64_t TimerClock::monotonicNow(clockid_t clockId) {
+  struct timespec ts;
+  clock_gettime(clockId,&ts);
+  return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+uint64_t TimerClock::now() {
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_expect(calibration.isReady.load(std::memory_order_acquire),1)) {
+    return calibration.ns0+(int64_t)((int64_t)(__rdtsc()-calibration.tsc0)*calibration.nsPerTick);
+  }
+#endif
+  return slowNow();
+}
+
+uint64_t TimerClock::coarseNow() {
+  return monotonicNow(CLOCK_MONOTONIC_COARSE);
+}
+
 } // namespace Common
 } // namespace AliceO2
 
@@ -201,3 +201,18 @@ ConfigFileBrowser::Iterator ConfigFileBrowser::end() {
   return Iterator(this,ptPtr->end(),ptPtr->end());
 }
  
+
+
+
+
+ConfigFileSection::ConfigFileSection(ConfigFile &cfg, const std::string section) {
+  boost::optional<boost::property_tree::ptree &> node = cfg.dPtr->pt.get_child_optional(section);
+  ptPtr = node ? &(*node) : nullptr;
+}
+
+ConfigFileSection::~ConfigFileSection() {
+}
+
+int ConfigFileSection::isFound() {
+  return (ptPtr != nullptr) ? 1 : 0;
+}
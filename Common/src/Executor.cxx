@@ -0,0 +1,359 @@
+#include <Common/Executor.h>
+#include <limits.h>
+using namespace AliceO2::Common;
+
+
+// a callback run by the executor
+struct AliceO2::Common::ExecutorTask {
+  int id;
+  Thread::CallbackResult (*loopCallback)(void *);
+  void *loopArg;
+  std::string name;
+  ThreadIdleBackoff backoff;
+
+  int nIdle=0; // number of consecutive idle calls
+  std::chrono::steady_clock::time_point dueTime; // when to call again, if sleeping
+
+  std::atomic<int> isRemoved{0}; // set when task should not be run anymore
+  int isDropped=0; // set (with tasksLock) when task not in any queue and not running
+
+  // activity counters. Written by one worker at a time, hand-over between workers is done through queue locks.
+  std::atomic<unsigned long long> busyIterations{0};
+  std::atomic<unsigned long long> idleIterations{0};
+  std::atomic<unsigned long long> busyTime{0}; // in nanoseconds
+  std::atomic<unsigned long long> idleTime{0}; // in nanoseconds
+};
+
+
+// a worker thread, and its queues of tasks
+struct AliceO2::Common::ExecutorWorker {
+  Executor *executor;
+  int index;
+  std::unique_ptr<Thread> thread;
+
+  std::mutex lock; // lock for queues
+  std::condition_variable wakeUp; // signaled when worker sleeping should look for tasks
+  std::deque<std::shared_ptr<ExecutorTask>> ready; // tasks to be run
+  std::vector<std::shared_ptr<ExecutorTask>> sleeping; // tasks waiting for their due time after Idle
+  std::atomic<int> isSleeping{0}; // set when worker waits for tasks
+  int isWakeUpRequested=0; // set (with lock) to interrupt worker wait
+};
+
+
+// maximum number of calls of a busy task in a row, before going to next task
+static const int maxCallsInRow=16;
+// maximum time a worker waits without looking for tasks of other workers, in microseconds
+static const int maxWorkerSleep=1000;
+
+
+Executor::Executor(int numberOfWorkers, std::string vName) {
+  name=vName;
+  lastTaskId=0;
+  nSteals=0;
+  if (numberOfWorkers<1) {
+    numberOfWorkers=1;
+  }
+  // worker threads never sleep in Thread loop: waiting is done in runOnce(), until next task due
+  ThreadIdleBackoff backoff;
+  backoff.spinCount=INT_MAX;
+  for (int i=0;i<numberOfWorkers;i++) {
+    std::unique_ptr<ExecutorWorker> w=std::make_unique<ExecutorWorker>();
+    w->executor=this;
+    w->index=i;
+    w->thread=std::make_unique<Thread>(Executor::workerCallback,w.get(),name + "-" + std::to_string(i),0);
+    w->thread->setIdleBackoff(backoff);
+    workers.push_back(std::move(w));
+  }
+}
+
+Executor::~Executor() {
+  stop();
+}
+
+void Executor::setWorkerPlacement(int worker, const ThreadPlacement &placement) {
+  if ((worker>=0)&&(worker<(int)workers.size())) {
+    workers[worker]->thread->setPlacement(placement);
+  }
+}
+
+int Executor::pinWorkers(const std::string &cpus) {
+  std::vector<int> cpuList;
+  if ((Thread::parseCpuList(cpus,cpuList))||(cpuList.empty())) {
+    return -1;
+  }
+  for (size_t i=0;i<workers.size();i++) {
+    ThreadPlacement placement;
+    placement.cpus=std::to_string(cpuList[i%cpuList.size()]);
+    workers[i]->thread->setPlacement(placement);
+  }
+  return 0;
+}
+
+int Executor::addTask(Thread::CallbackResult (*loopCallback)(void *), void *loopArg, std::string taskName, const ThreadIdleBackoff &backoff) {
+  std::shared_ptr<ExecutorTask> task=std::make_shared<ExecutorTask>();
+  task->loopCallback=loopCallback;
+  task->loopArg=loopArg;
+  task->name=taskName;
+  task->backoff=backoff;
+  if (task->backoff.sleepMax<task->backoff.sleepMin) {
+    task->backoff.sleepMax=task->backoff.sleepMin;
+  }
+  {
+    std::lock_guard<std::mutex> lock(tasksLock);
+    task->id=++lastTaskId;
+    tasks[task->id]=task;
+  }
+  // tasks distributed on workers in turn
+  ExecutorWorker &w=*workers[task->id%workers.size()];
+  {
+    std::lock_guard<std::mutex> lock(w.lock);
+    w.ready.push_back(task);
+    w.isWakeUpRequested=1;
+  }
+  w.wakeUp.notify_one();
+  return task->id;
+}
+
+int Executor::removeTask(int id) {
+  std::shared_ptr<ExecutorTask> task=nullptr;
+  {
+    std::lock_guard<std::mutex> lock(tasksLock);
+    auto it=tasks.find(id);
+    if (it==tasks.end()) {
+      return -1;
+    }
+    task=it->second;
+  }
+  task->isRemoved=1;
+
+  // remove from queues. If not found, it is running, and worker drops it when done.
+  for (auto &w : workers) {
+    std::lock_guard<std::mutex> lock(w->lock);
+    for (auto it=w->ready.begin();it!=w->ready.end();++it) {
+      if (*it==task) {
+        w->ready.erase(it);
+        dropTask(task);
+        break;
+      }
+    }
+    for (auto it=w->sleeping.begin();it!=w->sleeping.end();++it) {
+      if (*it==task) {
+        w->sleeping.erase(it);
+        dropTask(task);
+        break;
+      }
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(tasksLock);
+  taskDropped.wait(lock,[&task]{return task->isDropped;});
+  tasks.erase(id);
+  return 0;
+}
+
+void Executor::start() {
+  for (auto &w : workers) {
+    w->thread->start();
+  }
+}
+
+void Executor::stop() {
+  for (auto &w : workers) {
+    w->thread->stop();
+  }
+  for (auto &w : workers) {
+    {
+      std::lock_guard<std::mutex> lock(w->lock);
+      w->isWakeUpRequested=1;
+    }
+    w->wakeUp.notify_one();
+    w->thread->join();
+  }
+}
+
+int Executor::getTaskStats(int id, ThreadStats &stats) {
+  std::lock_guard<std::mutex> lock(tasksLock);
+  auto it=tasks.find(id);
+  if (it==tasks.end()) {
+    return -1;
+  }
+  ExecutorTask &t=*(it->second);
+  stats.busyIterations=t.busyIterations.load(std::memory_order_relaxed);
+  stats.idleIterations=t.idleIterations.load(std::memory_order_relaxed);
+  stats.busyTime=t.busyTime.load(std::memory_order_relaxed)/1000000000.0;
+  stats.idleTime=t.idleTime.load(std::memory_order_relaxed)/1000000000.0;
+  return 0;
+}
+
+void Executor::getWorkerStats(int worker, ThreadStats &stats) {
+  if ((worker>=0)&&(worker<(int)workers.size())) {
+    workers[worker]->thread->getStats(stats);
+  }
+}
+
+std::string Executor::getWorkerPlacement(int worker) {
+  if ((worker>=0)&&(worker<(int)workers.size())) {
+    return workers[worker]->thread->getPlacement();
+  }
+  return "";
+}
+
+int Executor::getNumberOfWorkers() {
+  return (int)workers.size();
+}
+
+unsigned long long Executor::getNumberOfSteals() {
+  return nSteals;
+}
+
+
+Thread::CallbackResult Executor::workerCallback(void *arg) {
+  ExecutorWorker *w=(ExecutorWorker *)arg;
+  return w->executor->runOnce(w->index);
+}
+
+std::shared_ptr<ExecutorTask> Executor::takeTaskFrom(int worker, int isSteal) {
+  ExecutorWorker &w=*workers[worker];
+  std::lock_guard<std::mutex> lock(w.lock);
+  std::shared_ptr<ExecutorTask> task=nullptr;
+  if (!w.ready.empty()) {
+    // owner takes from the front, thieves from the back
+    if (isSteal) {
+      task=std::move(w.ready.back());
+      w.ready.pop_back();
+    } else {
+      task=std::move(w.ready.front());
+      w.ready.pop_front();
+    }
+    return task;
+  }
+  if (!w.sleeping.empty()) {
+    auto now=std::chrono::steady_clock::now();
+    for (size_t i=0;i<w.sleeping.size();i++) {
+      if (w.sleeping[i]->dueTime<=now) {
+        task=std::move(w.sleeping[i]);
+        w.sleeping[i]=std::move(w.sleeping.back());
+        w.sleeping.pop_back();
+        return task;
+      }
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<ExecutorTask> Executor::takeTask(int worker) {
+  std::shared_ptr<ExecutorTask> task=takeTaskFrom(worker,0);
+  if (task!=nullptr) {
+    return task;
+  }
+  int n=(int)workers.size();
+  for (int k=1;k<n;k++) {
+    task=takeTaskFrom((worker+k)%n,1);
+    if (task!=nullptr) {
+      nSteals.fetch_add(1,std::memory_order_relaxed);
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void Executor::dropTask(std::shared_ptr<ExecutorTask> task) {
+  {
+    std::lock_guard<std::mutex> lock(tasksLock);
+    task->isDropped=1;
+  }
+  taskDropped.notify_all();
+}
+
+void Executor::reschedule(int worker, std::shared_ptr<ExecutorTask> task, Thread::CallbackResult result) {
+  if (result==Thread::CallbackResult::Done) {
+    dropTask(task);
+    return;
+  }
+  ExecutorWorker &w=*workers[worker];
+  int isBacklog=0;
+  {
+    std::lock_guard<std::mutex> lock(w.lock);
+    // checked with queue lock: either removeTask() finds the task queued, or the task is not queued again
+    if (task->isRemoved) {
+      dropTask(task);
+      return;
+    }
+    if (result==Thread::CallbackResult::Idle) {
+      if (task->nIdle<INT_MAX) {
+        task->nIdle++;
+      }
+      if (task->nIdle<=task->backoff.spinCount) {
+        w.ready.push_back(std::move(task));
+      } else {
+        int sleepTime=getThreadIdleSleepTime(task->backoff,task->nIdle-task->backoff.spinCount);
+        task->dueTime=std::chrono::steady_clock::now()+std::chrono::microseconds(sleepTime);
+        w.sleeping.push_back(std::move(task));
+      }
+    } else {
+      task->nIdle=0;
+      w.ready.push_back(std::move(task));
+    }
+    isBacklog=(w.ready.size()>1);
+  }
+
+  // more tasks ready than this worker can run: wake up a sleeping worker to steal them
+  if (isBacklog) {
+    for (auto &other : workers) {
+      if (other->isSleeping.load(std::memory_order_relaxed)) {
+        {
+          std::lock_guard<std::mutex> lock(other->lock);
+          other->isWakeUpRequested=1;
+        }
+        other->wakeUp.notify_one();
+        break;
+      }
+    }
+  }
+}
+
+Thread::CallbackResult Executor::runOnce(int worker) {
+  std::shared_ptr<ExecutorTask> task=takeTask(worker);
+
+  if (task==nullptr) {
+    // nothing to run: wait until next task of this worker is due, or until woken up
+    ExecutorWorker &w=*workers[worker];
+    std::unique_lock<std::mutex> lock(w.lock);
+    if ((w.ready.empty())&&(!w.isWakeUpRequested)) {
+      auto dueTime=std::chrono::steady_clock::now()+std::chrono::microseconds(maxWorkerSleep);
+      for (auto &t : w.sleeping) {
+        if (t->dueTime<dueTime) {
+          dueTime=t->dueTime;
+        }
+      }
+      w.isSleeping=1;
+      w.wakeUp.wait_until(lock,dueTime,[&w]{return (!w.ready.empty())||(w.isWakeUpRequested);});
+      w.isSleeping=0;
+    }
+    w.isWakeUpRequested=0;
+    return Thread::CallbackResult::Idle;
+  }
+
+  // call task while it has work to do
+  Thread::CallbackResult result=Thread::CallbackResult::Ok;
+  for (int i=0;i<maxCallsInRow;i++) {
+    if (task->isRemoved) {
+      break;
+    }
+    auto t0=std::chrono::steady_clock::now();
+    result=task->loopCallback(task->loopArg);
+    unsigned long long dt=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count();
+    if (result==Thread::CallbackResult::Idle) {
+      task->idleIterations.store(task->idleIterations.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+      task->idleTime.store(task->idleTime.load(std::memory_order_relaxed)+dt,std::memory_order_relaxed);
+      break;
+    }
+    task->busyIterations.store(task->busyIterations.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+    task->busyTime.store(task->busyTime.load(std::memory_order_relaxed)+dt,std::memory_order_relaxed);
+    if (result==Thread::CallbackResult::Done) {
+      break;
+    }
+  }
+  reschedule(worker,task,result);
+  return Thread::CallbackResult::Ok;
+}
@@ -0,0 +1,166 @@
+///
+/// \file    Histogram.cxx
+///
+
+#include "Common/Histogram.h"
+
+#include <stdio.h>
+
+namespace AliceO2 {
+namespace Common {
+
+Histogram::Histogram() {
+  reset();
+}
+
+Histogram::Histogram(const Histogram &h) {
+  reset();
+  merge(h);
+}
+
+Histogram::~Histogram() {
+}
+
+void Histogram::reset() {
+  for (int i=0;i<numberOfBuckets;i++) {
+    buckets[i].store(0,std::memory_order_relaxed);
+  }
+  count.store(0,std::memory_order_relaxed);
+  minValue.store(UINT64_MAX,std::memory_order_relaxed);
+  maxValue.store(0,std::memory_order_relaxed);
+}
+
+void Histogram::merge(const Histogram &h) {
+  for (int i=0;i<numberOfBuckets;i++) {
+    uint64_t n=h.buckets[i].load(std::memory_order_relaxed);
+    if (n) {
+      buckets[i].store(buckets[i].load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+    }
+  }
+  count.store(count.load(std::memory_order_relaxed)+h.count.load(std::memory_order_relaxed),std::memory_order_relaxed);
+  uint64_t v=h.minValue.load(std::memory_order_relaxed);
+  if (v<minValue.load(std::memory_order_relaxed)) {
+    minValue.store(v,std::memory_order_relaxed);
+  }
+  v=h.maxValue.load(std::memory_order_relaxed);
+  if (v>maxValue.load(std::memory_order_relaxed)) {
+    maxValue.store(v,std::memory_order_relaxed);
+  }
+}
+
+uint64_t Histogram::getBucketLowestValue(int index) {
+  if (index<2*subBucketCount) {
+    return index;
+  }
+  int shift=index/subBucketCount-1;
+  return ((uint64_t)(index-shift*subBucketCount))<<shift;
+}
+
+uint64_t Histogram::getBucketHighestValue(int index) {
+  if (index<2*subBucketCount) {
+    return index;
+  }
+  int shift=index/subBucketCount-1;
+  return getBucketLowestValue(index)+((1ULL<<shift)-1);
+}
+
+uint64_t Histogram::getCount() const {
+  return count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMin() const {
+  uint64_t v=minValue.load(std::memory_order_relaxed);
+  return (v==UINT64_MAX) ? 0 : v;
+}
+
+uint64_t Histogram::getMax() const {
+  return maxValue.load(std::memory_order_relaxed);
+}
+
+double Histogram::getMean() const {
+  double sum=0;
+  uint64_t n=0;
+  for (int i=0;i<numberOfBuckets;i++) {
+    uint64_t c=buckets[i].load(std::memory_order_relaxed);
+    if (c) {
+      // middle of bucket
+      sum+=c*((getBucketLowestValue(i)+(double)getBucketHighestValue(i))/2.0);
+      n+=c;
+    }
+  }
+  return (n>0) ? sum/n : 0;
+}
+
+uint64_t Histogram::getPercentile(double percentile) const {
+  // buckets may be updated concurrently: use the sum of buckets read, not the total count
+  uint64_t counts[numberOfBuckets];
+  uint64_t n=0;
+  for (int i=0;i<numberOfBuckets;i++) {
+    counts[i]=buckets[i].load(std::memory_order_relaxed);
+    n+=counts[i];
+  }
+  if (n==0) {
+    return 0;
+  }
+  if (percentile<0) {
+    percentile=0;
+  } else if (percentile>100) {
+    percentile=100;
+  }
+  // rank of requested value, from 1 to n
+  uint64_t rank=(uint64_t)(percentile*n/100.0+0.5);
+  if (rank<1) {
+    rank=1;
+  }
+  uint64_t sum=0;
+  for (int i=0;i<numberOfBuckets;i++) {
+    sum+=counts[i];
+    if (sum>=rank) {
+      uint64_t v=getBucketHighestValue(i);
+      // do not report more than the largest value seen
+      uint64_t vMax=getMax();
+      return ((vMax>0)&&(v>vMax)) ? vMax : v;
+    }
+  }
+  return getMax();
+}
+
+std::string Histogram::toString(const char *unit) const {
+  char buffer[256];
+  snprintf(buffer,sizeof(buffer),"count=%llu min=%llu%s mean=%.1f%s p50=%llu%s p99=%llu%s p99.9=%llu%s max=%llu%s",
+    (unsigned long long)getCount(),
+    (unsigned long long)getMin(),unit,
+    getMean(),unit,
+    (unsigned long long)getPercentile(50),unit,
+    (unsigned long long)getPercentile(99),unit,
+    (unsigned long long)getPercentile(99.9),unit,
+    (unsigned long long)getMax(),unit);
+  return buffer;
+}
+
+std::string Histogram::toJSON() const {
+  char buffer[256];
+  snprintf(buffer,sizeof(buffer),"{\"count\":%llu,\"min\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p99\":%llu,\"p99.9\":%llu,\"max\":%llu,\"buckets\":[",
+    (unsigned long long)getCount(),
+    (unsigned long long)getMin(),
+    getMean(),
+    (unsigned long long)getPercentile(50),
+    (unsigned long long)getPercentile(99),
+    (unsigned long long)getPercentile(99.9),
+    (unsigned long long)getMax());
+  std::string s=buffer;
+  int isFirst=1;
+  for (int i=0;i<numberOfBuckets;i++) {
+    uint64_t c=buckets[i].load(std::memory_order_relaxed);
+    if (c) {
+      snprintf(buffer,sizeof(buffer),"%s[%llu,%llu]",isFirst ? "" : ",",(unsigned long long)getBucketLowestValue(i),(unsigned long long)c);
+      s+=buffer;
+      isFirst=0;
+    }
+  }
+  s+="]}";
+  return s;
+}
+
+} // namespace Common
+} // namespace AliceO2
@@ -1,7 +1,13 @@
 #include <Common/SimpleLog.h>
+#include <Common/FifoMPMC.h>
 
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <thread>
 #include <time.h>
-#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
 
 class SimpleLog::Impl {
   public:
@@ -20,10 +26,41 @@ class SimpleLog::Impl {
   // \param message   Message content, printf-like format.
   // \param ap        Variable list of arguments associated with message.
   int logV(SimpleLog::Impl::Severity severity, const char *message, va_list ap);
-  
+
+  // format message in given buffer, with timestamp and severity as defined by formatOptions
+  // \return          Length of formatted message, excluding trailing NUL.
+  size_t formatV(char *buffer, size_t len, SimpleLog::Impl::Severity severity, const char *message, va_list ap);
+  size_t format(char *buffer, size_t len, SimpleLog::Impl::Severity severity, const char *message, ...) __attribute__ ((format (printf, 5,6)));
+
+  // asynchronous mode
+  int startWriter(int queueSize); // allocate queue and start writer thread
+  void stopWriter(); // write pending messages and stop writer thread
+  int writePending(); // write queued messages. Returns number of messages written.
+  void flushAll(); // write queued messages, and those being formatted by other threads at the time of the call
+  void writerLoop(); // writer thread main loop
+
   protected: 
   FILE *fp; // descriptor to be used. If NULL, using stdout/stderr.
   int formatOptions;
+
+  static const int recordSize=1024; // maximum size of a formatted message
+  struct Record {
+    std::atomic<unsigned int> sequence{0}; // incremented when record taken from free list, and when message complete: odd while message formatted
+    std::atomic<unsigned int> written{0}; // sequence number of the last message of this record written
+    Severity severity;
+    int length;
+    char data[recordSize];
+  };
+  std::atomic<int> isAsynchronous; // set when messages are queued
+  std::atomic<int> nWriters; // number of threads using the queues in logV(). Queues are not deleted until it is back to zero.
+  std::vector<Record> records; // message buffers
+  std::unique_ptr<AliceO2::Common::FifoMPMC<int>> freeRecords; // indexes of records available
+  std::unique_ptr<AliceO2::Common::FifoMPMC<int>> pendingRecords; // indexes of records to be written, in order
+  std::atomic<unsigned long long> nDropped; // number of messages dropped because queue full
+  unsigned long long nDroppedReported; // number of dropped messages already reported in log
+  std::mutex outputLock; // lock for output from writer thread, and change of output file
+  std::unique_ptr<std::thread> writerThread;
+  std::atomic<int> writerShutdown; // set to stop writer thread
   
   friend class SimpleLog;
 };
@@ -33,9 +70,15 @@ SimpleLog::Impl::Impl() {
   formatOptions =   SimpleLog::FormatOption::ShowTimeStamp
                   | SimpleLog::FormatOption::ShowSeveritySymbol
                   | SimpleLog::FormatOption::ShowMessage;
+  isAsynchronous=0;
+  nWriters=0;
+  nDropped=0;
+  nDroppedReported=0;
+  writerShutdown=0;
 }
 
 SimpleLog::Impl::~Impl() {
+  stopWriter();
   if (fp!=NULL) {
     fclose(fp);
     fp=NULL;
@@ -43,31 +86,40 @@ SimpleLog::Impl::~Impl() {
 }
 
 
-int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char *message, va_list ap)
+// timestamp of current second, formatted once per second by each thread
+struct SimpleLogTimeStampCache {
+  time_t second=-1;
+  char str[32];
+  size_t length=0;
+};
+static thread_local SimpleLogTimeStampCache timeStampCache;
+
+
+size_t SimpleLog::Impl::formatV(char *buffer, size_t len, SimpleLog::Impl::Severity s, const char *message, va_list ap)
 {
-  char buffer[1024] = "";
-  size_t len = sizeof(buffer);
   size_t ix = 0;
 
   if (formatOptions & SimpleLog::FormatOption::ShowTimeStamp) {  
     // timestamp (microsecond)
-    struct timeval tv;
-    double fullTimeNow=-1;
-    if(gettimeofday(&tv,NULL) == -1){
-      fullTimeNow = time(NULL);
-    } else {
-      fullTimeNow = (double)tv.tv_sec + (double)tv.tv_usec/1000000;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    SimpleLogTimeStampCache &c=timeStampCache;
+    if (ts.tv_sec!=c.second) {
+      struct tm tm_str;
+      localtime_r(&ts.tv_sec, &tm_str);
+      c.length=strftime(c.str, sizeof(c.str), "%Y-%m-%d %T.", &tm_str);
+      c.second=ts.tv_sec;
+    }
+    if (c.length+7<len) {
+      memcpy(&buffer[ix],c.str,c.length);
+      ix+=c.length;
+      long fractionOfSecond=ts.tv_nsec/1000;
+      for (int i=5;i>=0;i--) {
+        buffer[ix+i]='0'+fractionOfSecond%10;
+        fractionOfSecond/=10;
+      }
+      ix+=6;
     }
-    time_t now;
-    struct tm tm_str;
-    now = (time_t)fullTimeNow;
-    localtime_r(&now, &tm_str);
-    double fractionOfSecond=fullTimeNow-now;
-    ix+=strftime(&buffer[ix], len-ix, "%Y-%m-%d %T", &tm_str);
-    char str_fractionOfSecond[10];
-    snprintf(str_fractionOfSecond,sizeof(str_fractionOfSecond),"%.6lf",fractionOfSecond);
-    ix+=snprintf(&buffer[ix], len-ix, ".%s",&str_fractionOfSecond[2]);
-    if (ix>len) { ix=len; }
   }
 
   if (formatOptions & SimpleLog::FormatOption::ShowSeveritySymbol) {
@@ -78,6 +130,7 @@ int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char *message, va_l
     } else {
       ix+=snprintf(&buffer[ix], len-ix, "     ");
     }
+    if (ix>len-1) { ix=len-1; }
   }
 
   if (formatOptions & SimpleLog::FormatOption::ShowSeverityTxt) {
@@ -88,15 +141,55 @@ int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char *message, va_l
     } else {
       //ix+=snprintf(&buffer[ix], len-ix, "");
     }
+    if (ix>len-1) { ix=len-1; }
   }
 
   
   if (formatOptions & SimpleLog::FormatOption::ShowMessage) {
    ix+=vsnprintf(&buffer[ix], len-ix, message, ap);
-   if (ix>len) { ix=len; } 
+   if (ix>len-1) { ix=len-1; } 
   }
   
   buffer[ix]=0;
+  return ix;
+}
+
+size_t SimpleLog::Impl::format(char *buffer, size_t len, SimpleLog::Impl::Severity s, const char *message, ...)
+{
+  va_list ap;
+  va_start(ap, message);
+  size_t ix=formatV(buffer, len, s, message, ap);
+  va_end(ap);
+  return ix;
+}
+
+
+int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char *message, va_list ap)
+{
+  // writers count is updated before checking mode, so that stopWriter() either sees this thread, or this thread sees synchronous mode
+  nWriters.fetch_add(1,std::memory_order_seq_cst);
+  if (isAsynchronous.load(std::memory_order_seq_cst)) {
+    // format in a free record, and queue it. Drop message if none free.
+    int id;
+    if (freeRecords->pop(id)) {
+      nDropped.fetch_add(1,std::memory_order_relaxed);
+      nWriters.fetch_sub(1,std::memory_order_release);
+      return -1;
+    }
+    Record &r=records[id];
+    r.sequence.fetch_add(1,std::memory_order_seq_cst);
+    r.severity=s;
+    r.length=formatV(r.data, sizeof(r.data), s, message, ap);
+    // message complete before it is queued: once queued, the record may be written and reused by another thread
+    r.sequence.fetch_add(1,std::memory_order_release);
+    pendingRecords->push(id);
+    nWriters.fetch_sub(1,std::memory_order_release);
+    return 0;
+  }
+  nWriters.fetch_sub(1,std::memory_order_release);
+
+  char buffer[recordSize] = "";
+  formatV(buffer, sizeof(buffer), s, message, ap);
 
   FILE *fpOut=stdout;
   
@@ -113,6 +206,126 @@ int SimpleLog::Impl::logV(SimpleLog::Impl::Severity s, const char *message, va_l
 }
 
 
+int SimpleLog::Impl::startWriter(int queueSize) {
+  if (queueSize<=0) {
+    return -1;
+  }
+  records=std::vector<Record>(queueSize);
+  freeRecords=std::make_unique<AliceO2::Common::FifoMPMC<int>>(queueSize);
+  pendingRecords=std::make_unique<AliceO2::Common::FifoMPMC<int>>(queueSize);
+  for (int i=0;i<queueSize;i++) {
+    freeRecords->push(i);
+  }
+  writerShutdown=0;
+  writerThread=std::make_unique<std::thread>(&SimpleLog::Impl::writerLoop,this);
+  isAsynchronous=1;
+  return 0;
+}
+
+void SimpleLog::Impl::stopWriter() {
+  if (writerThread==nullptr) {
+    return;
+  }
+  isAsynchronous=0;
+  // threads still in logV() may be using the queues
+  while (nWriters.load(std::memory_order_acquire)>0) {
+    std::this_thread::yield();
+  }
+  writerShutdown=1;
+  writerThread->join();
+  writerThread=nullptr;
+  writePending();
+  records.clear();
+  freeRecords=nullptr;
+  pendingRecords=nullptr;
+}
+
+int SimpleLog::Impl::writePending() {
+  std::lock_guard<std::mutex> lock(outputLock);
+  if (pendingRecords==nullptr) {
+    return 0;
+  }
+
+  // write all messages available, flush once
+  int nWritten=0;
+  int isStdout=0;
+  int isStderr=0;
+  int id;
+  while (pendingRecords->pop(id)==0) {
+    Record &r=records[id];
+    FILE *fpOut=fp;
+    if (fpOut==NULL) {
+      if (r.severity==Severity::Error) {
+        fpOut=stderr;
+        isStderr=1;
+      } else {
+        fpOut=stdout;
+        isStdout=1;
+      }
+    }
+    r.data[r.length]='\n';
+    fwrite(r.data,1,r.length+1,fpOut);
+    r.written.store(r.sequence.load(std::memory_order_relaxed),std::memory_order_release);
+    freeRecords->push(id);
+    nWritten++;
+  }
+
+  // report messages lost since last time
+  unsigned long long n=nDropped.load(std::memory_order_relaxed);
+  if (n!=nDroppedReported) {
+    char buffer[recordSize];
+    size_t len=format(buffer, sizeof(buffer), Severity::Warning, "%llu messages dropped", n-nDroppedReported);
+    buffer[len]='\n';
+    fwrite(buffer,1,len+1,(fp!=NULL)?fp:stderr);
+    isStderr=1;
+    nDroppedReported=n;
+    nWritten++;
+  }
+
+  if (nWritten) {
+    if (fp!=NULL) {
+      fflush(fp);
+    }
+    if (isStdout) {
+      fflush(stdout);
+    }
+    if (isStderr) {
+      fflush(stderr);
+    }
+  }
+  return nWritten;
+}
+
+void SimpleLog::Impl::flushAll() {
+  // for each record, sequence number of its message being formatted or waiting to be written, if any
+  std::vector<unsigned int> target(records.size());
+  for (size_t i=0;i<records.size();i++) {
+    target[i]=(records[i].sequence.load(std::memory_order_seq_cst)+1)&~1U;
+  }
+  // wait until these messages (or later ones in the same record) are written
+  for (size_t i=0;i<records.size();i++) {
+    while ((int)(records[i].written.load(std::memory_order_acquire)-target[i])<0) {
+      if (writePending()==0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+  writePending();
+}
+
+void SimpleLog::Impl::writerLoop() {
+  for (;;) {
+    if (writePending()==0) {
+      if (writerShutdown) {
+        break;
+      }
+      // batch messages arriving in the meantime
+      usleep(1000);
+    }
+  }
+}
+
+
 
 
 
@@ -124,10 +337,13 @@ SimpleLog::SimpleLog(const char* logFilePath) {
 }
 
 SimpleLog::~SimpleLog() {
+  pImpl->stopWriter();
   setLogFile(NULL);
 }
 
 int SimpleLog::setLogFile(const char* logFilePath) {
+  pImpl->writePending();
+  std::lock_guard<std::mutex> lock(pImpl->outputLock);
   if (pImpl->fp!=NULL) {
     fclose(pImpl->fp);
     pImpl->fp=NULL;
@@ -182,4 +398,22 @@ void SimpleLog::setOutputFormat(int opts) {
   pImpl->formatOptions=opts;
 }
 
-/// \todo: thread to flush output every 1 second
+int SimpleLog::setAsynchronous(int queueSize) {
+  pImpl->stopWriter();
+  if (queueSize>0) {
+    return pImpl->startWriter(queueSize);
+  }
+  return 0;
+}
+
+void SimpleLog::flush() {
+  if (pImpl->isAsynchronous.load(std::memory_order_acquire)) {
+    pImpl->flushAll();
+  } else {
+    pImpl->writePending();
+  }
+}
+
+unsigned long long SimpleLog::getNumberOfDroppedMessages() {
+  return pImpl->nDropped.load(std::memory_order_relaxed);
+}
@@ -1,8 +1,69 @@
 #include <Common/Thread.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <limits.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 using namespace AliceO2::Common;
 
+#ifdef __linux__
+// NUMA memory policy, as defined in numaif.h (not using libnuma)
+#define THREAD_MPOL_PREFERRED 1
+#endif
+
+
+int Thread::parseCpuList(const std::string &list, std::vector<int> &cpus) {
+  cpus.clear();
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss,item,',')) {
+    int first, last;
+    char dummy;
+    if (sscanf(item.c_str(),"%d-%d%c",&first,&last,&dummy)==2) {
+    } else if (sscanf(item.c_str(),"%d%c",&first,&dummy)==1) {
+      last=first;
+    } else {
+      return -1;
+    }
+    if ((first<0)||(last<first)) {
+      return -1;
+    }
+    for (int i=first;i<=last;i++) {
+      cpus.push_back(i);
+    }
+  }
+  return 0;
+}
+
+// format a list of CPUs, grouping consecutive ones, e.g. "0-3,8"
+static std::string formatCpuList(const std::vector<int> &cpus) {
+  std::string list;
+  for (size_t i=0;i<cpus.size();) {
+    size_t j=i;
+    while ((j+1<cpus.size())&&(cpus[j+1]==cpus[j]+1)) {
+      j++;
+    }
+    if (list.length()) {
+      list+=",";
+    }
+    list+=std::to_string(cpus[i]);
+    if (j>i) {
+      list+="-" + std::to_string(cpus[j]);
+    }
+    i=j+1;
+  }
+  return list;
+}
+
 Thread::Thread(Thread::CallbackResult (*vLoopCallback)(void *), void *vLoopArg, std::string vThreadName, int vLoopSleepTime) {
   shutdown=0;
   running=0;
@@ -11,6 +72,13 @@ Thread::Thread(Thread::CallbackResult (*vLoopCallback)(void *), void *vLoopArg,
   loopCallback=vLoopCallback;
   loopArg=vLoopArg;
   loopSleepTime=vLoopSleepTime;
+  isStarted=0;
+  idleBackoff.sleepMin=loopSleepTime;
+  idleBackoff.sleepMax=loopSleepTime;
+  busyIterations=0;
+  idleIterations=0;
+  busyTime=0;
+  idleTime=0;
 }
 
 Thread::~Thread() {
@@ -20,11 +88,66 @@ Thread::~Thread() {
   }
 }
 
+void Thread::setPlacement(const ThreadPlacement &vPlacement) {
+  placement=vPlacement;
+}
+
+void Thread::setIdleBackoff(const ThreadIdleBackoff &backoff) {
+  idleBackoff=backoff;
+  if (idleBackoff.sleepMin<0) {
+    idleBackoff.sleepMin=0;
+  }
+  if (idleBackoff.sleepMax<idleBackoff.sleepMin) {
+    idleBackoff.sleepMax=idleBackoff.sleepMin;
+  }
+}
+
+void Thread::getStats(ThreadStats &stats) {
+  stats.busyIterations=busyIterations.load(std::memory_order_relaxed);
+  stats.idleIterations=idleIterations.load(std::memory_order_relaxed);
+  stats.busyTime=busyTime.load(std::memory_order_relaxed)/1000000000.0;
+  stats.idleTime=idleTime.load(std::memory_order_relaxed)/1000000000.0;
+}
+
+int AliceO2::Common::getThreadIdleSleepTime(const ThreadIdleBackoff &backoff, int nSleep) {
+  if (backoff.sleepMax<=0) {
+    return 0;
+  }
+  // sleepMin<2^31 and sleepMax<2^31: shifting more than 31 bits always gives sleepMax, and does not overflow below
+  long long sleepMin=(backoff.sleepMin<1) ? 1 : backoff.sleepMin;
+  int shift=(nSleep<1) ? 0 : nSleep-1;
+  if (shift>31) {
+    shift=31;
+  }
+  long long sleepTime=sleepMin<<shift;
+  return (sleepTime>backoff.sleepMax) ? backoff.sleepMax : (int)sleepTime;
+}
+
+void Thread::idleWait(int nIdle) {
+  if (nIdle<=idleBackoff.spinCount) {
+    return;
+  }
+  nIdle-=idleBackoff.spinCount;
+  if (nIdle<=idleBackoff.yieldCount) {
+    sched_yield();
+    return;
+  }
+  nIdle-=idleBackoff.yieldCount;
+  int sleepTime=getThreadIdleSleepTime(idleBackoff,nIdle);
+  if (sleepTime>0) {
+    usleep(sleepTime);
+  }
+}
+
 void Thread::start() {
   if (theThread==NULL) {
     shutdown=0;
     running=0;
+    isStarted=0;
     theThread= new std::thread(threadMain,this);
+    // wait placement applied, so that it can be reported
+    std::unique_lock<std::mutex> lock(startLock);
+    startCondition.wait(lock,[this]{return isStarted;});
   }
   return;  
 }
@@ -46,26 +169,53 @@ void Thread::join() {
 }
 
 void Thread::threadMain(Thread *e) {
+  e->applyPlacement();
+  {
+    std::lock_guard<std::mutex> lock(e->startLock);
+    e->isStarted=1;
+  }
+  e->startCondition.notify_all();
+
   e->running=1;
   int maxIterOnShutdown=100;
   int nIterOnShutdown=0;
-  
+  int nIdle=0; // number of consecutive idle iterations
+
+  // time of each iteration (including idle wait) is accounted as busy or idle, depending on loop result
+  auto t0=std::chrono::steady_clock::now();
   for(;;) {
     if (e->shutdown) {
       if (nIterOnShutdown>=maxIterOnShutdown) break;
       nIterOnShutdown++;
     }
     int r=e->doLoop();
+    int isIdle=0;
     if (r==Thread::CallbackResult::Ok) {
     } else if (r==Thread::CallbackResult::Idle) {
       if (e->shutdown) break; // exit immediately on shutdown
-      usleep(e->loopSleepTime);
+      isIdle=1;
+      if (nIdle<INT_MAX) {
+        nIdle++;
+      }
+      e->idleWait(nIdle);
     } else if (r==Thread::CallbackResult::Error) {
       // account this error... maybe do something if repetitive
       if (e->shutdown) break; // exit immediately on shutdown
     } else {
       break;
     }
+    auto t1=std::chrono::steady_clock::now();
+    unsigned long long dt=std::chrono::duration_cast<std::chrono::nanoseconds>(t1-t0).count();
+    t0=t1;
+    // single writer: no need for atomic increments
+    if (isIdle) {
+      e->idleIterations.store(e->idleIterations.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+      e->idleTime.store(e->idleTime.load(std::memory_order_relaxed)+dt,std::memory_order_relaxed);
+    } else {
+      nIdle=0;
+      e->busyIterations.store(e->busyIterations.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+      e->busyTime.store(e->busyTime.load(std::memory_order_relaxed)+dt,std::memory_order_relaxed);
+    }
   }
   e->running=0;
 }
@@ -83,3 +233,129 @@ std::string Thread::getName() {
   return name;
 }
 
+std::string Thread::getPlacement() {
+  std::lock_guard<std::mutex> lock(startLock);
+  return effectivePlacement;
+}
+
+
+void Thread::applyPlacement() {
+  std::string errors;
+  auto addError=[&](std::string err) {
+    errors+=((errors.length()) ? ", " : "") + err;
+  };
+
+#ifdef __linux__
+  // name visible in system tools (limited to 15 characters)
+  if (name.length()) {
+    pthread_setname_np(pthread_self(),name.substr(0,15).c_str());
+  }
+
+  // CPUs allowed: those requested, restricted to the ones of the NUMA node
+  std::vector<int> cpus;
+  int isCpuSetDefined=0;
+  if (placement.cpus.length()) {
+    if (parseCpuList(placement.cpus,cpus)) {
+      addError("invalid CPU list " + placement.cpus);
+    } else {
+      isCpuSetDefined=1;
+    }
+  }
+  int numaNode=-1;
+  if (placement.numaNode>=0) {
+    std::string nodeCpuList;
+    std::vector<int> nodeCpus;
+    std::ifstream nodeFile("/sys/devices/system/node/node" + std::to_string(placement.numaNode) + "/cpulist");
+    if ((!std::getline(nodeFile,nodeCpuList))||(parseCpuList(nodeCpuList,nodeCpus))) {
+      addError("unknown NUMA node " + std::to_string(placement.numaNode));
+    } else {
+      if (isCpuSetDefined) {
+        std::vector<int> common;
+        for (auto c : cpus) {
+          for (auto n : nodeCpus) {
+            if (c==n) {
+              common.push_back(c);
+            }
+          }
+        }
+        cpus=common;
+      } else {
+        cpus=nodeCpus;
+      }
+      isCpuSetDefined=1;
+      // memory preferably allocated from this node
+      const int bitsPerLong=8*sizeof(unsigned long);
+      std::vector<unsigned long> nodeMask(placement.numaNode/bitsPerLong+1,0);
+      nodeMask[placement.numaNode/bitsPerLong]=1UL << (placement.numaNode%bitsPerLong);
+      if (syscall(SYS_set_mempolicy,THREAD_MPOL_PREFERRED,&nodeMask[0],nodeMask.size()*bitsPerLong+1)==0) {
+        numaNode=placement.numaNode;
+      } else {
+        addError("failed to set memory policy: " + std::string(strerror(errno)));
+      }
+    }
+  }
+  if (isCpuSetDefined) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (auto c : cpus) {
+      if (c<CPU_SETSIZE) {
+        CPU_SET(c,&cpuSet);
+      }
+    }
+    if (CPU_COUNT(&cpuSet)==0) {
+      addError("no CPU selected");
+    } else if (pthread_setaffinity_np(pthread_self(),sizeof(cpuSet),&cpuSet)) {
+      addError("failed to set CPU affinity");
+    }
+  }
+
+  // scheduling policy
+  if (placement.realtimePriority>0) {
+    struct sched_param param;
+    param.sched_priority=placement.realtimePriority;
+    int err=pthread_setschedparam(pthread_self(),(placement.realtimeRoundRobin) ? SCHED_RR : SCHED_FIFO,&param);
+    if (err) {
+      addError("failed to set real-time priority: " + std::string(strerror(err)));
+    }
+  }
+
+  // report what was actually applied
+  std::string description;
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  if (pthread_getaffinity_np(pthread_self(),sizeof(cpuSet),&cpuSet)==0) {
+    std::vector<int> allowed;
+    for (int i=0;i<CPU_SETSIZE;i++) {
+      if (CPU_ISSET(i,&cpuSet)) {
+        allowed.push_back(i);
+      }
+    }
+    description="CPU " + formatCpuList(allowed);
+  }
+  if (numaNode>=0) {
+    description+=", NUMA node " + std::to_string(numaNode);
+  }
+  int policy;
+  struct sched_param param;
+  if (pthread_getschedparam(pthread_self(),&policy,&param)==0) {
+    if (policy==SCHED_FIFO) {
+      description+=", SCHED_FIFO priority " + std::to_string(param.sched_priority);
+    } else if (policy==SCHED_RR) {
+      description+=", SCHED_RR priority " + std::to_string(param.sched_priority);
+    } else {
+      description+=", default scheduling";
+    }
+  }
+#else
+  std::string description="default placement";
+  if ((placement.cpus.length())||(placement.numaNode>=0)||(placement.realtimePriority>0)) {
+    addError("placement not supported on this system");
+  }
+#endif
+
+  if (errors.length()) {
+    description+=" (" + errors + ")";
+  }
+  std::lock_guard<std::mutex> lock(startLock);
+  effectivePlacement=description;
+}
@@ -5,10 +5,122 @@
 
 #include "Common/Timer.h"
 
+#include <mutex>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
 
 namespace AliceO2 {
 namespace Common {
 
+TimerClock::Calibration TimerClock::calibration;
+
+// time stamp counter calibration state
+static std::once_flag tscCalibrationFlag;
+static int tscAvailable=0; // set if time stamp counter usable
+static double tscNsPerTick=0; // calibrated duration of a counter increment
+static uint64_t tscRef=0; // counter value at reference time
+static uint64_t nsRef=0; // CLOCK_MONOTONIC at reference time
+
+#if defined(__x86_64__) || defined(__i386__)
+// read a pair of (counter, CLOCK_MONOTONIC) as close in time as possible
+static void readTscPair(uint64_t &tsc, uint64_t &ns) {
+  uint64_t bestDelta=0;
+  for (int i=0;i<10;i++) {
+    struct timespec ts;
+    uint64_t t1=__rdtsc();
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    uint64_t t2=__rdtsc();
+    if ((i==0)||(t2-t1<bestDelta)) {
+      bestDelta=t2-t1;
+      tsc=t1+(t2-t1)/2;
+      ns=ts.tv_sec*1000000000ULL+ts.tv_nsec;
+    }
+  }
+}
+#endif
+
+// check time stamp counter is invariant, and measure its rate
+static void calibrateTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000,&eax,&ebx,&ecx,&edx)||(eax<0x80000007)) {
+    return;
+  }
+  __get_cpuid(0x80000007,&eax,&ebx,&ecx,&edx);
+  if (!(edx&(1<<8))) {
+    // not invariant
+    return;
+  }
+
+  // two consecutive measurements of the rate, which should agree
+  const int calibrationTime=5000; // in microseconds
+  uint64_t tsc[3], ns[3];
+  readTscPair(tsc[0],ns[0]);
+  usleep(calibrationTime);
+  readTscPair(tsc[1],ns[1]);
+  usleep(calibrationTime);
+  readTscPair(tsc[2],ns[2]);
+  if ((tsc[1]<=tsc[0])||(tsc[2]<=tsc[1])||(ns[1]<=ns[0])||(ns[2]<=ns[1])) {
+    return;
+  }
+  double r1=(ns[1]-ns[0])/(double)(tsc[1]-tsc[0]);
+  double r2=(ns[2]-ns[1])/(double)(tsc[2]-tsc[1]);
+  if ((r1-r2>r1*0.0001)||(r2-r1>r1*0.0001)) {
+    return;
+  }
+  tscNsPerTick=(ns[2]-ns[0])/(double)(tsc[2]-tsc[0]);
+  tscRef=tsc[2];
+  nsRef=ns[2];
+  tscAvailable=1;
+#endif
+}
+
+uint64_t TimerClock::slowNow() {
+  std::call_once(tscCalibrationFlag,[]{
+    calibrateTsc();
+    if (tscAvailable) {
+      calibration.nsPerTick=tscNsPerTick;
+      calibration.tsc0=tscRef;
+      calibration.ns0=nsRef;
+      calibration.isReady.store(1,std::memory_order_release);
+    }
+  });
+  return monotonicNow(CLOCK_MONOTONIC);
+}
+
+int TimerClock::setTscEnabled(int enabled) {
+  now(); // ensure calibration done
+  if (!enabled) {
+    calibration.isReady.store(0,std::memory_order_release);
+    return 0;
+  }
+  if (!tscAvailable) {
+    return -1;
+  }
+  calibration.nsPerTick=tscNsPerTick;
+  calibration.tsc0=tscRef;
+  calibration.ns0=nsRef;
+  calibration.isReady.store(1,std::memory_order_release);
+  return 0;
+}
+
+int TimerClock::isTscEnabled() {
+  now();
+  return calibration.isReady.load(std::memory_order_acquire) ? 1 : 0;
+}
+
+double TimerClock::getTscFrequency() {
+  if (!isTscEnabled()) {
+    return 0;
+  }
+  return 1000000000.0/calibration.nsPerTick;
+}
+
+
+
 Timer::Timer() {
   reset(0);
 }
@@ -17,26 +129,33 @@ Timer::~Timer(){
 }
 
 void Timer::reset(int timeout) {
-   t0 = std::chrono::high_resolution_clock::now();
-   tmax=timeout/1000000.0; 
+  t0=TimerClock::now();
+  t0Coarse=TimerClock::coarseNow();
+  tmax=timeout*1000LL;
 }
 
 void Timer::increment() {
-  t0+=std::chrono::microseconds((int)(tmax*1000000.0));
+  t0+=tmax;
+  t0Coarse+=tmax;
 }
 
 int Timer::isTimeout() {
-    std::chrono::duration<double> tdiff= std::chrono::high_resolution_clock::now() - t0;
-    if (tdiff.count()>=tmax) {
-      return 1;
-    }
-    return 0;
+  if ((int64_t)(TimerClock::now()-t0)>=tmax) {
+    return 1;
+  }
+  return 0;
+}
+
+int Timer::isTimeoutCoarse() {
+  if ((int64_t)(TimerClock::coarseNow()-t0Coarse)>=tmax) {
+    return 1;
+  }
+  return 0;
 }
 
 double Timer::getTime() {
-    std::chrono::duration<double> tdiff= std::chrono::high_resolution_clock::now() - t0;
-    return tdiff.count();
-} 
+  return (int64_t)(TimerClock::now()-t0)/1000000000.0;
+}
 
 } // namespace Common
 } // namespace AliceO2
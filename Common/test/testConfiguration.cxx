@@ -0,0 +1,145 @@
+#include "../include/Common/Configuration.h"
+
+#define BOOST_TEST_MODULE Configuration test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <fstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+
+const int nSections=500;
+const int nKeys=20; // keys per section
+
+
+// parameters of a section
+struct SectionParameters {
+  std::string name;
+  int enabled;
+  double rate;
+  int size;
+  int unusedA; // not in config, default value
+  int unusedB;
+  std::vector<int> values;
+};
+
+
+// write a config file with many sections
+static std::string writeConfig() {
+  std::string path="/tmp/testConfiguration." + std::to_string(getpid()) + ".cfg";
+  std::ofstream f(path);
+  f << "[readout]\nrate=10.5\nexitTimeout=-1\n\n";
+  for (int i=0;i<nSections;i++) {
+    f << "[equipment-" << i << "]\n";
+    f << "name=eq" << i << "\n";
+    f << "enabled=" << (i%2) << "\n";
+    f << "rate=" << i*0.5 << "\n";
+    f << "size=" << 1000+i << "\n";
+    for (int k=0;k<nKeys-4;k++) {
+      f << "key" << k << "=" << i*100+k << "\n";
+    }
+    f << "\n";
+  }
+  return path;
+}
+
+
+BOOST_AUTO_TEST_CASE(configuration_test)
+{
+  std::string path=writeConfig();
+  ConfigFile cfg;
+  cfg.load("file:" + path);
+
+  // lookups without exception
+  BOOST_CHECK_EQUAL(cfg.getValue<double>("readout.rate"),10.5);
+  BOOST_CHECK(cfg.getOptional<int>("readout.exitTimeout")==-1);
+  BOOST_CHECK(!cfg.getOptional<int>("readout.missing"));
+  BOOST_CHECK(!cfg.getOptional<int>("equipment-1.name")); // not an int
+  BOOST_CHECK_THROW(cfg.getValue<int>("readout.missing"),std::string);
+  int v=5;
+  BOOST_CHECK_EQUAL(cfg.getOptionalValue<int>("readout.missing",v),1);
+  BOOST_CHECK_EQUAL(v,5);
+  BOOST_CHECK_EQUAL(cfg.getOptionalValue<int>("readout.missing",v,3),1);
+  BOOST_CHECK_EQUAL(v,3);
+  BOOST_CHECK_EQUAL(cfg.getOptionalValue<int>("equipment-3.size",v,3),0);
+  BOOST_CHECK_EQUAL(v,1003);
+
+  // sections
+  ConfigFileSection missing(cfg,"equipment-x");
+  BOOST_CHECK_EQUAL(missing.isFound(),0);
+  BOOST_CHECK(!missing.getOptional<int>("size"));
+  ConfigFileSection s(cfg,"equipment-7");
+  BOOST_CHECK_EQUAL(s.isFound(),1);
+  SectionParameters p;
+  p.unusedB=2;
+  s.bind("name",p.name).bind("enabled",p.enabled,0).bind("rate",p.rate,0.0).bind("size",p.size,0).bind("unusedA",p.unusedA,1).bind("unusedB",p.unusedB);
+  BOOST_CHECK_EQUAL(p.name,"eq7");
+  BOOST_CHECK_EQUAL(p.enabled,1);
+  BOOST_CHECK_EQUAL(p.rate,3.5);
+  BOOST_CHECK_EQUAL(p.size,1007);
+  BOOST_CHECK_EQUAL(p.unusedA,1);
+  BOOST_CHECK_EQUAL(p.unusedB,2);
+
+  unlink(path.c_str());
+}
+
+
+// parse a large config and read all sections, with section binding or with exceptions for missing keys
+BOOST_AUTO_TEST_CASE(configuration_benchmark)
+{
+  std::string path=writeConfig();
+
+  auto t0=std::chrono::steady_clock::now();
+  ConfigFile cfg;
+  cfg.load("file:" + path);
+  auto t1=std::chrono::steady_clock::now();
+
+  std::vector<SectionParameters> params(nSections);
+  int nErr=0;
+  int i=0;
+  for (auto kName : ConfigFileBrowser (&cfg,"equipment-")) {
+    SectionParameters &p=params[i++];
+    ConfigFileSection s(cfg,kName);
+    s.bind("name",p.name,kName).bind("enabled",p.enabled,1).bind("rate",p.rate,-1.0).bind("size",p.size,0);
+    s.bind("unusedA",p.unusedA,0).bind("unusedB",p.unusedB,0);
+    for (int k=0;k<nKeys-4;k++) {
+      p.values.push_back(s.getOptional<int>("key" + std::to_string(k)).value_or(-1));
+    }
+    if ((p.size<1000)||(p.values[nKeys-5]==-1)) {
+      nErr++;
+    }
+  }
+  auto t2=std::chrono::steady_clock::now();
+
+  // same with exceptions for missing keys
+  for (auto kName : ConfigFileBrowser (&cfg,"equipment-")) {
+    SectionParameters p;
+    const char *keys[]={"unusedA","unusedB"};
+    for (auto k : keys) {
+      try {
+        p.unusedA=cfg.getValue<int>(kName + "." + k);
+      }
+      catch (...) {
+        p.unusedA=0;
+      }
+    }
+    p.name=cfg.getValue<std::string>(kName + ".name");
+    p.enabled=cfg.getValue<int>(kName + ".enabled");
+    p.rate=cfg.getValue<double>(kName + ".rate");
+    p.size=cfg.getValue<int>(kName + ".size");
+    for (int k=0;k<nKeys-4;k++) {
+      p.values.push_back(cfg.getValue<int>(kName + ".key" + std::to_string(k)));
+    }
+  }
+  auto t3=std::chrono::steady_clock::now();
+
+  BOOST_CHECK_EQUAL(i,nSections);
+  BOOST_CHECK_EQUAL(nErr,0);
+  std::chrono::duration<double,std::milli> dtLoad=t1-t0, dtBind=t2-t1, dtThrow=t3-t2;
+  printf("%d sections x %d keys: parse %.2f ms, bind %.2f ms, getValue with exceptions %.2f ms\n",nSections,nKeys,dtLoad.count(),dtBind.count(),dtThrow.count());
+
+  unlink(path.c_str());
+}
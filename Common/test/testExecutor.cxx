@@ -0,0 +1,227 @@
+#include "../include/Common/Executor.h"
+
+#define BOOST_TEST_MODULE Executor test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace AliceO2::Common;
+
+
+// a task doing a given number of busy iterations, then done
+struct CountingTask {
+  std::atomic<int> nCalls{0};
+  std::atomic<int> isRunning{0};
+  std::atomic<int> nOverlaps{0}; // number of times task found already running
+  int nCallsMax=1000;
+};
+
+static Thread::CallbackResult countingLoop(void *arg) {
+  CountingTask *t=(CountingTask *)arg;
+  if (t->isRunning.exchange(1)) {
+    t->nOverlaps++;
+  }
+  int n=++t->nCalls;
+  t->isRunning=0;
+  if (n>=t->nCallsMax) {
+    return Thread::CallbackResult::Done;
+  }
+  // alternate busy and idle
+  return (n%4) ? Thread::CallbackResult::Ok : Thread::CallbackResult::Idle;
+}
+
+static Thread::CallbackResult idleLoop(void *arg) {
+  CountingTask *t=(CountingTask *)arg;
+  t->nCalls++;
+  return Thread::CallbackResult::Idle;
+}
+
+static Thread::CallbackResult busyLoop(void *arg) {
+  CountingTask *t=(CountingTask *)arg;
+  t->nCalls++;
+  return Thread::CallbackResult::Ok;
+}
+
+
+BOOST_AUTO_TEST_CASE(executor_test)
+{
+  const int nTasks=16;
+  std::vector<CountingTask> tasks(nTasks);
+  std::vector<int> ids;
+  ThreadIdleBackoff backoff;
+  backoff.spinCount=1;
+  backoff.sleepMin=10;
+  backoff.sleepMax=100;
+
+  Executor e(4,"testExecutor");
+  BOOST_CHECK_EQUAL(e.getNumberOfWorkers(),4);
+  for (int i=0;i<nTasks;i++) {
+    ids.push_back(e.addTask(countingLoop,&tasks[i],"task-" + std::to_string(i),backoff));
+  }
+  CountingTask idleTask;
+  int idleId=e.addTask(idleLoop,&idleTask,"idle",backoff);
+  e.start();
+
+  // wait all counting tasks done
+  for (int k=0;k<400;k++) {
+    int nDone=0;
+    for (auto &t : tasks) {
+      if (t.nCalls==t.nCallsMax) {
+        nDone++;
+      }
+    }
+    if (nDone==nTasks) {
+      break;
+    }
+    usleep(10000);
+  }
+
+  // each task called exactly until Done, never concurrently
+  for (int i=0;i<nTasks;i++) {
+    BOOST_CHECK_EQUAL(tasks[i].nCalls,tasks[i].nCallsMax);
+    BOOST_CHECK_EQUAL(tasks[i].nOverlaps,0);
+    ThreadStats stats;
+    BOOST_CHECK_EQUAL(e.getTaskStats(ids[i],stats),0);
+    BOOST_CHECK_EQUAL(stats.busyIterations+stats.idleIterations,(unsigned long long)tasks[i].nCallsMax);
+    BOOST_CHECK_EQUAL(stats.idleIterations,(unsigned long long)(tasks[i].nCallsMax-1)/4);
+  }
+
+  // idle task keeps being called, until removed
+  BOOST_CHECK(idleTask.nCalls>0);
+  BOOST_CHECK_EQUAL(e.removeTask(idleId),0);
+  int n=idleTask.nCalls;
+  usleep(10000);
+  BOOST_CHECK_EQUAL(idleTask.nCalls,n);
+  BOOST_CHECK_EQUAL(e.removeTask(idleId),-1);
+  ThreadStats stats;
+  BOOST_CHECK_EQUAL(e.getTaskStats(idleId,stats),-1);
+
+  e.stop();
+  for (int i=0;i<e.getNumberOfWorkers();i++) {
+    e.getWorkerStats(i,stats);
+    printf("worker %d: %llu busy %llu idle\n",i,stats.busyIterations,stats.idleIterations);
+  }
+  printf("steals: %llu\n",e.getNumberOfSteals());
+}
+
+
+// tasks always busy are rescheduled in a tight loop: removeTask() must not miss them between run and requeue
+BOOST_AUTO_TEST_CASE(executor_remove_busy_test)
+{
+  for (int nWorkers=1;nWorkers<=2;nWorkers++) {
+    Executor e(nWorkers,"testExecutor");
+    e.start();
+    for (int k=0;k<500;k++) {
+      CountingTask busyTask;
+      int id=e.addTask(busyLoop,&busyTask,"busy");
+      while (busyTask.nCalls<k%20) {
+        std::this_thread::yield();
+      }
+      BOOST_CHECK_EQUAL(e.removeTask(id),0);
+      int n=busyTask.nCalls;
+      usleep(100);
+      BOOST_CHECK_EQUAL(busyTask.nCalls,n);
+    }
+    e.stop();
+  }
+}
+
+
+// periodic task: does something every period, idle otherwise. Records lateness of execution.
+struct PeriodicTask {
+  std::chrono::steady_clock::time_point nextTime;
+  std::chrono::microseconds period{1000};
+  unsigned long long nTicks=0;
+  double totalLatency=0; // in microseconds
+  double maxLatency=0; // in microseconds
+};
+
+static Thread::CallbackResult periodicLoop(void *arg) {
+  PeriodicTask *t=(PeriodicTask *)arg;
+  auto now=std::chrono::steady_clock::now();
+  if (now<t->nextTime) {
+    return Thread::CallbackResult::Idle;
+  }
+  double latency=std::chrono::duration<double,std::micro>(now-t->nextTime).count();
+  t->totalLatency+=latency;
+  if (latency>t->maxLatency) {
+    t->maxLatency=latency;
+  }
+  t->nTicks++;
+  t->nextTime+=t->period;
+  return Thread::CallbackResult::Ok;
+}
+
+static double getProcessCpuTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  return ts.tv_sec+ts.tv_nsec/1000000000.0;
+}
+
+static void printPeriodicResults(const char *label, std::vector<PeriodicTask> &tasks, double cpu, double duration) {
+  unsigned long long nTicks=0;
+  double totalLatency=0;
+  double maxLatency=0;
+  for (auto &t : tasks) {
+    nTicks+=t.nTicks;
+    totalLatency+=t.totalLatency;
+    if (t.maxLatency>maxLatency) {
+      maxLatency=t.maxLatency;
+    }
+  }
+  printf("%s: %llu ticks, latency avg %.1f us max %.1f us, CPU %.1f%%\n",label,nTicks,nTicks ? totalLatency/nTicks : 0,maxLatency,cpu*100.0/duration);
+}
+
+
+// many periodic callbacks: one thread per callback compared to an executor with 2 workers
+BOOST_AUTO_TEST_CASE(executor_benchmark)
+{
+  const int nTasks=64;
+  const int sleepTime=100; // idle sleep, in microseconds
+  const double duration=0.5; // in seconds
+
+  {
+    std::vector<PeriodicTask> tasks(nTasks);
+    std::vector<std::unique_ptr<Thread>> threads;
+    for (int i=0;i<nTasks;i++) {
+      tasks[i].nextTime=std::chrono::steady_clock::now();
+      threads.push_back(std::make_unique<Thread>(periodicLoop,&tasks[i],"periodic",sleepTime));
+    }
+    double cpu0=getProcessCpuTime();
+    for (auto &t : threads) {
+      t->start();
+    }
+    usleep(duration*1000000);
+    for (auto &t : threads) {
+      t->stop();
+    }
+    for (auto &t : threads) {
+      t->join();
+    }
+    printPeriodicResults("thread per callback",tasks,getProcessCpuTime()-cpu0,duration);
+  }
+
+  {
+    std::vector<PeriodicTask> tasks(nTasks);
+    Executor e(2,"periodic");
+    ThreadIdleBackoff backoff;
+    backoff.sleepMin=sleepTime;
+    backoff.sleepMax=sleepTime;
+    for (int i=0;i<nTasks;i++) {
+      tasks[i].nextTime=std::chrono::steady_clock::now();
+      e.addTask(periodicLoop,&tasks[i],"periodic",backoff);
+    }
+    double cpu0=getProcessCpuTime();
+    e.start();
+    usleep(duration*1000000);
+    e.stop();
+    printPeriodicResults("executor 2 workers",tasks,getProcessCpuTime()-cpu0,duration);
+  }
+}
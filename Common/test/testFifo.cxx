@@ -5,6 +5,15 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 
 
@@ -48,3 +57,270 @@ BOOST_AUTO_TEST_CASE(fifo_test)
   
   printf("fifoSz=%d sum=%d\n",fifoSz,sum2);
 }
+
+
+BOOST_AUTO_TEST_CASE(fifo_bulk_test)
+{
+  const int fifoSz=10;
+  AliceO2::Common::Fifo<int> f(fifoSz);
+  int in[fifoSz*2];
+  int out[fifoSz*2];
+  for (int i=0;i<fifoSz*2;i++) {
+    in[i]=i;
+  }
+
+  // partial push when FIFO gets full, then wrap around circular buffer
+  BOOST_CHECK_EQUAL(f.pushBulk(in,fifoSz*2),fifoSz);
+  BOOST_CHECK_EQUAL(f.isFull(),1);
+  BOOST_CHECK_EQUAL(f.popBulk(out,3),3);
+  BOOST_CHECK_EQUAL(f.pushBulk(&in[fifoSz],3),3);
+  BOOST_CHECK_EQUAL(f.popBulk(out,fifoSz*2),fifoSz);
+  for (int i=0;i<fifoSz;i++) {
+    BOOST_CHECK_EQUAL(out[i],i+3);
+  }
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  BOOST_CHECK_EQUAL(f.popBulk(out,fifoSz),0);
+
+  // FIFO still usable after clear
+  f.push(1);
+  f.clear();
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  BOOST_CHECK_EQUAL(f.getNumberOfFreeSlots(),fifoSz);
+  BOOST_CHECK_EQUAL(f.pushBulk(in,fifoSz),fifoSz);
+  BOOST_CHECK_EQUAL(f.getNumberOfUsedSlots(),fifoSz);
+}
+
+
+// FIFO with the previous layout (adjacent indexes, no cached copies), used as reference in benchmark
+class FifoReference {
+  public:
+  FifoReference(int s) : size(s), indexStart(0), indexEnd(0), data(s+1) {
+  }
+  int push(int item) {
+    int indexEndNew=indexEnd+1;
+    if (indexEndNew>size) {
+      indexEndNew=0;
+    }
+    if (indexEndNew==indexStart) {
+      return -1;
+    }
+    data[indexEndNew]=item;
+    indexEnd=indexEndNew;
+    return 0;
+  }
+  int pop(int &item) {
+    if (indexEnd==indexStart) {
+      return -1;
+    }
+    int indexStartNew=indexStart+1;
+    if (indexStartNew>size) {
+      indexStartNew=0;
+    }
+    indexStart=indexStartNew;
+    item=data[indexStart];
+    return 0;
+  }
+  private:
+  int size;
+  std::atomic<int> indexStart;
+  std::atomic<int> indexEnd;
+  std::vector<int> data;
+};
+
+
+// run producer and consumer, pinned to different cores when possible
+// returns throughput, in millions of items per second
+double runBenchmark(std::function<void()> producer, std::function<void()> consumer, int nItems) {
+  auto pinned=[](std::function<void()> f, int cpu) {
+    return [=]() {
+      if ((int)std::thread::hardware_concurrency()>cpu) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu,&cpuSet);
+        pthread_setaffinity_np(pthread_self(),sizeof(cpuSet),&cpuSet);
+      }
+      f();
+    };
+  };
+  auto t0=std::chrono::steady_clock::now();
+  std::thread tConsumer(pinned(consumer,1));
+  std::thread tProducer(pinned(producer,0));
+  tProducer.join();
+  tConsumer.join();
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  return nItems/dt.count()/1000000.0;
+}
+
+
+BOOST_AUTO_TEST_CASE(fifo_benchmark)
+{
+  const int fifoSz=1024;
+  const int nItems=5000000;
+  const int bulkSz=64;
+  long long sumIn=(long long)nItems*(nItems-1)/2;
+
+  {
+    FifoReference f(fifoSz);
+    long long sum=0;
+    double rate=runBenchmark([&]() {
+      for (int i=0;i<nItems;) {
+        if (f.push(i)==0) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }, [&]() {
+      int v;
+      for (int i=0;i<nItems;) {
+        if (f.pop(v)==0) {
+          sum+=v;
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }, nItems);
+    BOOST_CHECK_EQUAL(sum,sumIn);
+    printf("previous layout  : %.1f M items/s\n",rate);
+  }
+
+  {
+    AliceO2::Common::Fifo<int> f(fifoSz);
+    long long sum=0;
+    double rate=runBenchmark([&]() {
+      for (int i=0;i<nItems;) {
+        if (f.push(i)==0) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }, [&]() {
+      int v;
+      for (int i=0;i<nItems;) {
+        if (f.pop(v)==0) {
+          sum+=v;
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }, nItems);
+    BOOST_CHECK_EQUAL(sum,sumIn);
+    printf("push/pop         : %.1f M items/s\n",rate);
+  }
+
+  {
+    AliceO2::Common::Fifo<int> f(fifoSz);
+    long long sum=0;
+    double rate=runBenchmark([&]() {
+      int v[bulkSz];
+      for (int i=0;i<nItems;) {
+        int n=std::min(bulkSz,nItems-i);
+        for (int k=0;k<n;k++) {
+          v[k]=i+k;
+        }
+        for (int k=0;k<n;) {
+          int nPushed=f.pushBulk(&v[k],n-k);
+          if (nPushed==0) {
+            std::this_thread::yield();
+          }
+          k+=nPushed;
+        }
+        i+=n;
+      }
+    }, [&]() {
+      int v[bulkSz];
+      for (int i=0;i<nItems;) {
+        int n=f.popBulk(v,bulkSz);
+        if (n==0) {
+          std::this_thread::yield();
+        }
+        for (int k=0;k<n;k++) {
+          sum+=v[k];
+        }
+        i+=n;
+      }
+    }, nItems);
+    BOOST_CHECK_EQUAL(sum,sumIn);
+    printf("pushBulk/popBulk : %.1f M items/s\n",rate);
+  }
+}
+
+
+// round trip time between 2 threads exchanging an item through 2 FIFOs, waiting with pop(timeout)
+// returns average round trip time, in microseconds
+double pingPong(int isBlockingWaitEnabled, int nRounds) {
+  AliceO2::Common::Fifo<int> ping(10);
+  AliceO2::Common::Fifo<int> pong(10);
+  if (isBlockingWaitEnabled) {
+    ping.enableBlockingWait();
+    pong.enableBlockingWait();
+  }
+  std::thread echo([&]() {
+    for (int i=0;i<nRounds;i++) {
+      int v;
+      if (ping.pop(v,-1)==0) {
+        pong.push(v,-1);
+      }
+    }
+  });
+  auto t0=std::chrono::steady_clock::now();
+  for (int i=0;i<nRounds;i++) {
+    int v=-1;
+    ping.push(i,-1);
+    pong.pop(v,-1);
+    BOOST_CHECK_EQUAL(v,i);
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  echo.join();
+  return dt.count()*1000000.0/nRounds;
+}
+
+
+BOOST_AUTO_TEST_CASE(fifo_blocking_test)
+{
+  AliceO2::Common::Fifo<int> f(2);
+  f.enableBlockingWait();
+  int v=-1;
+
+  // timeouts
+  auto t0=std::chrono::steady_clock::now();
+  BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.pop(v,2000))(0) );
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  BOOST_CHECK(dt.count()>=0.002);
+  BOOST_CHECK_EQUAL(f.push(1,0),0);
+  BOOST_CHECK_EQUAL(f.push(2,1000),0);
+  BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.push(3,1000))(0) );
+  BOOST_CHECK_EQUAL(f.pop(v,1000),0);
+  BOOST_CHECK_EQUAL(v,1);
+
+  // writer blocked on full FIFO is woken up by reader
+  std::thread reader([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    int w;
+    f.pop(w);
+  });
+  BOOST_CHECK_EQUAL(f.push(3,-1),0);
+  reader.join();
+
+  // idle reader sleeping instead of spinning
+  AliceO2::Common::Fifo<int> idle(10);
+  idle.enableBlockingWait();
+  double cpuTime=0;
+  std::thread sleeper([&]() {
+    struct timespec ts0, ts1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts0);
+    int w;
+    idle.pop(w,200000);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts1);
+    cpuTime=(ts1.tv_sec-ts0.tv_sec)+(ts1.tv_nsec-ts0.tv_nsec)/1000000000.0;
+  });
+  sleeper.join();
+  BOOST_CHECK(cpuTime<0.02);
+
+  double tBlocking=pingPong(1,20000);
+  double tPolling=pingPong(0,200);
+  printf("round trip : %.1f us with futex wake-up, %.1f us with polling - idle wait of 200 ms used %.3f ms CPU\n",tBlocking,tPolling,cpuTime*1000);
+}
@@ -0,0 +1,245 @@
+#include "../include/Common/Fifo.h"
+#include "../include/Common/FifoMPMC.h"
+#include "../include/Common/FifoMPSC.h"
+
+#define BOOST_TEST_MODULE FifoMPMC test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+const int nProducers=4;
+const int nItemsPerProducer=250000;
+
+
+// item value: producer id in high bits, sequence number in low bits
+static inline long makeItem(int producer, int i) {
+  return ((long)producer<<32)|i;
+}
+
+
+BOOST_AUTO_TEST_CASE(fifo_mpmc_basic_test)
+{
+  AliceO2::Common::FifoMPMC<int> f(100);
+  int fifoSz=f.getNumberOfFreeSlots();
+  BOOST_CHECK_EQUAL(fifoSz,128);
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  int j=-1;
+  BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.pop(j))(0) );
+  for (int i=0;i<fifoSz;i++) {
+    BOOST_CHECK_EQUAL(f.push(i),0);
+  }
+  BOOST_CHECK_EQUAL(f.isFull(),1);
+  BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.push(-1))(0) );
+  for (int i=0;i<fifoSz;i++) {
+    BOOST_CHECK_EQUAL(f.pop(j),0);
+    BOOST_CHECK_EQUAL(j,i);
+  }
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  BOOST_CHECK_EQUAL(f.getNumberIn(),(unsigned long long)fifoSz);
+  BOOST_CHECK_EQUAL(f.getNumberOut(),(unsigned long long)fifoSz);
+
+  // elements released on pop
+  AliceO2::Common::FifoMPSC<std::shared_ptr<int>> fp(4);
+  std::shared_ptr<int> p=std::make_shared<int>(1);
+  std::shared_ptr<int> q;
+  fp.push(p);
+  fp.pop(q);
+  q=nullptr;
+  BOOST_CHECK(p.unique());
+}
+
+
+// push/pop with timeout, with and without blocking wait
+BOOST_AUTO_TEST_CASE(fifo_mpmc_wait_test)
+{
+  for (int blocking=0;blocking<=1;blocking++) {
+    AliceO2::Common::FifoMPMC<long> f(4);
+    if (blocking) {
+      f.enableBlockingWait();
+    }
+
+    // timeouts
+    long v;
+    auto t0=std::chrono::steady_clock::now();
+    BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.pop(v,20000))(0) );
+    std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+    BOOST_CHECK((dt.count()>=0.020)&&(dt.count()<0.5));
+    for (int i=0;i<4;i++) {
+      BOOST_CHECK_EQUAL(f.push(i,0),0);
+    }
+    t0=std::chrono::steady_clock::now();
+    BOOST_CHECK_PREDICATE( std::not_equal_to<int>(), (f.push(-1,20000))(0) );
+    dt=std::chrono::steady_clock::now()-t0;
+    BOOST_CHECK((dt.count()>=0.020)&&(dt.count()<0.5));
+    for (int i=0;i<4;i++) {
+      BOOST_CHECK_EQUAL(f.pop(v,0),0);
+      BOOST_CHECK_EQUAL(v,i);
+    }
+
+    // producers and consumers waiting on a small FIFO: nothing lost
+    const int nItems=20000;
+    std::atomic<long> sum(0);
+    std::vector<std::thread> threads;
+    for (int k=0;k<2;k++) {
+      threads.push_back(std::thread([&f]() {
+        for (int i=1;i<=nItems;i++) {
+          BOOST_CHECK_EQUAL(f.push(i,-1),0);
+        }
+      }));
+      threads.push_back(std::thread([&f,&sum]() {
+        long item;
+        for (int i=0;i<nItems;i++) {
+          BOOST_CHECK_EQUAL(f.pop(item,-1),0);
+          sum+=item;
+        }
+      }));
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+    BOOST_CHECK_EQUAL(sum.load(),2L*nItems*(nItems+1)/2);
+    BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  }
+}
+
+
+// several producers, one consumer: check nothing lost and order kept for each producer
+BOOST_AUTO_TEST_CASE(fifo_mpsc_stress_test)
+{
+  AliceO2::Common::FifoMPSC<long> f(1024);
+  std::vector<std::thread> producers;
+  for (int k=0;k<nProducers;k++) {
+    producers.push_back(std::thread([&f,k]() {
+      for (int i=0;i<nItemsPerProducer;) {
+        if (f.push(makeItem(k,i))==0) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  std::vector<int> next(nProducers,0);
+  int nErr=0;
+  auto t0=std::chrono::steady_clock::now();
+  for (int n=0;n<nProducers*nItemsPerProducer;) {
+    long v;
+    if (f.pop(v)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int k=(int)(v>>32);
+    int i=(int)(v&0xFFFFFFFF);
+    if ((k<0)||(k>=nProducers)||(next[k]!=i)) {
+      nErr++;
+    } else {
+      next[k]++;
+    }
+    n++;
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  for (auto &t : producers) {
+    t.join();
+  }
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  printf("FifoMPSC %d producers : %.1f M items/s\n",nProducers,nProducers*nItemsPerProducer/dt.count()/1000000.0);
+}
+
+
+// several producers, several consumers: check nothing lost or duplicated
+BOOST_AUTO_TEST_CASE(fifo_mpmc_stress_test)
+{
+  const int nConsumers=4;
+  AliceO2::Common::FifoMPMC<long> f(1024);
+  std::vector<std::vector<char>> received(nProducers,std::vector<char>(nItemsPerProducer,0));
+  std::atomic<int> nReceived(0);
+  std::atomic<int> nErr(0);
+  std::vector<std::thread> threads;
+  auto t0=std::chrono::steady_clock::now();
+  for (int k=0;k<nConsumers;k++) {
+    threads.push_back(std::thread([&]() {
+      while (nReceived<nProducers*nItemsPerProducer) {
+        long v;
+        if (f.pop(v)) {
+          std::this_thread::yield();
+          continue;
+        }
+        int p=(int)(v>>32);
+        int i=(int)(v&0xFFFFFFFF);
+        if ((p<0)||(p>=nProducers)||(i<0)||(i>=nItemsPerProducer)||(received[p][i])) {
+          nErr++;
+        } else {
+          received[p][i]=1;
+        }
+        nReceived++;
+      }
+    }));
+  }
+  for (int k=0;k<nProducers;k++) {
+    threads.push_back(std::thread([&f,k]() {
+      for (int i=0;i<nItemsPerProducer;) {
+        if (f.push(makeItem(k,i))==0) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(nReceived,nProducers*nItemsPerProducer);
+  BOOST_CHECK_EQUAL(f.isEmpty(),1);
+  printf("FifoMPMC %d producers %d consumers : %.1f M items/s\n",nProducers,nConsumers,nProducers*nItemsPerProducer/dt.count()/1000000.0);
+}
+
+
+// fan-in with one Fifo per producer, polled round-robin by the consumer, for comparison with FifoMPSC
+BOOST_AUTO_TEST_CASE(fifo_fanin_benchmark)
+{
+  std::vector<std::unique_ptr<AliceO2::Common::Fifo<long>>> fifos;
+  std::vector<std::thread> producers;
+  for (int k=0;k<nProducers;k++) {
+    fifos.push_back(std::make_unique<AliceO2::Common::Fifo<long>>(1024/nProducers));
+  }
+  for (int k=0;k<nProducers;k++) {
+    producers.push_back(std::thread([&fifos,k]() {
+      for (int i=0;i<nItemsPerProducer;) {
+        if (fifos[k]->push(makeItem(k,i))==0) {
+          i++;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  auto t0=std::chrono::steady_clock::now();
+  for (int n=0;n<nProducers*nItemsPerProducer;) {
+    int nPopped=0;
+    for (auto &f : fifos) {
+      long v;
+      if (f->pop(v)==0) {
+        nPopped++;
+      }
+    }
+    if (nPopped==0) {
+      std::this_thread::yield();
+    }
+    n+=nPopped;
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  for (auto &t : producers) {
+    t.join();
+  }
+  printf("Fifo x %d polled : %.1f M items/s\n",nProducers,nProducers*nItemsPerProducer/dt.count()/1000000.0);
+}
@@ -0,0 +1,136 @@
+#include "../include/Common/Histogram.h"
+
+#define BOOST_TEST_MODULE Histogram test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace AliceO2::Common;
+
+
+BOOST_AUTO_TEST_CASE(histogram_buckets_test)
+{
+  // each value in its bucket, with bounded relative error
+  int nErr=0;
+  for (uint64_t v=1;v<(1ULL<<62);v=v*3/2+1) {
+    for (uint64_t x : {v-1,v,v+1}) {
+      int i=Histogram::getBucketIndex(x);
+      uint64_t lo=Histogram::getBucketLowestValue(i);
+      uint64_t hi=Histogram::getBucketHighestValue(i);
+      if ((i<0)||(i>=Histogram::numberOfBuckets)||(x<lo)||(x>hi)||(hi-lo>x/Histogram::subBucketCount)) {
+        nErr++;
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(Histogram::getBucketIndex(UINT64_MAX),Histogram::numberOfBuckets-1);
+  BOOST_CHECK_EQUAL(Histogram::getBucketHighestValue(Histogram::numberOfBuckets-1),UINT64_MAX);
+  for (int i=0;i<2*Histogram::subBucketCount;i++) {
+    BOOST_CHECK_EQUAL(Histogram::getBucketIndex(i),i);
+  }
+}
+
+
+BOOST_AUTO_TEST_CASE(histogram_test)
+{
+  Histogram h;
+  BOOST_CHECK_EQUAL(h.getCount(),0);
+  BOOST_CHECK_EQUAL(h.getPercentile(50),0);
+
+  // uniform distribution 1..100000
+  const int n=100000;
+  for (int i=1;i<=n;i++) {
+    h.record(i);
+  }
+  BOOST_CHECK_EQUAL(h.getCount(),(uint64_t)n);
+  BOOST_CHECK_EQUAL(h.getMin(),1);
+  BOOST_CHECK_EQUAL(h.getMax(),(uint64_t)n);
+  for (double p : {1.0,50.0,90.0,99.0,99.9}) {
+    double expected=p*n/100.0;
+    BOOST_CHECK(std::fabs(h.getPercentile(p)-expected)<=expected/Histogram::subBucketCount+1);
+  }
+  BOOST_CHECK_EQUAL(h.getPercentile(100),(uint64_t)n);
+  BOOST_CHECK(std::fabs(h.getMean()-n/2.0)<n/2.0/Histogram::subBucketCount);
+  printf("%s\n",h.toString(" ns").c_str());
+
+  // merge
+  Histogram h2;
+  h2.record(1000000);
+  h2.merge(h);
+  BOOST_CHECK_EQUAL(h2.getCount(),(uint64_t)n+1);
+  BOOST_CHECK_EQUAL(h2.getMax(),1000000);
+  BOOST_CHECK_EQUAL(h2.getMin(),1);
+  Histogram h3(h2);
+  BOOST_CHECK_EQUAL(h3.getPercentile(99),h2.getPercentile(99));
+  h3.reset();
+  BOOST_CHECK_EQUAL(h3.getCount(),0);
+  BOOST_CHECK_EQUAL(h3.getMax(),0);
+
+  Histogram hj;
+  hj.record(3);
+  hj.record(3);
+  hj.record(100);
+  std::string json=hj.toJSON();
+  printf("%s\n",json.c_str());
+  BOOST_CHECK(json.find("\"count\":3,")!=std::string::npos);
+  BOOST_CHECK(json.find("\"buckets\":[[3,2],[100,1]]")!=std::string::npos);
+}
+
+
+// per-thread histograms merged, compared to a shared histogram
+BOOST_AUTO_TEST_CASE(histogram_threads_test)
+{
+  const int nThreads=4;
+  const int nValues=1000000;
+  Histogram shared;
+  std::vector<std::unique_ptr<Histogram>> local;
+  std::vector<std::thread> threads;
+  for (int k=0;k<nThreads;k++) {
+    local.push_back(std::make_unique<Histogram>());
+  }
+
+  auto t0=std::chrono::steady_clock::now();
+  for (int k=0;k<nThreads;k++) {
+    threads.push_back(std::thread([&local,k]() {
+      Histogram &h=*local[k];
+      for (int i=0;i<nValues;i++) {
+        h.record(i);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double,std::nano> dtLocal=std::chrono::steady_clock::now()-t0;
+  threads.clear();
+
+  t0=std::chrono::steady_clock::now();
+  for (int k=0;k<nThreads;k++) {
+    threads.push_back(std::thread([&shared]() {
+      for (int i=0;i<nValues;i++) {
+        shared.recordConcurrent(i);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double,std::nano> dtShared=std::chrono::steady_clock::now()-t0;
+
+  Histogram merged;
+  for (auto &h : local) {
+    merged.merge(*h);
+  }
+  BOOST_CHECK_EQUAL(merged.getCount(),(uint64_t)nThreads*nValues);
+  BOOST_CHECK_EQUAL(shared.getCount(),(uint64_t)nThreads*nValues);
+  BOOST_CHECK_EQUAL(merged.getPercentile(50),shared.getPercentile(50));
+  BOOST_CHECK_EQUAL(merged.getPercentile(99.9),shared.getPercentile(99.9));
+  BOOST_CHECK_EQUAL(merged.getMax(),(uint64_t)nValues-1);
+  BOOST_CHECK_EQUAL(shared.getMax(),(uint64_t)nValues-1);
+  printf("record(): %.1f ns, recordConcurrent(): %.1f ns (%d threads)\n",dtLocal.count()/(nThreads*nValues),dtShared.count()/(nThreads*nValues),nThreads);
+}
@@ -0,0 +1,150 @@
+#include "../include/Common/SimpleLog.h"
+
+#define BOOST_TEST_MODULE SimpleLog test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+
+const int nThreads=4;
+const int nMessagesPerThread=20000;
+
+
+// count messages in file, and check each message complete. Reports of dropped messages are summed separately.
+static int countLines(const std::string &path, int &nErr, unsigned long long &nDroppedReported) {
+  std::ifstream f(path);
+  std::string line;
+  int n=0;
+  nErr=0;
+  nDroppedReported=0;
+  while (std::getline(f,line)) {
+    size_t ix=line.find(" messages dropped");
+    if (ix!=std::string::npos) {
+      size_t ixStart=line.rfind(' ',ix-1);
+      nDroppedReported+=std::stoull(line.substr(ixStart+1,ix-ixStart-1));
+      continue;
+    }
+    if (line.find(" end")==std::string::npos) {
+      nErr++;
+    }
+    n++;
+  }
+  return n;
+}
+
+// log messages from several threads, return time per message in nanoseconds
+static double logFromThreads(SimpleLog &log) {
+  std::vector<std::thread> threads;
+  auto t0=std::chrono::steady_clock::now();
+  for (int k=0;k<nThreads;k++) {
+    threads.push_back(std::thread([&log,k]() {
+      for (int i=0;i<nMessagesPerThread;i++) {
+        log.info("thread %d message %d of %d end",k,i,nMessagesPerThread);
+      }
+    }));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double,std::nano> dt=std::chrono::steady_clock::now()-t0;
+  return dt.count()/(nThreads*nMessagesPerThread);
+}
+
+
+BOOST_AUTO_TEST_CASE(simplelog_test)
+{
+  std::string path="/tmp/testSimpleLog." + std::to_string(getpid()) + ".log";
+  int nErr;
+  unsigned long long nDroppedReported;
+
+  // synchronous
+  unlink(path.c_str());
+  double tSync;
+  {
+    SimpleLog log(path.c_str());
+    tSync=logFromThreads(log);
+  }
+  BOOST_CHECK_EQUAL(countLines(path,nErr,nDroppedReported),nThreads*nMessagesPerThread);
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(nDroppedReported,0);
+
+  // asynchronous, all messages written or counted as dropped
+  unlink(path.c_str());
+  double tAsync;
+  unsigned long long nDropped;
+  {
+    SimpleLog log(path.c_str());
+    BOOST_CHECK_EQUAL(log.setAsynchronous(4096),0);
+    tAsync=logFromThreads(log);
+    log.flush();
+    nDropped=log.getNumberOfDroppedMessages();
+    log.info("last message end");
+  }
+  int nLines=countLines(path,nErr,nDroppedReported);
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(nDroppedReported,nDropped);
+  BOOST_CHECK_EQUAL(nLines+nDropped,(unsigned long long)(nThreads*nMessagesPerThread+1));
+
+  // asynchronous mode stopped and restarted while threads are logging: no message lost or corrupted
+  unlink(path.c_str());
+  {
+    SimpleLog log(path.c_str());
+    BOOST_CHECK_EQUAL(log.setAsynchronous(4096),0);
+    std::thread logger([&log]() {
+      logFromThreads(log);
+    });
+    for (int i=0;i<10;i++) {
+      usleep(1000);
+      BOOST_CHECK_EQUAL(log.setAsynchronous(0),0);
+      usleep(1000);
+      BOOST_CHECK_EQUAL(log.setAsynchronous(4096),0);
+    }
+    logger.join();
+    log.flush();
+    nDropped=log.getNumberOfDroppedMessages();
+  }
+  nLines=countLines(path,nErr,nDroppedReported);
+  BOOST_CHECK_EQUAL(nErr,0);
+  BOOST_CHECK_EQUAL(nLines+nDropped,(unsigned long long)(nThreads*nMessagesPerThread));
+
+  // flush while threads are logging: messages logged before flush() are in file when it returns
+  unlink(path.c_str());
+  {
+    SimpleLog log(path.c_str());
+    BOOST_CHECK_EQUAL(log.setAsynchronous(64),0); // small queue, records reused often
+    std::atomic<int> nLogged(0);
+    std::atomic<int> isDone(0);
+    std::vector<std::thread> threads;
+    for (int k=0;k<nThreads;k++) {
+      threads.push_back(std::thread([&log,&nLogged,&isDone,k]() {
+        for (int i=0;!isDone;i++) {
+          if (log.info("thread %d message %d end",k,i)==0) {
+            nLogged++;
+          }
+        }
+      }));
+    }
+    for (int i=0;i<20;i++) {
+      usleep(1000);
+      int n=nLogged;
+      log.flush();
+      int nLines=countLines(path,nErr,nDroppedReported);
+      BOOST_CHECK_EQUAL(nErr,0);
+      BOOST_CHECK(nLines>=n);
+    }
+    isDone=1;
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  printf("SimpleLog %d threads: synchronous %.0f ns/message, asynchronous %.0f ns/message (%llu dropped)\n",nThreads,tSync,tAsync,nDropped);
+  unlink(path.c_str());
+}
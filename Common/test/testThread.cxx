@@ -0,0 +1,152 @@
+#include "../include/Common/Thread.h"
+
+#define BOOST_TEST_MODULE Thread test
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <sched.h>
+#include <limits.h>
+
+using namespace AliceO2::Common;
+
+
+// count loop iterations, and record CPU used
+struct ThreadTestData {
+  std::atomic<int> nLoops;
+  std::atomic<int> cpu;
+};
+
+static Thread::CallbackResult countLoops(void *arg) {
+  ThreadTestData *d=(ThreadTestData *)arg;
+  d->nLoops++;
+  d->cpu=sched_getcpu();
+  return Thread::CallbackResult::Idle;
+}
+
+
+BOOST_AUTO_TEST_CASE(thread_placement_test)
+{
+  ThreadTestData d;
+  d.nLoops=0;
+  d.cpu=-1;
+
+  // pinned to a single CPU
+  {
+    Thread t(countLoops,&d,"testThread",100);
+    ThreadPlacement placement;
+    placement.cpus="0";
+    t.setPlacement(placement);
+    BOOST_CHECK_EQUAL(t.getPlacement(),"");
+    t.start();
+    std::string p=t.getPlacement();
+    printf("placement: %s\n",p.c_str());
+    BOOST_CHECK_EQUAL(p.substr(0,6),"CPU 0,");
+    while (d.nLoops<10) {
+      usleep(100);
+    }
+    t.stop();
+    t.join();
+    BOOST_CHECK_EQUAL(d.cpu,0);
+  }
+
+  // invalid settings are reported, but thread runs anyway
+  {
+    d.nLoops=0;
+    Thread t(countLoops,&d,"testThread",100);
+    ThreadPlacement placement;
+    placement.cpus="0-x";
+    placement.numaNode=1000;
+    t.setPlacement(placement);
+    t.start();
+    std::string p=t.getPlacement();
+    printf("placement: %s\n",p.c_str());
+    BOOST_CHECK(p.find("invalid CPU list")!=std::string::npos);
+    BOOST_CHECK(p.find("unknown NUMA node")!=std::string::npos);
+    while (d.nLoops<10) {
+      usleep(100);
+    }
+    t.stop();
+    t.join();
+  }
+
+  // real-time scheduling, may fail without privileges
+  {
+    Thread t(countLoops,&d,"testThread",100);
+    ThreadPlacement placement;
+    placement.realtimePriority=1;
+    t.setPlacement(placement);
+    t.start();
+    std::string p=t.getPlacement();
+    printf("placement: %s\n",p.c_str());
+    BOOST_CHECK((p.find("SCHED_FIFO priority 1")!=std::string::npos)||(p.find("failed to set real-time priority")!=std::string::npos));
+    t.stop();
+    t.join();
+  }
+}
+
+
+// busy for the first iterations, then idle
+static Thread::CallbackResult busyThenIdle(void *arg) {
+  ThreadTestData *d=(ThreadTestData *)arg;
+  d->nLoops++;
+  if (d->nLoops<=1000) {
+    return Thread::CallbackResult::Ok;
+  }
+  return Thread::CallbackResult::Idle;
+}
+
+
+BOOST_AUTO_TEST_CASE(thread_backoff_test)
+{
+  ThreadTestData d;
+  d.nLoops=0;
+  Thread t(busyThenIdle,&d,"testThread",1000);
+  ThreadIdleBackoff backoff;
+  backoff.spinCount=100;
+  backoff.yieldCount=100;
+  backoff.sleepMin=10;
+  backoff.sleepMax=10000;
+  t.setIdleBackoff(backoff);
+  t.start();
+  usleep(100000);
+  t.stop();
+  t.join();
+
+  ThreadStats stats;
+  t.getStats(stats);
+  printf("busy: %llu iterations %.6f s - idle: %llu iterations %.6f s\n",stats.busyIterations,stats.busyTime,stats.idleIterations,stats.idleTime);
+  BOOST_CHECK_EQUAL(stats.busyIterations,1000ULL);
+  // spin + yield + sleeps of 10us to 10ms in 100ms
+  BOOST_CHECK(stats.idleIterations>=200);
+  BOOST_CHECK(stats.idleIterations<=200+50);
+  BOOST_CHECK(stats.idleTime>0.05);
+  BOOST_CHECK(stats.busyTime<stats.idleTime);
+}
+
+
+BOOST_AUTO_TEST_CASE(thread_backoff_sleep_time_test)
+{
+  ThreadIdleBackoff backoff;
+  backoff.sleepMin=10;
+  backoff.sleepMax=1000;
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,1),10);
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,2),20);
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,7),640);
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,8),1000);
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,INT_MAX),1000);
+
+  // sleepMin 0 would never grow: starts at 1us
+  backoff.sleepMin=0;
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,1),1);
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,5),16);
+
+  // no sleep
+  backoff.sleepMax=0;
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,100),0);
+
+  // no overflow
+  backoff.sleepMin=INT_MAX;
+  backoff.sleepMax=INT_MAX;
+  BOOST_CHECK_EQUAL(getThreadIdleSleepTime(backoff,64),INT_MAX);
+}
@@ -6,6 +6,9 @@
 #include <cmath>
 #include <boost/test/unit_test.hpp>
 #include <assert.h>
+#include <chrono>
+#include <functional>
+#include <unistd.h>
 
 #include <time.h>
 
@@ -29,3 +32,87 @@ BOOST_AUTO_TEST_CASE(timer_test)
 
   BOOST_CHECK_EQUAL(success, 1);
 }
+
+
+static uint64_t getMonotonicTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+BOOST_AUTO_TEST_CASE(timer_clock_test)
+{
+  using AliceO2::Common::TimerClock;
+  printf("TimerClock: TSC %s, %.1f MHz\n",TimerClock::isTscEnabled() ? "enabled" : "disabled",TimerClock::getTscFrequency()/1000000.0);
+
+  // consistent with CLOCK_MONOTONIC
+  for (int k=0;k<2;k++) {
+    uint64_t m0=getMonotonicTime();
+    uint64_t t0=TimerClock::now();
+    usleep(100000);
+    uint64_t m1=getMonotonicTime();
+    uint64_t t1=TimerClock::now();
+    double offset=((double)t0-(double)m0)/1000.0;
+    double error=((double)(t1-t0)-(double)(m1-m0))/1000.0;
+    printf("TimerClock offset %.3f us, error after 100ms %.3f us\n",offset,error);
+    BOOST_CHECK(std::fabs(offset)<100);
+    BOOST_CHECK(std::fabs(error)<100);
+    uint64_t c=TimerClock::coarseNow();
+    BOOST_CHECK(std::fabs((double)c-(double)TimerClock::now())<50000000);
+    BOOST_CHECK(TimerClock::setTscEnabled(0)==0);
+  }
+  BOOST_CHECK_EQUAL(TimerClock::isTscEnabled(),0);
+  TimerClock::setTscEnabled(1);
+
+  // coarse timeout
+  AliceO2::Common::Timer t;
+  t.reset(20000);
+  BOOST_CHECK_EQUAL(t.isTimeoutCoarse(),0);
+  usleep(50000);
+  BOOST_CHECK_EQUAL(t.isTimeoutCoarse(),1);
+  BOOST_CHECK_EQUAL(t.isTimeout(),1);
+
+  // periodic coarse timeout, without drift from the fine clock
+  AliceO2::Common::Timer elapsed;
+  t.reset(10000);
+  for (int i=0;i<10;i++) {
+    while (!t.isTimeoutCoarse()) {
+      usleep(1000);
+    }
+    t.increment();
+  }
+  printf("10 coarse periods of 10ms in %.3f ms\n",elapsed.getTime()*1000);
+  BOOST_CHECK(std::fabs(elapsed.getTime()-0.1)<0.02);
+}
+
+
+// cost of reading time with different methods
+BOOST_AUTO_TEST_CASE(timer_clock_benchmark)
+{
+  using AliceO2::Common::TimerClock;
+  const int nLoops=1000000;
+  uint64_t sum=0;
+
+  auto bench=[&](const char *label, std::function<uint64_t()> f) {
+    auto t0=std::chrono::steady_clock::now();
+    for (int i=0;i<nLoops;i++) {
+      sum+=f();
+    }
+    std::chrono::duration<double,std::nano> dt=std::chrono::steady_clock::now()-t0;
+    printf("%-30s %6.1f ns/call\n",label,dt.count()/nLoops);
+  };
+
+  AliceO2::Common::Timer t;
+  t.reset(1000000);
+  int tscEnabled=TimerClock::isTscEnabled();
+  bench("TimerClock::now()",[]{return TimerClock::now();});
+  bench("TimerClock::coarseNow()",[]{return TimerClock::coarseNow();});
+  bench("Timer::isTimeout()",[&t]{return (uint64_t)t.isTimeout();});
+  bench("Timer::isTimeoutCoarse()",[&t]{return (uint64_t)t.isTimeoutCoarse();});
+  TimerClock::setTscEnabled(0);
+  bench("TimerClock::now() no TSC",[]{return TimerClock::now();});
+  bench("Timer::isTimeout() no TSC",[&t]{return (uint64_t)t.isTimeout();});
+  TimerClock::setTscEnabled(tscEnabled);
+  bench("high_resolution_clock::now()",[]{return (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();});
+  BOOST_CHECK(sum!=0);
+}
@@ -5,6 +5,10 @@ o2_define_bucket(
         NAME
         o2_dataformat_bucket
 
+        DEPENDENCIES
+        pthread
+        rt
+
         SYSTEMINCLUDE_DIRECTORIES
         ${Boost_INCLUDE_DIRS}
 )
@@ -2,6 +2,7 @@
 #define DATAFORMAT_DATABLOCKCONTAINER
 
 #include <DataFormat/MemPool.h>
+#include <DataFormat/MemPoolSubAllocator.h>
 #include <DataFormat/DataBlock.h>
 
 #include <stdlib.h>
@@ -27,9 +28,12 @@ class DataBlockContainer {
 class DataBlockContainerFromMemPool : public DataBlockContainer {
 
   public:
-  DataBlockContainerFromMemPool(std::shared_ptr<MemPool> pool, DataBlock *v_data=NULL);
+  // if v_data is NULL, a page is taken from the pool, waiting up to timeout microseconds if none available (see MemPool::getPage())
+  DataBlockContainerFromMemPool(std::shared_ptr<MemPool> pool, DataBlock *v_data=NULL, int timeout=0);
   ~DataBlockContainerFromMemPool();
 
+  MemPool *getMemPool(); // pool from which block page was taken
+
   private:
   std::shared_ptr<MemPool> mp;
 };
@@ -37,4 +41,19 @@ class DataBlockContainerFromMemPool : public DataBlockContainer {
 
 
 
+// container for data blocks of variable size, packed in pages by a MemPoolSubAllocator
+
+class DataBlockContainerFromMemPoolSubAllocator : public DataBlockContainer {
+
+  public:
+  DataBlockContainerFromMemPoolSubAllocator(std::shared_ptr<MemPoolSubAllocator> allocator, int size, int timeout=0);
+  ~DataBlockContainerFromMemPoolSubAllocator();
+
+  private:
+  std::shared_ptr<MemPoolSubAllocator> mpa;
+};
+
+
+
+
 #endif
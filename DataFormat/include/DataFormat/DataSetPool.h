@@ -0,0 +1,36 @@
+#ifndef DATAFORMAT_DATASETPOOL
+#define DATAFORMAT_DATASETPOOL
+
+#include <DataFormat/DataSet.h>
+#include <DataFormat/MemPool.h>
+
+#include <memory>
+#include <vector>
+
+
+// A pool of preallocated DataSet objects, each with capacity reserved for a given number of blocks.
+// DataSets are given as DataSetReference, and go back to the pool (emptied, capacity kept)
+// when their last reference is released.
+// No heap allocation is done, unless the pool is exhausted (a new DataSet is then allocated from heap)
+// or a DataSet grows above its initial capacity.
+//
+// DataSets can be requested and released from different threads.
+// The pool must outlive all the DataSets it provided.
+
+class DataSetPool {
+  public:
+  DataSetPool(int numberOfSets, int capacity);
+  ~DataSetPool();
+
+  DataSetReference getDataSet(); // returns an empty DataSet. Throws an exception if it can not be allocated.
+
+  int getCapacity(); // initial capacity of each DataSet
+
+  private:
+  int capacity;
+  std::unique_ptr<MemPool> setPool; // one page per DataSet: DataSet object (constructed once), followed by the reference counter of DataSetReference
+  std::vector<DataSet *> sets; // all DataSet objects constructed in setPool
+};
+
+
+#endif
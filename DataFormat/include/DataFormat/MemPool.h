@@ -3,33 +3,200 @@
 
 
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+
+// type of memory used to allocate the pool
+enum class MemPoolStorage {
+  Malloc,      ///< standard allocated memory (default)
+  HugePage2M,  ///< anonymous 2MB hugepages
+  HugePage1G,  ///< anonymous 1GB hugepages
+  HugeTlbFs,   ///< file in a hugetlbfs mount point
+  SharedMemory ///< POSIX shared memory object (or anonymous memfd), which can be attached by other processes
+};
+
+
+// optional parameters used to create a MemPool
+struct MemPoolOptions {
+  int align=1024;               ///< alignment of each page, in bytes
+  MemPoolStorage storage=MemPoolStorage::Malloc;  ///< type of memory to be used. If hugepages can not be allocated, falls back to standard memory.
+  std::string hugeTlbFsPath=""; ///< path to file to be created for HugeTlbFs storage (e.g. /var/lib/hugetlbfs/global/pagesize-2MB/myPool). Must not exist, and be on a hugetlbfs filesystem.
+  int numaNode=-1;              ///< NUMA node where memory should be allocated (-1 for default system policy)
+  std::string sharedMemoryName=""; ///< name of POSIX shared memory object for SharedMemory storage (e.g. /readout-pool). If empty, an anonymous memfd is used.
+  int prefault=0;               ///< if 1, all pages are written at creation, so that they are backed by physical memory before first use
+  int prefaultThreads=0;        ///< number of threads used to prefault memory. 0 for automatic, based on pool size and number of CPUs.
+  int lockMemory=0;             ///< if 1, memory is locked in RAM with mlock() (implies prefault). Left unlocked with a warning on failure (e.g. RLIMIT_MEMLOCK too low).
+};
+
+
+// parameters to attach to a pool created with SharedMemory storage by another process
+struct MemPoolAttach {
+  std::string sharedMemoryName=""; ///< name of POSIX shared memory object, as given in MemPoolOptions
+  int fd=-1;                       ///< or file descriptor of the memory (e.g. memfd inherited from parent process), if name is empty
+};
+
+
+// statistics of pool usage, see MemPool::getStats()
+struct MemPoolStats {
+  int numberOfPages=0;                 ///< total number of pages in pool
+  int pagesInUse=0;                    ///< number of pages not in shared free list (given to users, or kept in thread caches)
+  int pagesInUseMax=0;                 ///< maximum value of pagesInUse since pool creation
+  unsigned long long failedGets=0;     ///< number of getPage() calls which returned NULL
+  unsigned long long numberOfWaits=0;  ///< number of getPage(timeout) calls which found the pool exhausted and waited
+  double waitTime=0;                   ///< cumulated waiting time in getPage(timeout), in seconds
+};
+
+
+struct MemPoolState;
 
 
 // class to create a pool of memory pages from standard allocated memory.
 // lock-free mechanism for fast concurrent page request/release
+//
+// All pages are carved from a single contiguous memory block, so that a page pointer
+// can be converted back to its index by arithmetic.
+// Free pages are kept in a lock-free linked list (LIFO), both getPage() and releasePage() are O(1).
+//
+// Optionally, each thread can keep a private cache of free pages: pages are then moved
+// between thread cache and shared free list by batches, and most get/release calls
+// do not touch shared data (e.g. when pages are allocated by one thread and released by another one).
+//
+// Memory block can be allocated from hugepages and bound to a NUMA node, see MemPoolOptions.
+// It can also be prefaulted (in parallel for large pools) and locked in RAM at creation,
+// so that the first pages used do not pay the page fault cost.
+//
+// With SharedMemory storage, pages and pool state (free list, page reference counts) are in a shared memory segment,
+// so that other processes can attach to the pool (see MemPoolAttach), access pages without copy and release them.
+// Pages are passed to the other process with a single-producer/single-consumer hand-off queue (pushHandOff(), popHandOff()),
+// also in the shared segment.
+// Thread caches are private to each process, and getPage(timeout) is woken up by releases from the same process only.
+//
+// getPage() can wait for a page to be released when pool is exhausted: waiting threads are woken up
+// by releasePage(). As long as some thread is waiting, released pages bypass the thread caches.
 
 class MemPool {
   public:
   MemPool(int numberOfPages, int pageSize=1024*1024, int align=1024);
+  MemPool(int numberOfPages, int pageSize, const MemPoolOptions &options);
+  MemPool(const MemPoolAttach &attach); // attach to a pool created in shared memory by another process. Throws an exception on error.
   ~MemPool();
-  
+
   void *getPage();    // thread-safe ... can be called in parallel
-  void releasePage(void *page);  // thread-safe ... can be called in parallel
+
+  // get a page, waiting for one to be released if pool is exhausted. Thread-safe.
+  // Pages kept in the caches of other threads (see setThreadCacheSize()) are taken back while waiting.
+  // \param timeout  maximum waiting time, in microseconds. 0 for no wait (same as getPage()), -1 to wait until a page is available.
+  // \return page, or NULL if none available before timeout
+  void *getPage(int timeout);
+
+  int releasePage(void *page);  // thread-safe ... can be called in parallel. Page goes back to pool when all its references are released. Returns 0 on success, -1 if not a page of this pool.
+  void addPageReference(void *page); // add a reference to a page in use, to be released with releasePage(). Thread-safe.
+
+  // hand-off queue of pages to another process, for SharedMemory storage. Reference to the page is transferred to the reader.
+  // one writer and one reader only (possibly in different processes).
+  int pushHandOff(void *page); // returns 0 on success, -1 if queue not available or full
+  void *popHandOff(); // returns next page, or NULL if none
+
+  int getSharedMemoryFd(); // file descriptor of the shared memory segment, -1 if none
 
   int getPageSize();
-  
+  int getNumberOfPages();
+
+  int isPageValid(void *page); // returns 1 if page belongs to this pool, 0 otherwise
+  void *getPageAddress(void *ptr); // returns base address of the page containing the given address, or NULL if not in this pool
+
+  MemPoolStorage getStorage(); // type of memory actually used (may differ from the one requested, in case of fallback)
+  std::string getStorageDescription(); // human-readable description of memory used
+  int isMemoryLocked(); // returns 1 if pages are locked in RAM, 0 otherwise
+  double getSetupTime(); // time spent to create the pool (allocation, prefault, lock), in seconds
+
+  // enable per-thread cache of free pages, holding up to cacheSize pages per thread (0 to disable, default).
+  // to be called before pool is used.
+  void setThreadCacheSize(int cacheSize);
+
+  // get thread cache statistics (all threads), updated at each batch transfer with shared free list
+  // \param getHits       number of getPage() served from thread cache
+  // \param getMisses     number of getPage() which needed access to shared free list
+  // \param releaseHits   number of releasePage() kept in thread cache
+  // \param releaseMisses number of releasePage() which needed access to shared free list
+  void getThreadCacheStats(unsigned long long &getHits, unsigned long long &getMisses, unsigned long long &releaseHits, unsigned long long &releaseMisses);
+
+  // get statistics of getPage(timeout) calls which had to wait (all threads)
+  // \param numberOfWaits  number of calls which found the pool exhausted and waited
+  // \param waitTime       cumulated waiting time, in seconds
+  void getWaitStats(unsigned long long &numberOfWaits, double &waitTime);
+
+  // get pool usage statistics. Lock-free, can be called at any time.
+  // Counters are updated when pages move to/from the shared free list (i.e. by batches when thread cache enabled).
+  void getStats(MemPoolStats &stats);
+
   private:
-  
+
+  void initMembers(); // set default values of data members
   void deletePages();  // release memory allocated for data members of this object
+  void allocateBlock(const MemPoolOptions &options); // allocate memory block for pages, according to options. Throws an exception on error.
+  void createSharedSegment(const MemPoolOptions &options); // allocate pages and pool state in shared memory. Throws an exception on error.
+  void mapSharedSegment(int fd, size_t size); // map shared memory segment. Throws an exception on error.
+  void setSharedPointers(); // set pointers to content of shared memory segment, from offsets in pool state
+  void bindMemory(int node); // bind pages memory to a NUMA node
+  void prefaultMemory(int nThreads); // write all pages memory, with the given number of threads (0 for automatic)
+  void lockMemory(); // lock pages memory in RAM
+
+  int getPageIndex(void *page); // returns index of page in pool, or -1 if not a page of this pool
+  void *tryGetPage(); // get a page, without updating failed gets counter
+
+  int getFreePages(int *pages, int maxPages); // remove up to maxPages from free list with a single update, returns number of pages retrieved
+  void putFreePages(int *pages, int nPages); // insert pages in free list with a single update
+  void flushThreadCache(void *cache, int nPages); // move nPages from the given thread cache to free list. Cache must be locked.
+  void flushAllThreadCaches(); // move pages of all thread caches to free list, e.g. for a thread waiting for a page
+
+  friend class MemPoolThreadCaches;
 
   int numberOfPages;
   int pageSize;
+  size_t pageStride; // distance between 2 consecutive pages in memory (page size rounded up to alignment)
+  int pageStrideShift; // log2(pageStride) if it is a power of 2, -1 otherwise. Used to avoid divisions.
+
+  char *baseAddress; // contiguous memory block holding all pages
+  size_t blockSize;  // size of memory block
+  size_t mappedSize; // size of memory mapped for the block (0 if block not mapped)
+  MemPoolStorage storage; // type of memory used for the block
+  int numaNode; // NUMA node memory is bound to (-1 if none)
+  int memoryLocked; // 1 if memory block locked in RAM
+  double setupTime; // time spent in constructor, in seconds
+
+  std::atomic<int> *nextFreePage; // table with index of next free page in free list, for each page (-1 for end of list)
+  std::atomic<int> *pageIsUsed; // table with number of references to each page (0 if free)
+  MemPoolState *state; // free list head, usage counters and hand-off queue indexes
+  int *handOffQueue; // hand-off queue of page indexes (numberOfPages+1 slots), NULL if not in shared memory
+
+  char *sharedSegment; // shared memory segment holding state, tables and pages (NULL if not SharedMemory storage)
+  size_t sharedSegmentSize; // size of shared memory segment
+  int sharedFd; // file descriptor of shared memory segment
+  std::string sharedMemoryName; // name of shared memory object, unlinked on destruction by creator
+  int isSharedOwner; // 1 if this object created the shared segment, 0 if attached
+
+  std::atomic<unsigned long long> failedGets; // number of getPage() calls which returned NULL
 
-  void **pageTable; // table with list of allocated pages
-  std::atomic_flag *pageIsUsed; // table to flag pages in use
+  uint64_t poolId; // unique identifier of this pool, to match thread caches
+  int threadCacheSize; // max number of pages in each thread cache (0 if disabled)
+  std::atomic<unsigned long long> cacheGetHits;
+  std::atomic<unsigned long long> cacheGetMisses;
+  std::atomic<unsigned long long> cacheReleaseHits;
+  std::atomic<unsigned long long> cacheReleaseMisses;
+  std::mutex threadCacheListLock; // lock for threadCacheList
+  std::vector<void *> threadCacheList; // caches of the threads using this pool
 
-  std::atomic<int> lastPageIndexGet; // cache for last page index reserved, will start search of free page from there
-  std::atomic<int> lastPageIndexRelease; // cache for last page index reserved, will start search of free page from there
+  std::mutex waitLock; // lock used with waitCondition
+  std::condition_variable waitCondition; // signaled on page release when some threads are waiting
+  std::atomic<int> waiters; // number of threads waiting for a page
+  std::atomic<unsigned long long> waitCount; // number of getPage(timeout) calls which waited
+  std::atomic<unsigned long long> waitTime; // cumulated waiting time, in nanoseconds
 };
 
 
@@ -0,0 +1,82 @@
+#ifndef DATAFORMAT_MEMPOOLALLOCATOR
+#define DATAFORMAT_MEMPOOLALLOCATOR
+
+#include <DataFormat/MemPool.h>
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <stddef.h>
+
+
+// STL-compatible allocator getting memory from the pages of a MemPool.
+// Typically used with std::allocate_shared() to create small objects at high rate:
+// the object and its shared_ptr reference counter are stored in a recycled pool page,
+// instead of being allocated from the heap for each new object.
+//
+// Requests which do not fit in a page, or which can not be served because the pool is exhausted,
+// fall back to standard heap allocation.
+// The allocator does not own the pool: it must outlive all objects allocated with it.
+// Only a pool pointer is copied in each object reference counter, so that creating and releasing an object
+// does not update a reference counter shared by all objects of the pool.
+
+// upper bound of the memory used by std::allocate_shared() in addition to the object:
+// reference counters, virtual table pointer of the counter, and copy of the allocator.
+// An object of type T is stored in a page if sizeof(T)+memPoolSharedOverhead fits in it.
+const size_t memPoolSharedOverhead=4*sizeof(void *);
+
+template <class T>
+class MemPoolAllocator {
+  public:
+  using value_type=T;
+
+  MemPoolAllocator(MemPool *pool) : mp(pool) {
+  }
+
+  template <class U>
+  MemPoolAllocator(const MemPoolAllocator<U> &other) : mp(other.getPool()) {
+  }
+
+  T *allocate(size_t n) {
+    if ((mp!=nullptr)&&(n*sizeof(T)<=(size_t)mp->getPageSize())) {
+      void *p=mp->getPage();
+      if (p!=NULL) {
+        return static_cast<T *>(p);
+      }
+    }
+    return static_cast<T *>(::operator new(n*sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t) {
+    if ((mp==nullptr)||(mp->releasePage(p))) {
+      ::operator delete(p);
+    }
+  }
+
+  MemPool *getPool() const {
+    return mp;
+  }
+
+  private:
+  MemPool *mp;
+};
+
+template <class T, class U>
+bool operator==(const MemPoolAllocator<T> &a, const MemPoolAllocator<U> &b) {
+  return a.getPool()==b.getPool();
+}
+
+template <class T, class U>
+bool operator!=(const MemPoolAllocator<T> &a, const MemPoolAllocator<U> &b) {
+  return a.getPool()!=b.getPool();
+}
+
+
+// create an object with std::allocate_shared(), object and reference counter being stored in a page of the given pool
+template <class T, class... Args>
+std::shared_ptr<T> makeSharedFromMemPool(MemPool *pool, Args&&... args) {
+  return std::allocate_shared<T>(MemPoolAllocator<T>(pool), std::forward<Args>(args)...);
+}
+
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef DATAFORMAT_MEMPOOLSUBALLOCATOR
+#define DATAFORMAT_MEMPOOLSUBALLOCATOR
+
+#include <DataFormat/MemPool.h>
+
+#include <memory>
+
+
+// class to allocate variable-size blocks packed one after the other in MemPool pages.
+// Used for blocks of variable size, so that memory used follows the actual payload size
+// instead of the page size.
+//
+// Blocks are taken with a bump pointer in the current page.
+// Each page keeps a count of references (blocks allocated + current page of allocator),
+// and goes back to the MemPool when all its blocks have been released.
+//
+// getBlock() is not thread-safe (one allocator per producer thread), releaseBlock() is thread-safe.
+
+class MemPoolSubAllocator {
+  public:
+
+  // \param pool    Pool providing the pages where blocks are allocated. Its page size defines the maximum block size.
+  // \param align   Alignment of the blocks allocated, in bytes.
+  MemPoolSubAllocator(std::shared_ptr<MemPool> pool, int align=64);
+  ~MemPoolSubAllocator();
+
+  void *getBlock(int size, int timeout=0); // get a block of given size. Returns NULL if no page available (after timeout in microseconds, see MemPool::getPage()), or if size too big.
+  void releaseBlock(void *block); // release a block obtained with getBlock(). thread-safe.
+
+  int getMaxBlockSize(); // biggest block size which can be allocated
+
+  private:
+  void releasePageReference(void *page); // decrement page reference count, and release page when not used anymore
+
+  std::shared_ptr<MemPool> mp; // pool providing the pages
+  int align; // blocks alignment
+  int headerSize; // size reserved at beginning of each page for reference count
+  char *currentPage; // page where blocks are currently allocated (NULL if none)
+  int currentOffset; // offset of next free byte in current page
+};
+
+#endif
@@ -16,14 +16,14 @@ DataBlock * DataBlockContainer::getData() {
 
 // container for data pages coming fom MemPool class
 
-DataBlockContainerFromMemPool::DataBlockContainerFromMemPool(std::shared_ptr<MemPool> pool, DataBlock *v_data) {
+DataBlockContainerFromMemPool::DataBlockContainerFromMemPool(std::shared_ptr<MemPool> pool, DataBlock *v_data, int timeout) {
   mp=pool;
   if (mp==nullptr) {
     throw std::string("NULL argument");
   }
   data=v_data;
   if (data==NULL) {
-    data=(DataBlock*)mp->getPage();
+    data=(DataBlock*)mp->getPage(timeout);
     if (data==NULL) {
       throw std::string("No page available");
     }
@@ -37,4 +37,31 @@ DataBlockContainerFromMemPool::~DataBlockContainerFromMemPool() {
       mp->releasePage(data);
     }
   }
-}  
+}
+
+MemPool *DataBlockContainerFromMemPool::getMemPool() {
+  return mp.get();
+}
+
+
+// container for data blocks coming from MemPoolSubAllocator class
+
+DataBlockContainerFromMemPoolSubAllocator::DataBlockContainerFromMemPoolSubAllocator(std::shared_ptr<MemPoolSubAllocator> allocator, int size, int timeout) {
+  mpa=allocator;
+  if (mpa==nullptr) {
+    throw std::string("NULL argument");
+  }
+  data=(DataBlock*)mpa->getBlock(size,timeout);
+  if (data==NULL) {
+    throw std::string("No page available");
+  }
+}
+
+
+DataBlockContainerFromMemPoolSubAllocator::~DataBlockContainerFromMemPoolSubAllocator() {
+  if (mpa!=nullptr) {
+    if (data!=nullptr) {
+      mpa->releaseBlock(data);
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#include <DataFormat/DataSetPool.h>
+
+#include <new>
+
+
+// space reserved at the beginning of each page for the DataSet object, the rest is for the reference counter
+static const int dataSetSlotSize=64;
+static const int dataSetPageSize=192;
+
+
+// called when the last reference to a DataSet of the pool is released
+struct DataSetClear {
+  void operator()(DataSet *ds) const {
+    // release blocks, but keep memory of the vector
+    ds->clear();
+  }
+};
+
+
+// allocator for the reference counter of a DataSetReference, stored in the page of its DataSet.
+// Page goes back to pool when the reference counter is deallocated, i.e. after the DataSet was cleared
+// and the counter destroyed.
+template <class T>
+class DataSetPageAllocator {
+  public:
+  using value_type=T;
+
+  DataSetPageAllocator(MemPool *v_pool, void *v_page) : pool(v_pool), page(v_page) {
+  }
+
+  template <class U>
+  DataSetPageAllocator(const DataSetPageAllocator<U> &other) : pool(other.pool), page(other.page) {
+  }
+
+  T *allocate(size_t n) {
+    if (n*sizeof(T)<=(size_t)(dataSetPageSize-dataSetSlotSize)) {
+      return reinterpret_cast<T *>(&((char *)page)[dataSetSlotSize]);
+    }
+    return static_cast<T *>(::operator new(n*sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t) {
+    if ((void *)p!=(void *)&((char *)page)[dataSetSlotSize]) {
+      ::operator delete(p);
+    }
+    pool->releasePage(page);
+  }
+
+  MemPool *pool;
+  void *page;
+};
+
+template <class T, class U>
+bool operator==(const DataSetPageAllocator<T> &a, const DataSetPageAllocator<U> &b) {
+  return a.page==b.page;
+}
+
+template <class T, class U>
+bool operator!=(const DataSetPageAllocator<T> &a, const DataSetPageAllocator<U> &b) {
+  return a.page!=b.page;
+}
+
+
+DataSetPool::DataSetPool(int numberOfSets, int v_capacity) {
+  static_assert(sizeof(DataSet)<=dataSetSlotSize,"DataSet too big for page slot");
+
+  capacity=v_capacity;
+  setPool=std::make_unique<MemPool>(numberOfSets,dataSetPageSize,64);
+
+  // sets are usually requested by one thread and released by another one
+  setPool->setThreadCacheSize(64);
+
+  for (int i=0;i<numberOfSets;i++) {
+    void *p=setPool->getPage();
+    if (p==NULL) {
+      break;
+    }
+    DataSet *ds=new (p) DataSet;
+    ds->reserve(capacity);
+    sets.push_back(ds);
+  }
+  for (auto ds : sets) {
+    setPool->releasePage(ds);
+  }
+}
+
+
+DataSetPool::~DataSetPool() {
+  for (auto ds : sets) {
+    ds->~DataSet();
+  }
+}
+
+
+DataSetReference DataSetPool::getDataSet() {
+  void *p=setPool->getPage();
+  if (p==NULL) {
+    // pool exhausted
+    DataSetReference ds=std::make_shared<DataSet>();
+    ds->reserve(capacity);
+    return ds;
+  }
+  try {
+    return DataSetReference((DataSet *)p,DataSetClear(),DataSetPageAllocator<DataSet>(setPool.get(),p));
+  }
+  catch (...) {
+    setPool->releasePage(p);
+    throw;
+  }
+}
+
+
+int DataSetPool::getCapacity() {
+  return capacity;
+}
@@ -1,108 +1,1080 @@
 #include <DataFormat/MemPool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <boost/format.hpp>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <new>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#endif
+
+#ifdef __linux__
+// flags to select hugepage size, not defined by older system headers
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+// filesystem type of hugetlbfs, as defined in linux/magic.h
+#define MEMPOOL_HUGETLBFS_MAGIC 0x958458f6
+// NUMA memory policy, as defined in numaif.h (not using libnuma)
+#define MEMPOOL_MPOL_BIND 2
+#define MEMPOOL_MPOL_MF_MOVE (1<<1)
+// process-wide memory barrier commands, as defined in linux/membarrier.h
+#define MEMPOOL_MEMBARRIER_CMD_PRIVATE_EXPEDITED (1<<3)
+#define MEMPOOL_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED (1<<4)
+#endif
+
+// helpers to pack/unpack free list head: page index (low 32 bits) + modification counter (high 32 bits)
+static inline int headIndex(uint64_t head) {
+  return (int)(uint32_t)(head & 0xFFFFFFFF);
+}
+static inline uint64_t headMake(uint64_t previousHead, int index) {
+  return (((previousHead >> 32) + 1) << 32) | (uint32_t)index;
+}
+
+
+// state of the pool, common to all processes using it.
+// At the beginning of the shared memory segment for SharedMemory storage.
+struct MemPoolState {
+  uint64_t magic; // set once segment initialized
+  int numberOfPages;
+  int pageSize;
+  uint64_t pageStride;
+  // offsets of tables from beginning of segment
+  uint64_t handOffQueueOffset;
+  uint64_t nextFreePageOffset;
+  uint64_t pageIsUsedOffset;
+  uint64_t pagesOffset;
+
+  alignas(64) std::atomic<uint64_t> freeListHead; // first free page index (low 32 bits) + modification counter (high 32 bits, to avoid ABA problem)
+  std::atomic<int> pagesInUse; // number of pages not in free list
+  std::atomic<int> pagesInUseMax; // maximum of pagesInUse
+
+  // indexes of hand-off queue, on separate cache lines for writer and reader
+  alignas(64) std::atomic<uint32_t> handOffWrite; // next slot to be written
+  alignas(64) std::atomic<uint32_t> handOffRead; // next slot to be read
+};
+
+static const uint64_t memPoolStateMagic=0x4D656D506F6F6C31; // "MemPool1"
+
+static size_t roundUp(size_t value, size_t align) {
+  return ((value+align-1)/align)*align;
+}
+
+
+// registry of pools alive, so that thread caches can be flushed safely on thread exit
+static std::mutex poolRegistryLock;
+static std::set<uint64_t> poolRegistry;
+static std::atomic<uint64_t> poolIdCounter(0);
+
+
+// cache of free pages kept by a thread for a given pool
+class MemPoolThreadCache {
+  public:
+  uint64_t poolId; // pool using this cache
+  MemPool *pool;
+  std::vector<int> pages; // index of free pages in cache
+  int nPages; // number of pages in cache
+  std::atomic<int> isOwnerActive{0}; // set while cache is accessed by its thread (see lockCache())
+  std::atomic<int> isStealRequested{0}; // set while cache is emptied by another thread (see flushAllThreadCaches())
+
+  // statistics not yet published to pool
+  unsigned long long getHits=0;
+  unsigned long long getMisses=0;
+  unsigned long long releaseHits=0;
+  unsigned long long releaseMisses=0;
+};
+
+
+// when waiting for a page, period of checks of the other threads caches
+static const std::chrono::milliseconds cacheCheckPeriod(10);
+
+// A cache is used by its thread, and occasionally emptied by a thread waiting for a page in getPage(timeout).
+// Locking is asymmetric, so that the owner thread does not pay an atomic read-modify-write nor a fence on each access:
+// the owner marks the cache active and checks no other thread is emptying it, ordered only by a compiler barrier,
+// and the other thread issues a process-wide memory barrier (membarrier()) between its request and its check of the owner.
+// If membarrier() is not available, both sides use a full fence.
+static std::once_flag membarrierInitFlag;
+static int isMembarrierAvailable=0; // set once, before first cache is created
+
+static void membarrierInit() {
+#if defined(__linux__) && defined(SYS_membarrier)
+  if (syscall(SYS_membarrier,MEMPOOL_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED,0)==0) {
+    isMembarrierAvailable=1;
+  }
+#endif
+}
+
+// full memory barrier on all threads of the process
+static void processMemoryBarrier() {
+#if defined(__linux__) && defined(SYS_membarrier)
+  if ((isMembarrierAvailable)&&(syscall(SYS_membarrier,MEMPOOL_MEMBARRIER_CMD_PRIVATE_EXPEDITED,0)==0)) {
+    return;
+  }
+#endif
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+// to be called by the thread owning the cache
+static inline void lockCache(MemPoolThreadCache *c) {
+  for (;;) {
+    c->isOwnerActive.store(1,std::memory_order_relaxed);
+    if (isMembarrierAvailable) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } else {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    if (!c->isStealRequested.load(std::memory_order_acquire)) {
+      return;
+    }
+    // cache being emptied by another thread: wait until done
+    c->isOwnerActive.store(0,std::memory_order_release);
+    while (c->isStealRequested.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+static inline void unlockCache(MemPoolThreadCache *c) {
+  c->isOwnerActive.store(0,std::memory_order_release);
+}
+
+
+// all caches of a thread, one per pool used
+class MemPoolThreadCaches {
+  public:
+  ~MemPoolThreadCaches() {
+    lastCache=nullptr;
+    // give back cached pages to pools still alive
+    std::lock_guard<std::mutex> lock(poolRegistryLock);
+    for (auto &c : caches) {
+      if (poolRegistry.count(c->poolId)) {
+        std::lock_guard<std::mutex> listLock(c->pool->threadCacheListLock);
+        auto &list=c->pool->threadCacheList;
+        list.erase(std::remove(list.begin(),list.end(),(void *)c.get()),list.end());
+        lockCache(c.get());
+        c->pool->flushThreadCache(c.get(),c->nPages);
+        unlockCache(c.get());
+      }
+    }
+  }
+
+  // get cache of calling thread for given pool
+  static inline MemPoolThreadCache *get(MemPool *pool);
+
+  private:
+  MemPoolThreadCache *find(MemPool *pool); // search or create cache for given pool
+
+  std::vector<std::unique_ptr<MemPoolThreadCache>> caches;
+  // last cache used. Plain pointer, so that it is read without the initialization check of a thread_local object.
+  static thread_local MemPoolThreadCache *lastCache;
+};
+
+static thread_local MemPoolThreadCaches threadCaches;
+thread_local MemPoolThreadCache *MemPoolThreadCaches::lastCache=nullptr;
+
+MemPoolThreadCache *MemPoolThreadCaches::get(MemPool *pool) {
+  MemPoolThreadCache *c=lastCache;
+  if ((c!=nullptr)&&(c->poolId==pool->poolId)) {
+    return c;
+  }
+  lastCache=threadCaches.find(pool);
+  return lastCache;
+}
+
+MemPoolThreadCache *MemPoolThreadCaches::find(MemPool *pool) {
+  for (auto &c : caches) {
+    if (c->poolId==pool->poolId) {
+      return c.get();
+    }
+  }
+  // first access to this pool from this thread
+  // cleanup caches of pools which do not exist anymore
+  {
+    std::lock_guard<std::mutex> lock(poolRegistryLock);
+    for (auto it=caches.begin();it!=caches.end();) {
+      if (poolRegistry.count((*it)->poolId)) {
+        ++it;
+      } else {
+        it=caches.erase(it);
+      }
+    }
+  }
+  std::call_once(membarrierInitFlag,membarrierInit);
+  std::unique_ptr<MemPoolThreadCache> c=std::make_unique<MemPoolThreadCache>();
+  c->poolId=pool->poolId;
+  c->pool=pool;
+  c->pages.resize(pool->threadCacheSize);
+  c->nPages=0;
+  {
+    std::lock_guard<std::mutex> listLock(pool->threadCacheListLock);
+    pool->threadCacheList.push_back(c.get());
+  }
+  caches.push_back(std::move(c));
+  return caches.back().get();
+}
+
 
 void MemPool::deletePages() {
   int nPagesUsed=0;
-  
-  if (pageTable!=NULL) {
+
+  if (memoryLocked) {
+    munlock(baseAddress,blockSize);
+    memoryLocked=0;
+  }
+
+  // pages still used by other processes are not reported
+  if ((pageIsUsed!=NULL)&&((sharedSegment==NULL)||(isSharedOwner))) {
     for (int i=0;i<numberOfPages;i++) {
-      if (pageTable[i]!=NULL) {
-        if(pageIsUsed[i].test_and_set()) {
-          nPagesUsed++;
-          pageIsUsed[i].clear();
-        }
-        free(pageTable[i]);
+      if (pageIsUsed[i]) {
+        nPagesUsed++;
       }
     }
-    delete[] pageTable;
-    pageTable=NULL;
   }
+
+  if (sharedSegment!=NULL) {
+    munmap(sharedSegment,sharedSegmentSize);
+    close(sharedFd);
+    if ((isSharedOwner)&&(sharedMemoryName.length())) {
+      shm_unlink(sharedMemoryName.c_str());
+    }
+    sharedSegment=NULL;
+    sharedFd=-1;
+    pageIsUsed=NULL;
+    nextFreePage=NULL;
+    handOffQueue=NULL;
+    state=NULL;
+    baseAddress=NULL;
+  }
+
   if (pageIsUsed!=NULL) {
     delete[] pageIsUsed;
     pageIsUsed=NULL;
   }
+  if (nextFreePage!=NULL) {
+    delete[] nextFreePage;
+    nextFreePage=NULL;
+  }
+  if (state!=NULL) {
+    state->~MemPoolState();
+    free(state);
+    state=NULL;
+  }
+  if (baseAddress!=NULL) {
+    if (mappedSize>0) {
+      munmap(baseAddress,mappedSize);
+      mappedSize=0;
+    } else {
+      free(baseAddress);
+    }
+    baseAddress=NULL;
+  }
   if (nPagesUsed) {
     std::stringstream err;
-    err << boost::format("Warning: still %d pages in use") % nPagesUsed;    
+    err << boost::format("Warning: still %d pages in use") % nPagesUsed;
     std::cerr << err.str() << std::endl;
   }
 }
 
-MemPool::MemPool(int v_numberOfPages, int v_pageSize, int align) {
+void MemPool::allocateBlock(const MemPoolOptions &options) {
+  storage=options.storage;
+  numaNode=-1;
+  mappedSize=0;
+  baseAddress=NULL;
+
+  if (storage!=MemPoolStorage::Malloc) {
+#ifdef __linux__
+    size_t hugePageSize=2*1024*1024;
+    if (storage==MemPoolStorage::HugePage1G) {
+      hugePageSize=1024*1024*1024;
+    }
+    void *ptr=MAP_FAILED;
+    if (storage==MemPoolStorage::HugeTlbFs) {
+      const char *path=options.hugeTlbFsPath.c_str();
+      // do not reuse (and then delete) an existing file
+      int fd=open(path,O_CREAT|O_EXCL|O_RDWR,0600);
+      if (fd<0) {
+        std::cerr << "Warning: failed to create " << path << " : " << strerror(errno) << std::endl;
+      } else {
+        // the block size of the filesystem is the hugepage size
+        struct statfs fsInfo;
+        if ((fstatfs(fd,&fsInfo)==0)&&(fsInfo.f_type==MEMPOOL_HUGETLBFS_MAGIC)) {
+          hugePageSize=fsInfo.f_bsize;
+          mappedSize=((blockSize+hugePageSize-1)/hugePageSize)*hugePageSize;
+          if (ftruncate(fd,mappedSize)==0) {
+            ptr=mmap(NULL,mappedSize,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+          }
+        } else {
+          std::cerr << "Warning: " << path << " is not on a hugetlbfs filesystem" << std::endl;
+        }
+        close(fd);
+        // memory stays available until unmapped
+        unlink(path);
+      }
+    } else {
+      int flags=MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB;
+      if (storage==MemPoolStorage::HugePage1G) {
+        flags|=MAP_HUGE_1GB;
+      } else {
+        flags|=MAP_HUGE_2MB;
+      }
+      mappedSize=((blockSize+hugePageSize-1)/hugePageSize)*hugePageSize;
+      ptr=mmap(NULL,mappedSize,PROT_READ|PROT_WRITE,flags,-1,0);
+    }
+    if (ptr!=MAP_FAILED) {
+      baseAddress=(char *)ptr;
+    } else {
+      mappedSize=0;
+    }
+#endif
+    if (baseAddress==NULL) {
+      std::cerr << "Warning: failed to allocate pool from hugepages, using standard memory" << std::endl;
+      storage=MemPoolStorage::Malloc;
+    }
+  }
+
+  if (baseAddress==NULL) {
+    // align on system pages, so that memory can be bound to a NUMA node
+    size_t blockAlign=options.align;
+    size_t systemPageSize=sysconf(_SC_PAGESIZE);
+    if ((options.numaNode>=0)&&(blockAlign<systemPageSize)) {
+      blockAlign=systemPageSize;
+    }
+    void *newBlock=NULL;
+    if (posix_memalign(&newBlock,blockAlign,blockSize)) {
+      std::stringstream err;
+      err << boost::format("Failed to allocate %d pages sized %d") % numberOfPages % pageSize;
+      throw err.str();
+    }
+    baseAddress=(char *)newBlock;
+  }
+
+  if (options.numaNode>=0) {
+    bindMemory(options.numaNode);
+  }
+}
+
+void MemPool::bindMemory(int node) {
+  int success=0;
+#ifdef __linux__
+  // bind memory before it is touched, move pages already allocated
+  const int bitsPerLong=8*sizeof(unsigned long);
+  std::vector<unsigned long> nodeMask(node/bitsPerLong+1,0);
+  nodeMask[node/bitsPerLong]=1UL << (node%bitsPerLong);
+  size_t systemPageSize=sysconf(_SC_PAGESIZE);
+  size_t bindSize=((blockSize+systemPageSize-1)/systemPageSize)*systemPageSize;
+  if (syscall(SYS_mbind,baseAddress,bindSize,MEMPOOL_MPOL_BIND,&nodeMask[0],nodeMask.size()*bitsPerLong+1,MEMPOOL_MPOL_MF_MOVE)==0) {
+    success=1;
+  }
+#endif
+  if (success) {
+    numaNode=node;
+  } else {
+    std::cerr << boost::format("Warning: failed to bind pool memory to NUMA node %d") % node << std::endl;
+  }
+}
+
+void MemPool::prefaultMemory(int nThreads) {
+  // one system page written at a time: a single fault per page, and hugepages are faulted on first write
+  size_t systemPageSize=sysconf(_SC_PAGESIZE);
+  size_t nSystemPages=(blockSize+systemPageSize-1)/systemPageSize;
+  char *firstPage=(char *)(((size_t)baseAddress/systemPageSize)*systemPageSize);
+  if (firstPage<baseAddress) {
+    // first system page is shared with other data, skip its beginning
+    firstPage+=systemPageSize;
+    baseAddress[0]=0;
+  }
+  char *endAddress=baseAddress+blockSize;
+
+  // page faults are mostly kernel time spent zeroing memory, which scales with the number of threads
+  // one thread per 256MB, within number of CPUs available
+  if (nThreads<=0) {
+    const size_t bytesPerThread=256*1024*1024;
+    nThreads=(int)std::min((size_t)std::max(1U,std::thread::hardware_concurrency()),blockSize/bytesPerThread+1);
+  }
+  if ((size_t)nThreads>nSystemPages) {
+    nThreads=(int)nSystemPages;
+  }
+  auto touch=[=](size_t first, size_t last) {
+    for (size_t i=first;i<last;i++) {
+      char *p=firstPage+i*systemPageSize;
+      if (p>=endAddress) {
+        break;
+      }
+      *((volatile char *)p)=0;
+    }
+  };
+  if (nThreads<=1) {
+    touch(0,nSystemPages);
+    return;
+  }
+  std::vector<std::thread> threads;
+  size_t pagesPerThread=(nSystemPages+nThreads-1)/nThreads;
+  for (int i=0;i<nThreads;i++) {
+    threads.push_back(std::thread(touch,i*pagesPerThread,std::min((i+1)*pagesPerThread,nSystemPages)));
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+void MemPool::lockMemory() {
+  if (mlock(baseAddress,blockSize)==0) {
+    memoryLocked=1;
+  } else {
+    std::cerr << boost::format("Warning: failed to lock pool memory (%ld bytes) : %s") % blockSize % strerror(errno) << std::endl;
+  }
+}
+
+void MemPool::createSharedSegment(const MemPoolOptions &options) {
+  // segment layout: state, hand-off queue, free list table, page reference counts, pages
+  size_t systemPageSize=sysconf(_SC_PAGESIZE);
+  size_t handOffQueueOffset=roundUp(sizeof(MemPoolState),64);
+  size_t nextFreePageOffset=handOffQueueOffset+roundUp(sizeof(int)*(numberOfPages+1),64);
+  size_t pageIsUsedOffset=nextFreePageOffset+roundUp(sizeof(std::atomic<int>)*numberOfPages,64);
+  size_t pagesOffset=roundUp(pageIsUsedOffset+sizeof(std::atomic<int>)*numberOfPages,std::max((size_t)options.align,systemPageSize));
+  size_t segmentSize=pagesOffset+blockSize;
+
+  int fd=-1;
+  if (options.sharedMemoryName.length()) {
+    fd=shm_open(options.sharedMemoryName.c_str(),O_CREAT|O_EXCL|O_RDWR,0600);
+    sharedMemoryName=options.sharedMemoryName;
+  } else {
+#ifdef __linux__
+    fd=memfd_create("MemPool",0);
+#endif
+  }
+  if (fd<0) {
+    std::stringstream err;
+    err << boost::format("Failed to create shared memory %s") % options.sharedMemoryName;
+    throw err.str();
+  }
+  if (ftruncate(fd,segmentSize)!=0) {
+    close(fd);
+    if (sharedMemoryName.length()) {
+      shm_unlink(sharedMemoryName.c_str());
+    }
+    std::stringstream err;
+    err << boost::format("Failed to allocate %ld bytes of shared memory %s") % segmentSize % options.sharedMemoryName;
+    throw err.str();
+  }
+  isSharedOwner=1;
+
+  try {
+    mapSharedSegment(fd,segmentSize);
+  }
+  catch (...) {
+    if (sharedMemoryName.length()) {
+      shm_unlink(sharedMemoryName.c_str());
+    }
+    throw;
+  }
+
+  // segment is zero-filled: create state, tables of atomics are valid with initial value 0
+  MemPoolState *s=new (sharedSegment) MemPoolState;
+  s->numberOfPages=numberOfPages;
+  s->pageSize=pageSize;
+  s->pageStride=pageStride;
+  s->handOffQueueOffset=handOffQueueOffset;
+  s->nextFreePageOffset=nextFreePageOffset;
+  s->pageIsUsedOffset=pageIsUsedOffset;
+  s->pagesOffset=pagesOffset;
+  s->freeListHead=headMake(0,-1);
+  s->pagesInUse=0;
+  s->pagesInUseMax=0;
+  s->handOffWrite=0;
+  s->handOffRead=0;
+  setSharedPointers();
+
+  storage=MemPoolStorage::SharedMemory;
+  if (options.numaNode>=0) {
+    bindMemory(options.numaNode);
+  }
+}
+
+void MemPool::mapSharedSegment(int fd, size_t size) {
+  sharedFd=fd;
+  sharedSegment=(char *)mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  if (sharedSegment==MAP_FAILED) {
+    sharedSegment=NULL;
+    sharedFd=-1;
+    close(fd);
+    throw std::string("Failed to map shared memory");
+  }
+  sharedSegmentSize=size;
+}
 
-  int errorIx=-1;
-  
+void MemPool::setSharedPointers() {
+  state=(MemPoolState *)sharedSegment;
+  handOffQueue=(int *)&sharedSegment[state->handOffQueueOffset];
+  nextFreePage=(std::atomic<int> *)&sharedSegment[state->nextFreePageOffset];
+  pageIsUsed=(std::atomic<int> *)&sharedSegment[state->pageIsUsedOffset];
+  baseAddress=&sharedSegment[state->pagesOffset];
+}
+
+static MemPoolOptions getDefaultOptions(int align) {
+  MemPoolOptions options;
+  options.align=align;
+  return options;
+}
+
+MemPool::MemPool(int v_numberOfPages, int v_pageSize, int align) : MemPool(v_numberOfPages, v_pageSize, getDefaultOptions(align)) {
+}
+
+void MemPool::initMembers() {
+  numberOfPages=0;
+  pageSize=0;
+  pageStride=0;
+  pageStrideShift=-1;
+  baseAddress=NULL;
+  blockSize=0;
+  mappedSize=0;
+  storage=MemPoolStorage::Malloc;
+  numaNode=-1;
+  nextFreePage=NULL;
+  pageIsUsed=NULL;
+  state=NULL;
+  handOffQueue=NULL;
+  sharedSegment=NULL;
+  sharedSegmentSize=0;
+  sharedFd=-1;
+  sharedMemoryName="";
+  isSharedOwner=0;
+  memoryLocked=0;
+  setupTime=0;
+  threadCacheSize=0;
+  cacheGetHits=0;
+  cacheGetMisses=0;
+  cacheReleaseHits=0;
+  cacheReleaseMisses=0;
+  waiters=0;
+  waitCount=0;
+  waitTime=0;
+  failedGets=0;
+}
+
+static void setPageStrideShift(size_t pageStride, int &pageStrideShift) {
+  pageStrideShift=-1;
+  for (int i=0;i<64;i++) {
+    if (pageStride==((size_t)1<<i)) {
+      pageStrideShift=i;
+      break;
+    }
+  }
+}
+
+MemPool::MemPool(int v_numberOfPages, int v_pageSize, const MemPoolOptions &options) {
+
+  auto t0=std::chrono::steady_clock::now();
+  initMembers();
+  int align=options.align;
   numberOfPages=v_numberOfPages;
   pageSize=v_pageSize;
-  pageTable=NULL;
-  pageIsUsed=NULL;
-  
-  pageTable=new void*[numberOfPages];
-  pageIsUsed=new std::atomic_flag[numberOfPages];
-  
-  for (int i=0;i<numberOfPages;i++) {
-    pageTable[i]=NULL;
-    pageIsUsed[i].clear();
+
+  if ((numberOfPages<=0)||(pageSize<=0)||(align<=0)) {
+    std::stringstream err;
+    err << boost::format("Invalid pool parameters: %d pages sized %d, alignment %d") % numberOfPages % pageSize % align;
+    throw err.str();
   }
-  for (int i=0;i<numberOfPages;i++) {
-    void *newPage=NULL;
-    if (posix_memalign(&newPage,align,pageSize)) {
-      errorIx=i;
-      break;
+
+  // each page starts on an aligned address
+  pageStride=(((size_t)pageSize+align-1)/align)*align;
+  blockSize=pageStride*numberOfPages;
+  setPageStrideShift(pageStride,pageStrideShift);
+
+  // on failure, release what was allocated so far (memory block, tables, mapping, lock), as destructor is not called
+  try {
+    if (options.storage==MemPoolStorage::SharedMemory) {
+      createSharedSegment(options);
+    } else {
+      allocateBlock(options);
+
+      nextFreePage=new std::atomic<int>[numberOfPages]();
+      pageIsUsed=new std::atomic<int>[numberOfPages]();
+      void *stateMemory=NULL;
+      if (posix_memalign(&stateMemory,64,sizeof(MemPoolState))) {
+        throw std::string("Failed to allocate pool state");
+      }
+      state=new (stateMemory) MemPoolState;
+      state->pagesInUse=0;
+      state->pagesInUseMax=0;
+    }
+
+    // fault memory before locking it, in parallel: mlock() alone would fault it from a single thread
+    if ((options.prefault)||(options.lockMemory)) {
+      prefaultMemory(options.prefaultThreads);
+    }
+    if (options.lockMemory) {
+      lockMemory();
     }
-    pageTable[i]=newPage;
   }
-  if (errorIx>=0) {
+  catch (...) {
     deletePages();
+    throw;
+  }
+
+  // chain all pages in free list, in increasing address order
+  for (int i=0;i<numberOfPages;i++) {
+    pageIsUsed[i]=0;
+    nextFreePage[i]=(i+1<numberOfPages) ? i+1 : -1;
+  }
+  state->freeListHead=headMake(0,0);
+  state->magic=memPoolStateMagic;
+
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  setupTime=dt.count();
+
+  poolId=++poolIdCounter;
+  std::lock_guard<std::mutex> lock(poolRegistryLock);
+  poolRegistry.insert(poolId);
+}
+
+MemPool::MemPool(const MemPoolAttach &attach) {
+  initMembers();
+
+  int fd=-1;
+  if (attach.sharedMemoryName.length()) {
+    fd=shm_open(attach.sharedMemoryName.c_str(),O_RDWR,0);
+  } else if (attach.fd>=0) {
+    fd=dup(attach.fd);
+  }
+  if (fd<0) {
     std::stringstream err;
-    err << boost::format("Failed to allocate page %d / %d sized %d") % errorIx % numberOfPages % pageSize;
+    err << boost::format("Failed to open shared memory %s") % attach.sharedMemoryName;
     throw err.str();
   }
-  
-  lastPageIndexGet=-1;
-  lastPageIndexRelease=-1;
+  struct stat fdInfo;
+  if ((fstat(fd,&fdInfo)!=0)||((size_t)fdInfo.st_size<sizeof(MemPoolState))) {
+    close(fd);
+    throw std::string("Invalid shared memory size");
+  }
+  mapSharedSegment(fd,fdInfo.st_size);
+  state=(MemPoolState *)sharedSegment;
+  if ((state->magic!=memPoolStateMagic)||(state->pagesOffset+state->pageStride*state->numberOfPages>sharedSegmentSize)) {
+    deletePages();
+    throw std::string("Shared memory does not contain a valid pool");
+  }
+  setSharedPointers();
+
+  storage=MemPoolStorage::SharedMemory;
+  numberOfPages=state->numberOfPages;
+  pageSize=state->pageSize;
+  pageStride=state->pageStride;
+  blockSize=pageStride*numberOfPages;
+  setPageStrideShift(pageStride,pageStrideShift);
+
+  poolId=++poolIdCounter;
+  std::lock_guard<std::mutex> lock(poolRegistryLock);
+  poolRegistry.insert(poolId);
 }
 
 MemPool::~MemPool() {
+  {
+    std::lock_guard<std::mutex> lock(poolRegistryLock);
+    poolRegistry.erase(poolId);
+  }
   deletePages();
 }
 
 
+int MemPool::getFreePages(int *pages, int maxPages) {
+  // seq_cst, to pair with the waiters count in getPage(timeout) and releasePage()
+  uint64_t head=state->freeListHead.load(std::memory_order_seq_cst);
+  for (;;) {
+    int n=0;
+    int next=headIndex(head);
+    // the head counter is incremented on each change, so if the CAS succeeds, the chain walked is consistent
+    while ((n<maxPages)&&(next>=0)) {
+      pages[n++]=next;
+      next=nextFreePage[next].load(std::memory_order_relaxed);
+    }
+    if (n==0) {
+      return 0;
+    }
+    if (state->freeListHead.compare_exchange_weak(head,headMake(head,next),std::memory_order_acq_rel,std::memory_order_acquire)) {
+      int inUse=state->pagesInUse.fetch_add(n,std::memory_order_relaxed)+n;
+      int inUseMax=state->pagesInUseMax.load(std::memory_order_relaxed);
+      while ((inUse>inUseMax)&&(!state->pagesInUseMax.compare_exchange_weak(inUseMax,inUse,std::memory_order_relaxed))) {
+      }
+      return n;
+    }
+  }
+}
+
+
+void MemPool::putFreePages(int *pages, int nPages) {
+  if (nPages<=0) {
+    return;
+  }
+  for (int i=0;i<nPages-1;i++) {
+    nextFreePage[pages[i]].store(pages[i+1],std::memory_order_relaxed);
+  }
+  int last=pages[nPages-1];
+  uint64_t head=state->freeListHead.load(std::memory_order_relaxed);
+  do {
+    nextFreePage[last].store(headIndex(head),std::memory_order_relaxed);
+  } while (!state->freeListHead.compare_exchange_weak(head,headMake(head,pages[0]),std::memory_order_seq_cst,std::memory_order_relaxed));
+  state->pagesInUse.fetch_sub(nPages,std::memory_order_relaxed);
+}
+
+
+void MemPool::flushAllThreadCaches() {
+  // one cache flush at a time, and caches can not be removed while list locked
+  std::lock_guard<std::mutex> listLock(threadCacheListLock);
+  for (void *cache : threadCacheList) {
+    ((MemPoolThreadCache *)cache)->isStealRequested.store(1,std::memory_order_relaxed);
+  }
+  // either the owner sees the request, or we see the owner active (see lockCache())
+  processMemoryBarrier();
+  for (void *cache : threadCacheList) {
+    MemPoolThreadCache *c=(MemPoolThreadCache *)cache;
+    while (c->isOwnerActive.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    flushThreadCache(c,c->nPages);
+    c->isStealRequested.store(0,std::memory_order_release);
+  }
+}
+
+
+void MemPool::flushThreadCache(void *cache, int nPages) {
+  MemPoolThreadCache *c=(MemPoolThreadCache *)cache;
+  if (nPages>c->nPages) {
+    nPages=c->nPages;
+  }
+  c->nPages-=nPages;
+  putFreePages(&c->pages[c->nPages],nPages);
+
+  cacheGetHits+=c->getHits;
+  cacheGetMisses+=c->getMisses;
+  cacheReleaseHits+=c->releaseHits;
+  cacheReleaseMisses+=c->releaseMisses;
+  c->getHits=0;
+  c->getMisses=0;
+  c->releaseHits=0;
+  c->releaseMisses=0;
+}
+
+
+// inline: called for each page, avoid a call through the library symbol table
+inline void *MemPool::tryGetPage() {
+  int ix=-1;
+  if (threadCacheSize>0) {
+    MemPoolThreadCache *c=MemPoolThreadCaches::get(this);
+    lockCache(c);
+    if (c->nPages==0) {
+      c->getMisses++;
+      int batchSize=threadCacheSize/2;
+      if (batchSize<1) {
+        batchSize=1;
+      }
+      c->nPages=getFreePages(&c->pages[0],batchSize);
+      flushThreadCache(c,0); // publish stats
+    } else {
+      c->getHits++;
+    }
+    if (c->nPages>0) {
+      ix=c->pages[--c->nPages];
+    }
+    unlockCache(c);
+    if (ix<0) {
+      return NULL;
+    }
+  } else {
+    if (getFreePages(&ix,1)!=1) {
+      return NULL;
+    }
+  }
+  pageIsUsed[ix].store(1,std::memory_order_relaxed);
+  return &baseAddress[ix*pageStride];
+}
+
+
 void *MemPool::getPage() {
-  int j=0;
-  for (int i=0;i<numberOfPages;i++) {
-    int newIx=(lastPageIndexGet + 1 + i) % numberOfPages;
-    if (!pageIsUsed[newIx].test_and_set()) {
-      lastPageIndexGet=newIx;
-      //printf("getPage() scan => %d\n",j);
-      return pageTable[newIx];
+  void *page=tryGetPage();
+  if (page==NULL) {
+    failedGets++;
+  }
+  return page;
+}
+
+
+void *MemPool::getPage(int timeout) {
+  if (timeout==0) {
+    return getPage();
+  }
+  void *page=tryGetPage();
+  if (page!=NULL) {
+    return page;
+  }
+
+  auto t0=std::chrono::steady_clock::now();
+  auto deadline=t0+std::chrono::microseconds(timeout);
+  {
+    // waiters count is updated before checking again the free list, so that a concurrent release either
+    // makes its page visible to this check, or sees the waiter and signals it.
+    // Pages cached by other threads are not released anymore while there are waiters: take them.
+    // A release may still go to a cache just before the waiters count is seen, so caches are checked again periodically.
+    std::unique_lock<std::mutex> lock(waitLock);
+    waiters++;
+    for (;;) {
+      page=tryGetPage();
+      if (page!=NULL) {
+        break;
+      }
+      if (threadCacheSize>0) {
+        flushAllThreadCaches();
+        page=tryGetPage();
+        if (page!=NULL) {
+          break;
+        }
+      }
+      if (threadCacheSize>0) {
+        // wake up periodically to check caches again
+        auto wakeUp=std::chrono::steady_clock::now()+cacheCheckPeriod;
+        if ((timeout<0)||(wakeUp<deadline)) {
+          waitCondition.wait_until(lock,wakeUp);
+          continue;
+        }
+      }
+      if (timeout<0) {
+        waitCondition.wait(lock);
+      } else if (waitCondition.wait_until(lock,deadline)==std::cv_status::timeout) {
+        page=tryGetPage();
+        break;
+      }
     }
-    j++;
+    waiters--;
   }
-  return NULL;
+  if (page==NULL) {
+    failedGets++;
+  }
+  waitCount++;
+  waitTime+=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count();
+  return page;
 }
 
-// todo: use HASH for fast ptr->index access
+
+inline int MemPool::getPageIndex(void *pagePtr) {
+  if ((pagePtr<baseAddress)||(pagePtr>=baseAddress+blockSize)) {
+    return -1;
+  }
+  size_t offset=(char *)pagePtr-baseAddress;
+  if (pageStrideShift>=0) {
+    if (offset & (pageStride-1)) {
+      return -1;
+    }
+    return (int)(offset>>pageStrideShift);
+  }
+  if (offset % pageStride) {
+    return -1;
+  }
+  return (int)(offset/pageStride);
+}
 
 
-void MemPool::releasePage(void *pagePtr) {
-  int j=0;
-  for (int i=0;i<numberOfPages;i++) {
-    int pageIx=(lastPageIndexRelease+i+1) % numberOfPages;
-    if (pagePtr==pageTable[pageIx]) {
-      pageIsUsed[pageIx].clear();
-      lastPageIndexRelease=pageIx;
-      //printf("realeasePage() scan => %d\n",j);
-      return;
+int MemPool::releasePage(void *pagePtr) {
+  int ix=getPageIndex(pagePtr);
+  if (ix<0) {
+    return -1;
+  }
+  // ignore pages not in use (e.g. released twice)
+  int refs=pageIsUsed[ix].load(std::memory_order_relaxed);
+  if (refs==0) {
+    return 0;
+  }
+  // acq_rel: the last release sees the writes of all other holders (possibly in other processes, see addPageReference)
+  // before the page is recycled
+  if (pageIsUsed[ix].fetch_sub(1,std::memory_order_acq_rel)!=1) {
+    // page still referenced
+    return 0;
+  }
+  if ((threadCacheSize>0)&&(waiters.load(std::memory_order_relaxed)==0)) {
+    MemPoolThreadCache *c=MemPoolThreadCaches::get(this);
+    lockCache(c);
+    if (c->nPages>=threadCacheSize) {
+      c->releaseMisses++;
+      int batchSize=threadCacheSize/2;
+      if (batchSize<1) {
+        batchSize=1;
+      }
+      flushThreadCache(c,batchSize);
+    } else {
+      c->releaseHits++;
     }
-    j++;
+    c->pages[c->nPages++]=ix;
+    unlockCache(c);
+    return 0;
+  }
+  if (threadCacheSize>0) {
+    // some threads waiting: make the pages cached by this thread available too
+    MemPoolThreadCache *c=MemPoolThreadCaches::get(this);
+    lockCache(c);
+    flushThreadCache(c,c->nPages);
+    unlockCache(c);
+  }
+  putFreePages(&ix,1);
+  if (waiters.load(std::memory_order_seq_cst)>0) {
+    std::lock_guard<std::mutex> lock(waitLock);
+    waitCondition.notify_all();
+  }
+  return 0;
+}
+
+void MemPool::addPageReference(void *pagePtr) {
+  int ix=getPageIndex(pagePtr);
+  if (ix<0) {
+    return;
+  }
+  pageIsUsed[ix].fetch_add(1,std::memory_order_relaxed);
+}
+
+int MemPool::pushHandOff(void *pagePtr) {
+  int ix=getPageIndex(pagePtr);
+  if ((ix<0)||(handOffQueue==NULL)) {
+    return -1;
+  }
+  uint32_t w=state->handOffWrite.load(std::memory_order_relaxed);
+  uint32_t next=(w+1)%(numberOfPages+1);
+  if (next==state->handOffRead.load(std::memory_order_acquire)) {
+    return -1;
+  }
+  handOffQueue[w]=ix;
+  state->handOffWrite.store(next,std::memory_order_release);
+  return 0;
+}
+
+void *MemPool::popHandOff() {
+  if (handOffQueue==NULL) {
+    return NULL;
+  }
+  uint32_t r=state->handOffRead.load(std::memory_order_relaxed);
+  if (r==state->handOffWrite.load(std::memory_order_acquire)) {
+    return NULL;
+  }
+  int ix=handOffQueue[r];
+  state->handOffRead.store((r+1)%(numberOfPages+1),std::memory_order_release);
+  if ((ix<0)||(ix>=numberOfPages)) {
+    return NULL;
+  }
+  return &baseAddress[ix*pageStride];
+}
+
+int MemPool::getSharedMemoryFd() {
+  if (sharedSegment==NULL) {
+    return -1;
   }
+  return sharedFd;
 }
 
 int MemPool::getPageSize () {
   return pageSize;
 }
-  
+
+int MemPool::getNumberOfPages() {
+  return numberOfPages;
+}
+
+int MemPool::isPageValid(void *pagePtr) {
+  if (getPageIndex(pagePtr)<0) {
+    return 0;
+  }
+  return 1;
+}
+
+void MemPool::setThreadCacheSize(int cacheSize) {
+  if (cacheSize<0) {
+    cacheSize=0;
+  }
+  threadCacheSize=cacheSize;
+}
+
+void MemPool::getThreadCacheStats(unsigned long long &getHits, unsigned long long &getMisses, unsigned long long &releaseHits, unsigned long long &releaseMisses) {
+  getHits=cacheGetHits;
+  getMisses=cacheGetMisses;
+  releaseHits=cacheReleaseHits;
+  releaseMisses=cacheReleaseMisses;
+}
+
+void MemPool::getWaitStats(unsigned long long &numberOfWaits, double &v_waitTime) {
+  numberOfWaits=waitCount;
+  v_waitTime=waitTime/1000000000.0;
+}
+
+void MemPool::getStats(MemPoolStats &stats) {
+  stats.numberOfPages=numberOfPages;
+  stats.pagesInUse=state->pagesInUse;
+  stats.pagesInUseMax=state->pagesInUseMax;
+  stats.failedGets=failedGets;
+  getWaitStats(stats.numberOfWaits,stats.waitTime);
+}
+
+void *MemPool::getPageAddress(void *ptr) {
+  if ((ptr<baseAddress)||(ptr>=baseAddress+blockSize)) {
+    return NULL;
+  }
+  size_t offset=(char *)ptr-baseAddress;
+  return &baseAddress[(offset/pageStride)*pageStride];
+}
+
+MemPoolStorage MemPool::getStorage() {
+  return storage;
+}
+
+std::string MemPool::getStorageDescription() {
+  std::string description;
+  switch (storage) {
+    case MemPoolStorage::Malloc:
+      description="standard memory";
+      break;
+    case MemPoolStorage::HugePage2M:
+      description="2MB hugepages";
+      break;
+    case MemPoolStorage::HugePage1G:
+      description="1GB hugepages";
+      break;
+    case MemPoolStorage::HugeTlbFs:
+      description="hugetlbfs";
+      break;
+    case MemPoolStorage::SharedMemory:
+      description="shared memory";
+      if (sharedMemoryName.length()) {
+        description+=" " + sharedMemoryName;
+      }
+      break;
+  }
+  if (numaNode>=0) {
+    description+=" on NUMA node " + std::to_string(numaNode);
+  }
+  if (memoryLocked) {
+    description+=", locked";
+  }
+  return description;
+}
+
+int MemPool::isMemoryLocked() {
+  return memoryLocked;
+}
+
+double MemPool::getSetupTime() {
+  return setupTime;
+}
@@ -0,0 +1,72 @@
+#include <DataFormat/MemPoolSubAllocator.h>
+#include <atomic>
+#include <new>
+
+// the reference counter is stored at the beginning of each page
+typedef std::atomic<int> PageRefCount;
+
+MemPoolSubAllocator::MemPoolSubAllocator(std::shared_ptr<MemPool> pool, int v_align) {
+  mp=pool;
+  if (mp==nullptr) {
+    throw std::string("NULL argument");
+  }
+  align=v_align;
+  if (align<(int)sizeof(PageRefCount)) {
+    align=sizeof(PageRefCount);
+  }
+  headerSize=((sizeof(PageRefCount)+align-1)/align)*align;
+  currentPage=NULL;
+  currentOffset=0;
+}
+
+MemPoolSubAllocator::~MemPoolSubAllocator() {
+  // drop reference of allocator on current page, it will be released with its last block
+  if (currentPage!=NULL) {
+    releasePageReference(currentPage);
+    currentPage=NULL;
+  }
+}
+
+void *MemPoolSubAllocator::getBlock(int size, int timeout) {
+  if ((size<=0)||(size>getMaxBlockSize())) {
+    return NULL;
+  }
+  int alignedSize=((size+align-1)/align)*align;
+
+  if ((currentPage!=NULL)&&(currentOffset+alignedSize>mp->getPageSize())) {
+    // current page full
+    releasePageReference(currentPage);
+    currentPage=NULL;
+  }
+  if (currentPage==NULL) {
+    currentPage=(char *)mp->getPage(timeout);
+    if (currentPage==NULL) {
+      return NULL;
+    }
+    new (currentPage) PageRefCount(1); // reference from allocator
+    currentOffset=headerSize;
+  }
+
+  void *block=&currentPage[currentOffset];
+  currentOffset+=alignedSize;
+  ((PageRefCount *)currentPage)->fetch_add(1,std::memory_order_relaxed);
+  return block;
+}
+
+void MemPoolSubAllocator::releasePageReference(void *page) {
+  if (((PageRefCount *)page)->fetch_sub(1,std::memory_order_acq_rel)==1) {
+    mp->releasePage(page);
+  }
+}
+
+void MemPoolSubAllocator::releaseBlock(void *block) {
+  void *page=mp->getPageAddress(block);
+  if (page==NULL) {
+    return;
+  }
+  releasePageReference(page);
+}
+
+int MemPoolSubAllocator::getMaxBlockSize() {
+  return mp->getPageSize()-headerSize;
+}
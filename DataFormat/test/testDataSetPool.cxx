@@ -0,0 +1,111 @@
+/// \file testDataSetPool.cxx
+/// \brief Test of DataSetPool: recycling of DataSet objects, and release of their blocks.
+///
+
+#include "DataFormat/DataSetPool.h"
+#include <stdio.h>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+
+
+// get all sets from pool, and check they are the ones given initially
+// returns number of errors
+int checkAllSetsBack(DataSetPool &pool, std::set<DataSet *> &poolSets) {
+  int nErr=0;
+  std::vector<DataSetReference> v;
+  for (size_t i=0;i<poolSets.size();i++) {
+    v.push_back(pool.getDataSet());
+    if ((!poolSets.count(v.back().get()))||(!v.back()->empty())||((int)v.back()->capacity()<pool.getCapacity())) {
+      nErr++;
+    }
+  }
+  return nErr;
+}
+
+
+int main() {
+  int nErr=0;
+  const int nSets=10;
+  const int capacity=4;
+  DataSetPool pool(nSets,capacity);
+
+  printf("Get sets from pool\n");
+  std::set<DataSet *> poolSets;
+  std::vector<DataSetReference> v;
+  for (int i=0;i<nSets;i++) {
+    v.push_back(pool.getDataSet());
+    poolSets.insert(v.back().get());
+  }
+  if ((int)poolSets.size()!=nSets) {
+    nErr++;
+  }
+  // pool exhausted, allocated from heap
+  v.push_back(pool.getDataSet());
+  if ((poolSets.count(v.back().get()))||((int)v.back()->capacity()<capacity)) {
+    nErr++;
+  }
+
+  printf("Release sets\n");
+  std::shared_ptr<DataBlockContainer> b=std::make_shared<DataBlockContainer>();
+  for (auto &ds : v) {
+    for (int i=0;i<capacity*2;i++) {
+      ds->push_back(b);
+    }
+  }
+  v.clear();
+  // blocks should be released with sets
+  if (!b.unique()) {
+    nErr++;
+  }
+  nErr+=checkAllSetsBack(pool,poolSets);
+
+  printf("Producer/consumer\n");
+  std::mutex lock;
+  std::deque<DataSetReference> queue;
+  const int nLoops=100000;
+  std::thread consumer([&]() {
+    for (int n=0;n<nLoops;) {
+      DataSetReference ds=nullptr;
+      {
+        std::lock_guard<std::mutex> l(lock);
+        if (!queue.empty()) {
+          ds=std::move(queue.front());
+          queue.pop_front();
+        }
+      }
+      if (ds==nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      ds=nullptr;
+      n++;
+    }
+  });
+  for (int n=0;n<nLoops;) {
+    DataSetReference ds=pool.getDataSet();
+    ds->push_back(b);
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> l(lock);
+        if (queue.size()<nSets/2) {
+          queue.push_back(std::move(ds));
+          break;
+        }
+      }
+      std::this_thread::yield();
+    }
+    n++;
+  }
+  consumer.join();
+  if (!b.unique()) {
+    nErr++;
+  }
+  nErr+=checkAllSetsBack(pool,poolSets);
+
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
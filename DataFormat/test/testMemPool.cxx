@@ -1,28 +1,415 @@
-/// \file testDataFormat.c
-/// \brief Example of C usage of data format used in DataBlock.h.
+/// \file testMemPool.cxx
+/// \brief Test and benchmark of MemPool page allocation.
 ///
 /// \author Sylvain Chapeland, CERN
 
 #include "DataFormat/MemPool.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <deque>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <boost/format.hpp>
 
+
+// concurrent get/release from 2 threads, returns number of errors
+int testConcurrency(MemPool *mp, int nIterations) {
+  std::atomic<int> nErr(0);
+  auto worker=[&]() {
+    std::vector<void *> pages;
+    for (int i=0;i<nIterations;i++) {
+      void *p=mp->getPage();
+      if (p!=NULL) {
+        // check nobody else owns this page
+        *((volatile int *)p)=i;
+        pages.push_back(p);
+      }
+      if ((pages.size()>10)||((p==NULL)&&(!pages.empty()))) {
+        void *r=pages.back();
+        pages.pop_back();
+        if (!mp->isPageValid(r)) {
+          nErr++;
+        }
+        mp->releasePage(r);
+      }
+    }
+    for (auto r : pages) {
+      mp->releasePage(r);
+    }
+  };
+  std::thread t1(worker);
+  std::thread t2(worker);
+  t1.join();
+  t2.join();
+
+  // check all pages are back
+  std::vector<void *> pages;
+  for (int i=0;i<mp->getNumberOfPages();i++) {
+    void *p=mp->getPage();
+    if (p==NULL) {
+      nErr++;
+    } else {
+      pages.push_back(p);
+    }
+  }
+  if (mp->getPage()!=NULL) {
+    nErr++;
+  }
+  for (auto r : pages) {
+    mp->releasePage(r);
+  }
+  return nErr;
+}
+
+
+// measure average time of a get/release cycle on a pool filled at 90%
+void benchmark(int nPages) {
+  MemPool mp(nPages,64,64);
+  std::vector<void *> pages;
+  for (int i=0;i<nPages*9/10;i++) {
+    pages.push_back(mp.getPage());
+  }
+  // release in random order, so that free list is not sorted
+  for (size_t i=0;i<pages.size();i+=2) {
+    mp.releasePage(pages[i]);
+  }
+  for (size_t i=0;i<pages.size();i+=2) {
+    pages[i]=mp.getPage();
+  }
+
+  const int nLoops=1000000;
+  auto t0=std::chrono::steady_clock::now();
+  for (int i=0;i<nLoops;i++) {
+    void *p=mp.getPage();
+    void *q=mp.getPage();
+    mp.releasePage(p);
+    mp.releasePage(q);
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  printf("Pool %6d pages : %.1f ns per page get+release\n",nPages,dt.count()*1000000000.0/(nLoops*2));
+
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+}
+
+
+// pages allocated by a producer thread and released by a consumer thread
+// returns number of errors
+int testProducerConsumer(int threadCacheSize) {
+  const int nPages=10000;
+  const int nLoops=2000000;
+  const int maxPagesInFlight=nPages/2; // so that pool is never exhausted
+  MemPool mp(nPages,64,64);
+  mp.setThreadCacheSize(threadCacheSize);
+
+  std::mutex lock;
+  std::deque<void *> queue;
+  std::atomic<int> done(0);
+  std::atomic<int> pagesInFlight(0);
+
+  auto t0=std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    std::vector<void *> batch;
+    for (int i=0;i<nLoops;) {
+      if (pagesInFlight>=maxPagesInFlight) {
+        std::this_thread::yield();
+        continue;
+      }
+      void *p=mp.getPage();
+      if (p!=NULL) {
+        batch.push_back(p);
+        i++;
+      }
+      if ((batch.size()>=256)||((p==NULL)&&(!batch.empty()))) {
+        pagesInFlight+=batch.size();
+        std::lock_guard<std::mutex> l(lock);
+        queue.insert(queue.end(),batch.begin(),batch.end());
+        batch.clear();
+      }
+    }
+    std::lock_guard<std::mutex> l(lock);
+    queue.insert(queue.end(),batch.begin(),batch.end());
+    done=1;
+  });
+  std::thread consumer([&]() {
+    std::deque<void *> batch;
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> l(lock);
+        batch.swap(queue);
+      }
+      if (batch.empty()) {
+        if (done) {
+          std::lock_guard<std::mutex> l(lock);
+          if (queue.empty()) {
+            break;
+          }
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      for (auto p : batch) {
+        mp.releasePage(p);
+      }
+      pagesInFlight-=batch.size();
+      batch.clear();
+    }
+  });
+  producer.join();
+  consumer.join();
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+
+  unsigned long long getHits,getMisses,releaseHits,releaseMisses;
+  mp.getThreadCacheStats(getHits,getMisses,releaseHits,releaseMisses);
+  printf("Thread cache %4d : %.1f ns per page - get hit rate %.1f%% - release hit rate %.1f%%\n",
+    threadCacheSize,dt.count()*1000000000.0/nLoops,
+    (getHits+getMisses) ? getHits*100.0/(getHits+getMisses) : 0.0,
+    (releaseHits+releaseMisses) ? releaseHits*100.0/(releaseHits+releaseMisses) : 0.0);
+
+  // check all pages are back in pool (consumer thread cache flushed on thread exit)
+  int nErr=0;
+  std::vector<void *> pages;
+  for (int i=0;i<nPages;i++) {
+    void *p=mp.getPage();
+    if (p==NULL) {
+      nErr++;
+    } else {
+      pages.push_back(p);
+    }
+  }
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+  return nErr;
+}
+
+
+// check usage statistics
+// returns number of errors
+int testStats() {
+  int nErr=0;
+  const int nPages=16;
+  MemPool mp(nPages,1024);
+  MemPoolStats stats;
+  std::vector<void *> pages;
+  for (int i=0;i<nPages;i++) {
+    pages.push_back(mp.getPage());
+  }
+  for (int i=0;i<3;i++) {
+    if (mp.getPage()!=NULL) {
+      nErr++;
+    }
+  }
+  if (mp.getPage(1000)!=NULL) {
+    nErr++;
+  }
+  for (int i=0;i<nPages/2;i++) {
+    mp.releasePage(pages.back());
+    pages.pop_back();
+  }
+  mp.getStats(stats);
+  printf("%d/%d pages in use, max %d, %llu failed, %llu waits\n",stats.pagesInUse,stats.numberOfPages,stats.pagesInUseMax,stats.failedGets,stats.numberOfWaits);
+  if ((stats.numberOfPages!=nPages)||(stats.pagesInUse!=nPages/2)||(stats.pagesInUseMax!=nPages)||(stats.failedGets!=4)||(stats.numberOfWaits!=1)) {
+    nErr++;
+  }
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+  mp.getStats(stats);
+  if ((stats.pagesInUse!=0)||(stats.pagesInUseMax!=nPages)) {
+    nErr++;
+  }
+  return nErr;
+}
+
+
+// pool exhausted: check getPage(timeout) returns NULL after timeout, and is woken up when a page is released
+// returns number of errors
+int testWait(int threadCacheSize) {
+  int nErr=0;
+  const int nPages=16;
+  MemPool mp(nPages,1024);
+  mp.setThreadCacheSize(threadCacheSize);
+  std::vector<void *> pages;
+  for (int i=0;i<nPages;i++) {
+    pages.push_back(mp.getPage());
+  }
+
+  // timeout
+  auto t0=std::chrono::steady_clock::now();
+  if (mp.getPage(20000)!=NULL) {
+    nErr++;
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  if ((dt.count()<0.020)||(dt.count()>0.5)) {
+    nErr++;
+  }
+
+  // wake up on release, from another thread
+  const int nLoops=100;
+  double wakeUpTime=0;
+  for (int i=0;i<nLoops;i++) {
+    std::atomic<int> waiting(0);
+    std::chrono::steady_clock::time_point tRelease;
+    void *releasedPage=pages.back();
+    pages.pop_back();
+    std::thread releaser([&]() {
+      while (!waiting) {
+        std::this_thread::yield();
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(1000));
+      tRelease=std::chrono::steady_clock::now();
+      mp.releasePage(releasedPage);
+    });
+    waiting=1;
+    void *p=mp.getPage(-1);
+    auto tWakeUp=std::chrono::steady_clock::now();
+    releaser.join();
+    if (p!=releasedPage) {
+      nErr++;
+    }
+    pages.push_back(p);
+    wakeUpTime+=std::chrono::duration<double>(tWakeUp-tRelease).count();
+  }
+  unsigned long long numberOfWaits;
+  double waitTime;
+  mp.getWaitStats(numberOfWaits,waitTime);
+  printf("Thread cache %4d : wake up %.1f us after release - %llu waits, %.3f s\n",threadCacheSize,wakeUpTime*1000000.0/nLoops,numberOfWaits,waitTime);
+  // release may happen before waiting starts, on a busy system
+  if ((numberOfWaits<2)||(numberOfWaits>nLoops+1)) {
+    nErr++;
+  }
+
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+  pages.clear();
+
+  // pages kept in the cache of an idle thread are given to a waiting thread
+  if (threadCacheSize>0) {
+    std::atomic<int> cached(0);
+    std::atomic<int> done(0);
+    std::thread idle([&]() {
+      std::vector<void *> p;
+      for (void *page=mp.getPage();page!=NULL;page=mp.getPage()) {
+        p.push_back(page);
+      }
+      for (auto page : p) {
+        mp.releasePage(page);
+      }
+      cached=1;
+      while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    while (!cached) {
+      std::this_thread::yield();
+    }
+    for (int i=0;i<nPages;i++) {
+      void *p=mp.getPage(1000000);
+      if (p==NULL) {
+        nErr++;
+        break;
+      }
+      pages.push_back(p);
+    }
+    done=1;
+    idle.join();
+    for (auto p : pages) {
+      mp.releasePage(p);
+    }
+  }
+  return nErr;
+}
+
+
+// create a pool with given storage options and check pages are usable
+// returns number of errors
+int testStorage(MemPoolOptions options) {
+  int nErr=0;
+  const int nPages=64;
+  const int pageSize=64*1024;
+  try {
+    MemPool mp(nPages,pageSize,options);
+    printf("Pool created with %s\n",mp.getStorageDescription().c_str());
+    std::vector<void *> pages;
+    for (int i=0;i<nPages;i++) {
+      void *p=mp.getPage();
+      if ((p==NULL)||((size_t)p % options.align)) {
+        nErr++;
+        continue;
+      }
+      memset(p,i,pageSize);
+      pages.push_back(p);
+    }
+    for (auto p : pages) {
+      mp.releasePage(p);
+    }
+  }
+  catch (std::string err) {
+    printf("%s\n",err.c_str());
+    nErr++;
+  }
+  return nErr;
+}
+
+
+// create a pool with given options, and measure time of first write to all pages
+// returns number of errors
+int testPrefault(MemPoolOptions options) {
+  const int nPages=64;
+  const int pageSize=4*1024*1024;
+  const int systemPageSize=4096;
+  int nErr=0;
+  MemPool mp(nPages,pageSize,options);
+  std::vector<void *> pages;
+  double tMax=0;
+  auto t0=std::chrono::steady_clock::now();
+  for (int i=0;i<nPages;i++) {
+    auto t1=std::chrono::steady_clock::now();
+    char *p=(char *)mp.getPage();
+    if (p==NULL) {
+      nErr++;
+      continue;
+    }
+    for (int k=0;k<pageSize;k+=systemPageSize) {
+      p[k]=(char)k;
+    }
+    pages.push_back(p);
+    std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t1;
+    tMax=std::max(tMax,dt.count());
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+  printf("prefault %d threads %2d lock %d : setup %.3f s (%s) - first write %.3f s, max %.0f us per page\n",
+    options.prefault,options.prefaultThreads,options.lockMemory,mp.getSetupTime(),mp.isMemoryLocked() ? "locked" : "not locked",dt.count(),tMax*1000000.0);
+  return nErr;
+}
+
+
 int main() {
 
   int nErr=0;
+  int nErrTotal=0;
   MemPool *mp;
   int nPages=100;
   int pageSize=10*1024*1024;
   std::vector<void *> pageUsed;
-  
-    
+
+
   printf("Creating pool %d pages x %d bytes\n",nPages,pageSize);
   mp=new MemPool(nPages,pageSize);
-  
+
   printf("Get %d pages from pool\n",nPages);
   nErr=0;
   for (int i=0;i<nPages;i++) {
@@ -33,10 +420,14 @@ int main() {
       nErr++;
     }
   }
+  if (mp->getPage()!=NULL) {
+    nErr++;
+  }
   if (nErr) {
     printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
   }
-  
+
   printf("Release %d pages\n",nPages/2);
   nErr=0;
   for (int i=0;i<nPages/2;i++) {
@@ -50,6 +441,7 @@ int main() {
   }
   if (nErr) {
     printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
   }
 
   printf("Get %d pages from pool\n",nPages);
@@ -62,8 +454,17 @@ int main() {
       nErr++;
     }
   }
-  if (nErr) {
+  // only half of the pages should have been available
+  if (nErr!=nPages/2) {
     printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
+  }
+
+  printf("Check invalid pages are rejected\n");
+  int dummy;
+  if ((mp->isPageValid(&dummy))||(mp->isPageValid(((char *)pageUsed[0])+1))) {
+    printf("invalid page accepted\n");
+    nErrTotal++;
   }
 
   printf("Release all pages\n");
@@ -79,10 +480,107 @@ int main() {
   }
   if (nErr) {
     printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
   }
 
-
   printf("Delete pool\n");
   delete mp;
-  return 0;
+
+  printf("Concurrent access\n");
+  mp=new MemPool(nPages,1024);
+  nErr=testConcurrency(mp,1000000);
+  if (nErr) {
+    printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
+  }
+  delete mp;
+
+  printf("Concurrent access with thread cache\n");
+  mp=new MemPool(nPages,1024);
+  mp->setThreadCacheSize(16);
+  nErr=testConcurrency(mp,1000000);
+  if (nErr) {
+    printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
+  }
+  delete mp;
+
+  printf("Storage options\n");
+  {
+    MemPoolOptions options;
+    options.align=4096;
+    for (auto storage : {MemPoolStorage::Malloc, MemPoolStorage::HugePage2M, MemPoolStorage::HugePage1G, MemPoolStorage::HugeTlbFs}) {
+      options.storage=storage;
+      options.hugeTlbFsPath="/var/lib/hugetlbfs/global/pagesize-2MB/testMemPool";
+      nErrTotal+=testStorage(options);
+    }
+    // path not on hugetlbfs: standard memory, and existing file left untouched
+    std::string path="/tmp/testMemPool." + std::to_string(getpid());
+    options.storage=MemPoolStorage::HugeTlbFs;
+    options.hugeTlbFsPath=path;
+    nErrTotal+=testStorage(options);
+    if (MemPool(4,4096,options).getStorage()!=MemPoolStorage::Malloc) {
+      printf("no fallback to standard memory\n");
+      nErrTotal++;
+    }
+    FILE *fp=fopen(path.c_str(),"w");
+    if (fp!=NULL) {
+      fclose(fp);
+    }
+    nErrTotal+=testStorage(options);
+    if (access(path.c_str(),F_OK)) {
+      printf("existing file deleted\n");
+      nErrTotal++;
+    }
+    unlink(path.c_str());
+    options.storage=MemPoolStorage::Malloc;
+    options.numaNode=0;
+    nErrTotal+=testStorage(options);
+  }
+
+  printf("Prefault\n");
+  {
+    MemPoolOptions options;
+    options.align=4096;
+    nErrTotal+=testPrefault(options);
+    options.prefault=1;
+    for (int nThreads : {1, 0}) {
+      options.prefaultThreads=nThreads;
+      nErrTotal+=testPrefault(options);
+    }
+    options.lockMemory=1;
+    nErrTotal+=testPrefault(options);
+  }
+
+  printf("Statistics\n");
+  nErr=testStats();
+  if (nErr) {
+    printf("%d errors\n",nErr);
+    nErrTotal+=nErr;
+  }
+
+  printf("Wait for pages\n");
+  for (int cacheSize : {0, 64}) {
+    nErr=testWait(cacheSize);
+    if (nErr) {
+      printf("%d errors\n",nErr);
+      nErrTotal+=nErr;
+    }
+  }
+
+  printf("Producer/consumer\n");
+  for (int cacheSize : {0, 64, 256}) {
+    nErr=testProducerConsumer(cacheSize);
+    if (nErr) {
+      printf("%d errors\n",nErr);
+      nErrTotal+=nErr;
+    }
+  }
+
+  printf("Benchmark\n");
+  for (int n=100;n<=100000;n*=10) {
+    benchmark(n);
+  }
+
+  return nErrTotal;
 }
@@ -0,0 +1,199 @@
+/// \file testMemPoolAllocator.cxx
+/// \brief Test and benchmark of MemPoolAllocator, compared to standard heap allocation, for data block containers.
+///
+
+#include "DataFormat/MemPoolAllocator.h"
+#include "DataFormat/DataSet.h"
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+
+
+// a container similar to the ones used by readout equipments, with block header stored inside
+class DataBlockContainerTest : public DataBlockContainer {
+  public:
+  DataBlockContainerTest(DataBlockId id) {
+    block.header.id=id;
+    data=&block;
+  }
+  private:
+  DataBlock block;
+};
+
+using DataBlockContainerFactory=std::function<DataBlockContainerReference(DataBlockId)>;
+
+
+// create more objects than pages available, and check heap fallback and page release
+// returns number of errors
+int testFallback() {
+  int nErr=0;
+  const int nPages=100;
+  MemPool mp(nPages,256,64);
+  std::vector<DataBlockContainerReference> v;
+  for (int i=0;i<nPages*2;i++) {
+    v.push_back(makeSharedFromMemPool<DataBlockContainerTest>(&mp,i));
+  }
+  if (mp.getPage()!=NULL) {
+    nErr++;
+  }
+  for (int i=0;i<nPages*2;i++) {
+    if (v[i]->getData()->header.id!=(DataBlockId)i) {
+      nErr++;
+    }
+  }
+  v.clear();
+
+  // objects too big for pages are allocated from heap
+  struct BigObject {
+    char buffer[512];
+  };
+  auto big=makeSharedFromMemPool<BigObject>(&mp);
+  if (mp.isPageValid(big.get())) {
+    nErr++;
+  }
+  big=nullptr;
+
+  // largest object stored in a page
+  struct PageObject {
+    char buffer[256-memPoolSharedOverhead];
+  };
+  auto small=makeSharedFromMemPool<PageObject>(&mp);
+  if (!mp.isPageValid(mp.getPageAddress(small.get()))) {
+    nErr++;
+  }
+  small=nullptr;
+
+  std::vector<void *> pages;
+  for (int i=0;i<nPages;i++) {
+    void *p=mp.getPage();
+    if (p==NULL) {
+      nErr++;
+    } else {
+      pages.push_back(p);
+    }
+  }
+  for (auto p : pages) {
+    mp.releasePage(p);
+  }
+
+  return nErr;
+}
+
+
+const int nLoops=1000000;
+
+// containers created and released by batches in the same thread
+// returns time per container, in nanoseconds
+double benchmarkLocal(DataBlockContainerFactory create) {
+  std::vector<DataBlockContainerReference> batch;
+  auto t0=std::chrono::steady_clock::now();
+  for (int i=0;i<nLoops;i++) {
+    batch.push_back(create(i));
+    if (batch.size()>=256) {
+      batch.clear();
+    }
+  }
+  batch.clear();
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  return dt.count()*1000000000.0/nLoops;
+}
+
+// containers created by a producer thread, passed to a consumer thread, and released there
+// returns time per container, in nanoseconds
+double benchmark(DataBlockContainerFactory create) {
+  std::mutex lock;
+  std::deque<DataBlockContainerReference> queue;
+  std::atomic<int> done(0);
+  std::atomic<int> inFlight(0);
+
+  auto t0=std::chrono::steady_clock::now();
+  std::thread consumer([&]() {
+    std::deque<DataBlockContainerReference> batch;
+    for (;;) {
+      {
+        std::lock_guard<std::mutex> l(lock);
+        batch.swap(queue);
+      }
+      if (batch.empty()) {
+        if (done) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      inFlight-=batch.size();
+      batch.clear();
+    }
+  });
+  std::vector<DataBlockContainerReference> batch;
+  for (int i=0;i<nLoops;i++) {
+    while (inFlight>=5000) {
+      std::this_thread::yield();
+    }
+    batch.push_back(create(i));
+    if (batch.size()>=256) {
+      inFlight+=batch.size();
+      std::lock_guard<std::mutex> l(lock);
+      for (auto &b : batch) {
+        queue.push_back(std::move(b));
+      }
+      batch.clear();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> l(lock);
+    for (auto &b : batch) {
+      queue.push_back(std::move(b));
+    }
+    batch.clear();
+    done=1;
+  }
+  consumer.join();
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  return dt.count()*1000000000.0/nLoops;
+}
+
+
+int main() {
+  int nErr=0;
+
+  printf("Heap fallback\n");
+  nErr+=testFallback();
+
+  // best of several runs, alternating heap and pool
+  DataBlockContainerFactory createHeap=[](DataBlockId id) {
+    return std::make_shared<DataBlockContainerTest>(id);
+  };
+  MemPool pool(10000,256,64);
+  pool.setThreadCacheSize(256);
+  DataBlockContainerFactory createPool=[&](DataBlockId id) {
+    return makeSharedFromMemPool<DataBlockContainerTest>(&pool,id);
+  };
+  const int nRuns=5;
+  for (auto bench : {benchmarkLocal,benchmark}) {
+    printf((bench==benchmarkLocal) ? "Same thread\n" : "Producer/consumer\n");
+    double tHeap=0;
+    double tPool=0;
+    for (int k=0;k<nRuns;k++) {
+      double t=bench(createHeap);
+      if ((k==0)||(t<tHeap)) {
+        tHeap=t;
+      }
+      t=bench(createPool);
+      if ((k==0)||(t<tPool)) {
+        tPool=t;
+      }
+    }
+    printf("make_shared           : %.1f ns per container\n",tHeap);
+    printf("makeSharedFromMemPool : %.1f ns per container\n",tPool);
+  }
+
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
@@ -0,0 +1,178 @@
+/// \file testMemPoolSharedMemory.cxx
+/// \brief Test and benchmark of MemPool in shared memory: pages handed off to another process without copy.
+/// The producer fills each page, the reader checks its content, so the throughput includes one write and one read of the payload.
+///
+
+#include "DataFormat/MemPool.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <chrono>
+#include <string>
+
+
+const int nPages=64;
+const int pageSize=64*1024;
+const int nLoops=50000;
+const int nWords=pageSize/sizeof(uint64_t);
+
+
+// payload of page number i: sequence number first, then a pattern depending on i
+void fillPage(uint64_t *p, uint64_t i) {
+  p[0]=i;
+  for (int j=1;j<nWords;j++) {
+    p[j]=i*nWords+j;
+  }
+}
+
+// returns 0 if page content matches fillPage(p,i)
+int checkPage(const uint64_t *p, uint64_t i) {
+  if (p[0]!=i) {
+    return -1;
+  }
+  uint64_t sum=0;
+  for (int j=1;j<nWords;j++) {
+    sum+=p[j]^(i*nWords+j);
+  }
+  return (sum==0) ? 0 : -1;
+}
+
+
+// reader process: attach to pool, check and release pages received
+// returns number of errors
+int reader(const MemPoolAttach &attach) {
+  int nErr=0;
+  try {
+    MemPool mp(attach);
+    if ((mp.getNumberOfPages()!=nPages)||(mp.getPageSize()!=pageSize)) {
+      return 1;
+    }
+    for (uint64_t i=0;i<(uint64_t)nLoops;) {
+      void *p=mp.popHandOff();
+      if (p==NULL) {
+        sched_yield();
+        continue;
+      }
+      // check payload written by producer
+      if (checkPage((uint64_t *)p,i)) {
+        nErr++;
+      }
+      mp.releasePage(p);
+      i++;
+    }
+  }
+  catch (std::string err) {
+    nErr++;
+  }
+  return nErr;
+}
+
+
+// create pool in shared memory, start a reader process, and send pages to it
+// returns number of errors
+int testHandOff(MemPoolOptions options) {
+  int nErr=0;
+  MemPool mp(nPages,pageSize,options);
+  MemPoolAttach attach;
+  attach.sharedMemoryName=options.sharedMemoryName;
+  attach.fd=mp.getSharedMemoryFd();
+
+  // process exit code is limited to 8 bits
+  pid_t pid=fork();
+  if (pid==0) {
+    int n=reader(attach);
+    _exit((n>255) ? 255 : n);
+  }
+  if (pid<0) {
+    return 1;
+  }
+
+  auto t0=std::chrono::steady_clock::now();
+  for (uint64_t i=0;i<(uint64_t)nLoops;) {
+    void *p=mp.getPage();
+    if (p==NULL) {
+      sched_yield();
+      continue;
+    }
+    fillPage((uint64_t *)p,i);
+    while (mp.pushHandOff(p)) {
+      sched_yield();
+    }
+    i++;
+  }
+  int status=0;
+  waitpid(pid,&status,0);
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  if ((!WIFEXITED(status))||(WEXITSTATUS(status)!=0)) {
+    nErr++;
+  }
+
+  // all pages should be back in pool
+  MemPoolStats stats;
+  mp.getStats(stats);
+  if (stats.pagesInUse!=0) {
+    nErr++;
+  }
+  printf("%s : %.0f pages/s, %.2f GB/s written, handed off and checked\n",mp.getStorageDescription().c_str(),
+    nLoops/dt.count(),nLoops*(double)pageSize/dt.count()/(1024.0*1024*1024));
+  return nErr;
+}
+
+
+// pages referenced by both processes: page back in pool after both released it
+// returns number of errors
+int testReferences() {
+  int nErr=0;
+  MemPoolOptions options;
+  options.storage=MemPoolStorage::SharedMemory;
+  MemPool mp(4,4096,options);
+  MemPoolAttach attach;
+  attach.fd=mp.getSharedMemoryFd();
+  MemPool mpReader(attach);
+
+  void *p=mp.getPage();
+  mp.addPageReference(p);
+  mp.pushHandOff(p);
+  void *q=mpReader.popHandOff();
+  if ((q==NULL)||(memcmp(&p,&q,sizeof(p))==0)) {
+    // second mapping is at a different address
+    nErr++;
+  }
+  mp.releasePage(p);
+  MemPoolStats stats;
+  mp.getStats(stats);
+  if (stats.pagesInUse!=1) {
+    nErr++;
+  }
+  mpReader.releasePage(q);
+  mp.getStats(stats);
+  if (stats.pagesInUse!=0) {
+    nErr++;
+  }
+  return nErr;
+}
+
+
+int main() {
+  int nErr=0;
+
+  printf("Page references\n");
+  nErr+=testReferences();
+
+  printf("Hand-off to another process\n");
+  MemPoolOptions options;
+  options.storage=MemPoolStorage::SharedMemory;
+  // anonymous memory, file descriptor inherited by reader
+  nErr+=testHandOff(options);
+  // named shared memory
+  options.sharedMemoryName="/testMemPoolSharedMemory." + std::to_string(getpid());
+  nErr+=testHandOff(options);
+
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
@@ -0,0 +1,209 @@
+/// \file testMemPoolSubAllocator.cxx
+/// \brief Test and benchmark of MemPoolSubAllocator, compared to fixed-size pages, for realistic block size distributions.
+///
+
+#include "DataFormat/MemPoolSubAllocator.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+
+
+const int maxBlockSize=32*1024;
+const int largePageSize=1024*1024;
+const long memorySize=64*1024*1024; // memory budget for each pool
+
+
+// fill pools until exhausted to measure memory utilisation, then measure get/release cost with blocks released in order
+// returns number of errors
+int testDistribution(const char *name, std::function<int(std::mt19937 &)> getSize) {
+  int nErr=0;
+  std::mt19937 rnd(12345);
+
+  // fixed-size pages: a page must fit the biggest block
+  MemPool fixedPool(memorySize/maxBlockSize,maxBlockSize);
+
+  // packed blocks in large pages
+  std::shared_ptr<MemPool> largePool=std::make_shared<MemPool>(memorySize/largePageSize,largePageSize);
+  std::unique_ptr<MemPoolSubAllocator> allocator=std::make_unique<MemPoolSubAllocator>(largePool);
+
+  long nBlocksFixed=0;
+  long nBytesFixed=0;
+  std::vector<void *> pagesFixed;
+  for (;;) {
+    int sz=getSize(rnd);
+    void *p=fixedPool.getPage();
+    if (p==NULL) {
+      break;
+    }
+    pagesFixed.push_back(p);
+    nBlocksFixed++;
+    nBytesFixed+=sz;
+  }
+
+  long nBlocksPacked=0;
+  long nBytesPacked=0;
+  std::deque<void *> blocksPacked;
+  for (;;) {
+    int sz=getSize(rnd);
+    void *p=allocator->getBlock(sz);
+    if (p==NULL) {
+      break;
+    }
+    // write full block, to check no overlap with page header
+    memset(p,0xFF,sz);
+    blocksPacked.push_back(p);
+    nBlocksPacked++;
+    nBytesPacked+=sz;
+  }
+
+  printf("%-28s fixed: %6ld blocks, %5.1f%% used   packed: %6ld blocks, %5.1f%% used\n",name,
+    nBlocksFixed,nBytesFixed*100.0/memorySize,nBlocksPacked,nBytesPacked*100.0/memorySize);
+
+  for (auto p : pagesFixed) {
+    fixedPool.releasePage(p);
+  }
+
+  // steady state: release oldest block, get a new one
+  while (blocksPacked.size()>(size_t)nBlocksPacked/2) {
+    allocator->releaseBlock(blocksPacked.front());
+    blocksPacked.pop_front();
+  }
+  const int nLoops=1000000;
+  std::vector<int> sizes(nLoops);
+  for (auto &sz : sizes) {
+    sz=getSize(rnd);
+  }
+  auto t0=std::chrono::steady_clock::now();
+  for (int i=0;i<nLoops;i++) {
+    allocator->releaseBlock(blocksPacked.front());
+    blocksPacked.pop_front();
+    void *p=allocator->getBlock(sizes[i]);
+    if (p==NULL) {
+      nErr++;
+      continue;
+    }
+    blocksPacked.push_back(p);
+  }
+  std::chrono::duration<double> dt=std::chrono::steady_clock::now()-t0;
+  printf("%-28s packed: %.1f ns per block get+release\n","",dt.count()*1000000000.0/nLoops);
+
+  for (auto p : blocksPacked) {
+    allocator->releaseBlock(p);
+  }
+  allocator=nullptr;
+
+  // check all pages back in pool
+  std::vector<void *> pages;
+  for (int i=0;i<largePool->getNumberOfPages();i++) {
+    void *p=largePool->getPage();
+    if (p==NULL) {
+      nErr++;
+    } else {
+      pages.push_back(p);
+    }
+  }
+  for (auto p : pages) {
+    largePool->releasePage(p);
+  }
+  return nErr;
+}
+
+
+// blocks allocated by a producer thread and released by a consumer thread
+// returns number of errors
+int testProducerConsumer() {
+  int nErr=0;
+  std::shared_ptr<MemPool> pool=std::make_shared<MemPool>(16,64*1024);
+  std::unique_ptr<MemPoolSubAllocator> allocator=std::make_unique<MemPoolSubAllocator>(pool);
+  MemPoolSubAllocator *a=allocator.get();
+  std::mutex lock;
+  std::deque<void *> queue;
+  std::atomic<int> done(0);
+
+  std::thread consumer([&]() {
+    for (;;) {
+      void *p=NULL;
+      {
+        std::lock_guard<std::mutex> l(lock);
+        if (!queue.empty()) {
+          p=queue.front();
+          queue.pop_front();
+        }
+      }
+      if (p!=NULL) {
+        a->releaseBlock(p);
+      } else if (done) {
+        break;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  std::mt19937 rnd(1);
+  for (int i=0;i<1000000;) {
+    void *p=allocator->getBlock(std::uniform_int_distribution<int>(100,5000)(rnd));
+    if (p==NULL) {
+      std::this_thread::yield();
+      continue;
+    }
+    std::lock_guard<std::mutex> l(lock);
+    queue.push_back(p);
+    i++;
+  }
+  done=1;
+  consumer.join();
+  allocator=nullptr;
+
+  std::vector<void *> pages;
+  for (int i=0;i<pool->getNumberOfPages();i++) {
+    void *p=pool->getPage();
+    if (p==NULL) {
+      nErr++;
+    } else {
+      pages.push_back(p);
+    }
+  }
+  for (auto p : pages) {
+    pool->releasePage(p);
+  }
+  return nErr;
+}
+
+
+int main() {
+  int nErr=0;
+
+  // sizes as in example readout configuration
+  nErr+=testDistribution("uniform 10k-20k",[](std::mt19937 &r) {
+    return std::uniform_int_distribution<int>(10000,20000)(r);
+  });
+  nErr+=testDistribution("uniform 1k-32k",[](std::mt19937 &r) {
+    return std::uniform_int_distribution<int>(1000,maxBlockSize)(r);
+  });
+  nErr+=testDistribution("exponential mean 4k",[](std::mt19937 &r) {
+    int sz=1+(int)std::exponential_distribution<double>(1.0/4096)(r);
+    if (sz>maxBlockSize) sz=maxBlockSize;
+    return sz;
+  });
+  // mostly small events, a few large ones
+  nErr+=testDistribution("bimodal 90% 1-2k, 10% 20-30k",[](std::mt19937 &r) {
+    if (std::uniform_int_distribution<int>(0,9)(r)) {
+      return std::uniform_int_distribution<int>(1000,2000)(r);
+    }
+    return std::uniform_int_distribution<int>(20000,30000)(r);
+  });
+
+  printf("Producer/consumer\n");
+  nErr+=testProducerConsumer();
+
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
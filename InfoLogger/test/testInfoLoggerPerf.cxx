@@ -4,6 +4,7 @@
 /// \author Sylvain Chapeland, CERN
 
 #include "InfoLogger/InfoLogger.hxx"
+#include <Common/Histogram.h>
 #include <Common/Timer.h>
 
 using namespace AliceO2::InfoLogger;
@@ -14,6 +15,7 @@ int main(int argc,char *argv[])
 {
   InfoLogger theLog;
   Timer theTimer;
+  Histogram logTime; // time spent in each log() call, in nanoseconds
   
   int maxMsgCount=1000;   // number of message to send
   int maxMsgSize=100;     // max size of message to send
@@ -66,13 +68,18 @@ int main(int argc,char *argv[])
     char cBak=msgBuffer[sz];
     msgBuffer[sz]=0;
     if (!noOutput) {
+      uint64_t t0=TimerClock::now();
       theLog.log("%s",msgBuffer);
+      logTime.record(TimerClock::now()-t0);
     }
     msgBuffer[sz]=cBak;
   }
   double t=theTimer.getTime();
   printf("Done in %lf seconds\n",t);
   printf("%.2lf msg/s\n",maxMsgCount/t);
+  if (!noOutput) {
+    printf("log() time: %s\n",logTime.toString(" ns").c_str());
+  }
 
   
   return 0;
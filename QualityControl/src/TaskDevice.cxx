@@ -15,6 +15,7 @@
 #include "DataSampling/SamplerFactory.h"
 
 #include "runFairMQDevice.h"
+#include <chrono>
 
 namespace bpo = boost::program_options;
 using namespace std;
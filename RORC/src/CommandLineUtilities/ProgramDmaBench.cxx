@@ -23,8 +23,10 @@
 #include "CommandLineUtilities/Common.h"
 #include "CommandLineUtilities/Options.h"
 #include "CommandLineUtilities/Program.h"
+#include "Common/Histogram.h"
 #include "Common/Iommu.h"
 #include "Common/SuffixOption.h"
+#include "Common/Timer.h"
 #include "ExceptionInternal.h"
 #include "InfoLogger/InfoLogger.hxx"
 #include "folly/ProducerConsumerQueue.h"
@@ -345,6 +347,9 @@ class ProgramDmaBench: public Program
         throw std::runtime_error("Buffer too small");
       }
 
+      // Time when each superpage was given to the driver, to measure the time needed to fill it
+      std::vector<uint64_t> superpagePushTime(mMaxSuperpages, 0);
+
       // Lock-free queues. Usable size is (size-1), so we add 1
       folly::ProducerConsumerQueue<size_t> readoutQueue {static_cast<uint32_t>(mMaxSuperpages) + 1};
       folly::ProducerConsumerQueue<size_t> freeQueue {static_cast<uint32_t>(mMaxSuperpages) + 1};
@@ -400,6 +405,7 @@ class ProgramDmaBench: public Program
                 Superpage superpage;
                 if (freeQueue.read(superpage.offset)) {
                   superpage.size = mSuperpageSize;
+                  superpagePushTime[superpage.offset / mSuperpageSize] = AliceO2::Common::TimerClock::now();
                   mChannel->pushSuperpage(superpage);
                 } else {
                   // No free pages available, so take a little break
@@ -425,6 +431,8 @@ class ProgramDmaBench: public Program
               if (superpage.isReady() && readoutQueue.write(superpage.getOffset())) {
                 // Move full superpage to readout queue
                 currentSuperpagePagesCounted = 0;
+                mSuperpageFillTime.record(AliceO2::Common::TimerClock::now()
+                    - superpagePushTime[superpage.getOffset() / mSuperpageSize]);
                 mChannel->popSuperpage();
               } else {
                 // Readout is backed up, so rest a while
@@ -783,6 +791,14 @@ class ProgramDmaBench: public Program
          }
        }
 
+       if (mSuperpageFillTime.getCount() > 0) {
+         put("Superpage fill time (us)", "");
+         put("  p50", mSuperpageFillTime.getPercentile(50) / 1000.0);
+         put("  p99", mSuperpageFillTime.getPercentile(99) / 1000.0);
+         put("  p99.9", mSuperpageFillTime.getPercentile(99.9) / 1000.0);
+         put("  max", mSuperpageFillTime.getMax() / 1000.0);
+       }
+
        if (mOptions.barHammer) {
          size_t writeSize = sizeof(uint32_t);
          double hammerCount = mBarHammer->getCount();
@@ -896,6 +912,9 @@ class ProgramDmaBench: public Program
     size_t mMaxSuperpages = 0;
     size_t mPagesPerSuperpage = 0;
 
+    /// Time from giving a superpage to the driver until it is filled, in nanoseconds. Recorded by the push thread.
+    AliceO2::Common::Histogram mSuperpageFillTime;
+
     std::unique_ptr<MemoryMappedFile> mMemoryMappedFile;
 
     /// Stream for file readout, only opened if enabled by the --file program options
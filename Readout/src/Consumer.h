@@ -18,7 +18,7 @@ class Consumer {
   };
   virtual ~Consumer() {
   };
-  virtual int pushData(DataBlockContainerReference b)=0;
+  virtual int pushData(const DataBlockContainerReference &b)=0;
   
   protected:
     InfoLogger theLog;
@@ -30,5 +30,9 @@ std::unique_ptr<Consumer> getUniqueConsumerFMQ(ConfigFile &cfg, std::string cfgE
 std::unique_ptr<Consumer> getUniqueConsumerFileRecorder(ConfigFile &cfg, std::string cfgEntryPoint);
 std::unique_ptr<Consumer> getUniqueConsumerDataChecker(ConfigFile &cfg, std::string cfgEntryPoint);
 std::unique_ptr<Consumer> getUniqueConsumerDataSampling(ConfigFile &cfg, std::string cfgEntryPoint);
+std::unique_ptr<Consumer> getUniqueConsumerSharedMemory(ConfigFile &cfg, std::string cfgEntryPoint);
+
+// wrap a consumer to run it in a dedicated thread, see threadEnabled setting of consumers
+std::unique_ptr<Consumer> getUniqueConsumerThread(ConfigFile &cfg, std::string cfgEntryPoint, std::unique_ptr<Consumer> consumer);
 
 
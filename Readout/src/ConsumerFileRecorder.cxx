@@ -1,69 +1,523 @@
 #include "Consumer.h"
+#include "ReadoutUtils.h"
 
+#include <Common/Fifo.h>
+#include <Common/Thread.h>
+#include <Common/Timer.h>
 
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
 
-class ConsumerFileRecorder: public Consumer {
-  public: 
-  ConsumerFileRecorder(ConfigFile &cfg, std::string cfgEntryPoint):Consumer(cfg,cfgEntryPoint) {
+
+// a sequence of files written by a dedicated thread.
+// Data blocks (header and payload) are copied to large aligned buffers, and written by the stream thread.
+// Buffers are written with O_DIRECT (when the filesystem supports it), several at a time with writev(),
+// so that recording does not go through the page cache nor wait for the disk in the calling thread.
+// Files can be rotated after a given size or time: a new file is then started on a block boundary.
+class FileRecorderStream {
+  public:
+  // parameters of a stream, from configuration
+  struct Parameters {
+    int bufferSize=8*1024*1024; // size of each buffer, in bytes
+    int numberOfBuffers=4;
+    int directIO=1; // if set, try to write with O_DIRECT
+    unsigned long long fileMaxSize=0; // rotate file after this number of bytes. 0 for no limit.
+    double fileMaxTime=0; // rotate file after this number of seconds. 0 for no limit.
+    AliceO2::Common::ThreadPlacement placement; // placement of writer thread
+    AliceO2::Common::ThreadIdleBackoff backoff; // idle behavior of writer thread
+  };
+
+  // throws an exception if stream can not be created
+  // streamIndex is used to name the writer thread
+  FileRecorderStream(InfoLogger &theLog, const std::string &fileName, int streamIndex, const Parameters &parameters):theLog(theLog) {
+    this->fileName=fileName;
+    directIO=parameters.directIO;
+    fileMaxSize=parameters.fileMaxSize;
+    fileMaxTime=parameters.fileMaxTime;
     counterBytesTotal=0;
-    fp=NULL;
-    
-    fileName=cfg.getValue<std::string>(cfgEntryPoint + ".fileName");
-    if (fileName.length()>0) {
-      theLog.log("Recording to %s",fileName.c_str());
-      fp=fopen(fileName.c_str(),"wb");
-      if (fp==NULL) {
-        theLog.log("Failed to create file");
+    counterFiles=0;
+    blockedTime=0;
+    isError=0;
+    currentBuffer=-1;
+    fileIndex=0;
+    fileBytes=0;
+    fd=-1;
+    fdIndex=-1;
+    isFdDirect=0;
+
+    // buffer size multiple of alignment, so that all writes but the last of each file are aligned
+    int bufferSize=((parameters.bufferSize+alignment-1)/alignment)*alignment;
+    int numberOfBuffers=parameters.numberOfBuffers;
+    if (numberOfBuffers<2) {
+      numberOfBuffers=2;
+    }
+    bufferFree=std::make_unique<AliceO2::Common::Fifo<int>>(numberOfBuffers);
+    bufferFull=std::make_unique<AliceO2::Common::Fifo<int>>(numberOfBuffers);
+    bufferFree->enableBlockingWait(); // producer sleeps when all buffers are being written
+    for (int i=0;i<numberOfBuffers;i++) {
+      Buffer buf;
+      if (posix_memalign(&buf.data,alignment,bufferSize)) {
+        for (auto &b : buffers) {
+          free(b.data);
+        }
+        throw std::string("Failed to allocate recording buffers");
       }
+      buf.size=bufferSize;
+      buffers.push_back(buf);
+      bufferFree->push(i);
     }
-    if (fp==NULL) {
-      theLog.log("Recording disabled");
-    } else {
-      theLog.log("Recording enabled");
-    }   
-  }  
-  ~ConsumerFileRecorder() {
-    closeRecordingFile();
+
+    // check output can be created, before any data
+    if (openFile(0)) {
+      for (auto &buf : buffers) {
+        free(buf.data);
+      }
+      throw std::string("Failed to create " + getFileName(0));
+    }
+
+    writerThread=std::make_unique<AliceO2::Common::Thread>(FileRecorderStream::writerCallback,this,"FileRecorder-" + std::to_string(streamIndex),100);
+    writerThread->setPlacement(parameters.placement);
+    writerThread->setIdleBackoff(parameters.backoff);
+    writerThread->start();
+    fileTimer.reset();
+    theLog.log("Recording to %s - %d buffers x %d bytes, writer thread on %s",fileName.c_str(),numberOfBuffers,bufferSize,writerThread->getPlacement().c_str());
+  }
+
+  ~FileRecorderStream() {
+    if (!isError) {
+      closeCurrentFile();
+    }
+    // writer stops once all buffers are back
+    for (int i=0;(i<10000)&&(!isError)&&(bufferFree->getNumberOfUsedSlots()!=(int)buffers.size());i++) {
+      usleep(1000);
+    }
+    writerThread->stop();
+    writerThread->join();
+    closeFile();
+    theLog.log("Recorded %llu bytes in %llu files to %s, producer blocked %.3f s, writer thread %s",counterBytesTotal,counterFiles,fileName.c_str(),blockedTime,getThreadStatsDescription(*writerThread).c_str());
+    for (auto &buf : buffers) {
+      free(buf.data);
+    }
+  }
+
+  // write a block. Position of block (file index, offset in file) is returned in the given variables.
+  // Returns 0 on success, -1 on error.
+  int write(void *header, size_t headerSize, void *data, size_t dataSize, int &blockFileIndex, uint64_t &blockOffset) {
+    if (isError) {
+      return -1;
+    }
+    // start a new file before this block, if needed
+    if ((fileBytes>0)&&(((fileMaxSize>0)&&(fileBytes+headerSize+dataSize>fileMaxSize))||((fileMaxTime>0)&&(fileTimer.getTime()>=fileMaxTime)))) {
+      closeCurrentFile();
+      fileIndex++;
+      fileBytes=0;
+      fileTimer.reset();
+    }
+    blockFileIndex=fileIndex;
+    blockOffset=fileBytes;
+    if ((copyToBuffers(header,headerSize))||(copyToBuffers(data,dataSize))) {
+      return -1;
+    }
+    fileBytes+=headerSize+dataSize;
+    counterBytesTotal+=headerSize+dataSize;
+    return 0;
+  }
+
+  // get name of file with given index. Files are numbered when rotation enabled.
+  std::string getFileName(int index) {
+    if ((fileMaxSize==0)&&(fileMaxTime<=0)) {
+      return fileName;
+    }
+    char suffix[16];
+    snprintf(suffix,sizeof(suffix),".%04d",index);
+    return fileName + suffix;
+  }
+
+  private:
+  InfoLogger &theLog;
+  static const int alignment=4096; // alignment of buffers, sizes and offsets for O_DIRECT
+
+  struct Buffer {
+    void *data; // aligned memory
+    size_t size; // size of memory
+    size_t used; // bytes filled
+    int fileIndex; // file where buffer is to be written
+    int isEndOfFile; // set when file to be closed after buffer written
+  };
+  std::vector<Buffer> buffers;
+  std::unique_ptr<AliceO2::Common::Fifo<int>> bufferFree; // indexes of buffers available, filled by writer thread
+  std::unique_ptr<AliceO2::Common::Fifo<int>> bufferFull; // indexes of buffers to be written, filled by write()
+  int currentBuffer; // index of buffer being filled, or -1
+  std::unique_ptr<AliceO2::Common::Thread> writerThread;
+  std::atomic<int> isError; // set by writer thread on failure
+
+  // producer side
+  std::string fileName;
+  int directIO; // if set, try to write with O_DIRECT
+  unsigned long long fileMaxSize; // rotate file after this number of bytes. 0 for no limit.
+  double fileMaxTime; // rotate file after this number of seconds. 0 for no limit.
+  int fileIndex; // index of current file
+  unsigned long long fileBytes; // bytes in current file
+  AliceO2::Common::Timer fileTimer; // time since current file started
+  unsigned long long counterBytesTotal;
+  double blockedTime; // time spent waiting for a free buffer, in seconds
+
+  // writer side
+  int fd; // file being written
+  int fdIndex; // index of file being written
+  int isFdDirect; // set when fd opened with O_DIRECT
+  unsigned long long counterFiles;
+
+  // get a buffer to be filled, waiting for one if needed
+  int getBuffer() {
+    if (bufferFree->pop(currentBuffer)==0) {
+      return 0;
+    }
+    // sleep until writer releases a buffer, checking for writer errors periodically
+    const int errorCheckPeriod=100000; // in microseconds
+    AliceO2::Common::Timer t;
+    while (bufferFree->pop(currentBuffer,errorCheckPeriod)) {
+      if (isError) {
+        currentBuffer=-1;
+        return -1;
+      }
+    }
+    blockedTime+=t.getTime();
+    return 0;
   }
-  int pushData(DataBlockContainerReference b) {
 
-    for(;;) {
-      if (fp!=NULL) {
-        void *ptr;
-        size_t size;
+  // copy data to buffers, sending them to writer when full
+  int copyToBuffers(void *ptr, size_t size) {
+    while (size>0) {
+      if (currentBuffer<0) {
+        if (getBuffer()) {
+          return -1;
+        }
+        Buffer &buf=buffers[currentBuffer];
+        buf.used=0;
+        buf.fileIndex=fileIndex;
+        buf.isEndOfFile=0;
+      }
+      Buffer &buf=buffers[currentBuffer];
+      size_t n=buf.size-buf.used;
+      if (n>size) {
+        n=size;
+      }
+      memcpy((char *)buf.data+buf.used,ptr,n);
+      buf.used+=n;
+      ptr=(char *)ptr+n;
+      size-=n;
+      if (buf.used==buf.size) {
+        bufferFull->push(currentBuffer);
+        currentBuffer=-1;
+      }
+    }
+    return 0;
+  }
 
-        ptr=&b->getData()->header;
-        size=b->getData()->header.headerSize;
-        if (fwrite(ptr,size, 1, fp)!=1) {
+  // send current buffer to writer, to be written as the end of current file
+  void closeCurrentFile() {
+    if (currentBuffer<0) {
+      // empty buffer, just to close file
+      if (getBuffer()) {
+        return;
+      }
+      buffers[currentBuffer].used=0;
+      buffers[currentBuffer].fileIndex=fileIndex;
+    }
+    buffers[currentBuffer].isEndOfFile=1;
+    bufferFull->push(currentBuffer);
+    currentBuffer=-1;
+  }
+
+  // open file with given index. Returns 0 on success.
+  int openFile(int index) {
+    std::string name=getFileName(index);
+    int flags=O_WRONLY|O_CREAT|O_TRUNC;
+    isFdDirect=0;
+    fd=-1;
+    if (directIO) {
+      fd=open(name.c_str(),flags|O_DIRECT,0644);
+      if (fd>=0) {
+        isFdDirect=1;
+      } else if (errno==EINVAL) {
+        theLog.log("O_DIRECT not supported for %s, using buffered I/O",name.c_str());
+      }
+    }
+    if (fd<0) {
+      fd=open(name.c_str(),flags,0644);
+    }
+    if (fd<0) {
+      theLog.log("Failed to create %s : %s",name.c_str(),strerror(errno));
+      return -1;
+    }
+    fdIndex=index;
+    counterFiles++;
+    return 0;
+  }
+
+  void closeFile() {
+    if (fd>=0) {
+      theLog.log("Closing %s",getFileName(fdIndex).c_str());
+      close(fd);
+      fd=-1;
+    }
+  }
+
+  // write all bytes of iovec array. Returns 0 on success.
+  int writeAll(struct iovec *iov, int n) {
+    while (n>0) {
+      ssize_t r=writev(fd,iov,n);
+      if (r<0) {
+        if (errno==EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      // skip what was written
+      while ((n>0)&&((size_t)r>=iov->iov_len)) {
+        r-=iov->iov_len;
+        iov++;
+        n--;
+      }
+      if (n>0) {
+        iov->iov_base=(char *)iov->iov_base+r;
+        iov->iov_len-=r;
+      }
+    }
+    return 0;
+  }
+
+  // write the last buffer of a file: the size may not be aligned, so the tail is written without O_DIRECT
+  int writeTail(Buffer &buf) {
+    size_t aligned=buf.used & ~((size_t)alignment-1);
+    struct iovec iov;
+    if (aligned>0) {
+      iov.iov_base=buf.data;
+      iov.iov_len=aligned;
+      if (writeAll(&iov,1)) {
+        return -1;
+      }
+    }
+    if (aligned<buf.used) {
+      if ((isFdDirect)&&(fcntl(fd,F_SETFL,fcntl(fd,F_GETFL)&~O_DIRECT))) {
+        return -1;
+      }
+      iov.iov_base=(char *)buf.data+aligned;
+      iov.iov_len=buf.used-aligned;
+      if (writeAll(&iov,1)) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  // write buffers pending, several at a time
+  static AliceO2::Common::Thread::CallbackResult writerCallback(void *arg) {
+    FileRecorderStream *c=static_cast<FileRecorderStream *>(arg);
+    if (c->isError) {
+      return AliceO2::Common::Thread::CallbackResult::Idle;
+    }
+    const int maxBuffers=16;
+    int pending[maxBuffers];
+    int nPending=c->bufferFull->popBulk(pending,maxBuffers);
+    if (nPending==0) {
+      return AliceO2::Common::Thread::CallbackResult::Idle;
+    }
+
+    struct iovec iov[maxBuffers];
+    int nIov=0;
+    int err=0;
+    for (int k=0;(k<nPending)&&(!err);k++) {
+      Buffer &buf=c->buffers[pending[k]];
+      if ((c->fd<0)||(c->fdIndex!=buf.fileIndex)) {
+        c->closeFile();
+        if (c->openFile(buf.fileIndex)) {
+          err=1;
           break;
-        }     
-        counterBytesTotal+=size;
-        ptr=&b->getData()->data;
-        size=b->getData()->header.dataSize; 
-        if ((size>0)&&(ptr!=nullptr)) {
-          if (fwrite(ptr,size, 1, fp)!=1) {
-            break;
-          }
         }
-        counterBytesTotal+=size;
       }
-      return 0;
+      if (!buf.isEndOfFile) {
+        // full buffer, aligned: write together with the next ones
+        iov[nIov].iov_base=buf.data;
+        iov[nIov].iov_len=buf.used;
+        nIov++;
+        if ((k<nPending-1)&&(c->buffers[pending[k+1]].fileIndex==buf.fileIndex)) {
+          continue;
+        }
+      }
+      if ((nIov>0)&&(c->writeAll(iov,nIov))) {
+        err=1;
+        break;
+      }
+      nIov=0;
+      if (buf.isEndOfFile) {
+        if (c->writeTail(buf)) {
+          err=1;
+          break;
+        }
+        c->closeFile();
+      }
+    }
+    if (err) {
+      c->theLog.log("Recording write failed : %s",strerror(errno));
+      c->closeFile();
+      c->isError=1;
     }
-    closeRecordingFile();
-    return -1;
+    c->bufferFree->pushBulk(pending,nPending);
+    return AliceO2::Common::Thread::CallbackResult::Ok;
   }
-  private:
-    unsigned long long counterBytesTotal;
-    FILE *fp;
-    int recordingEnabled;
-    std::string fileName;
-    void closeRecordingFile() {
-      if (fp!=NULL) {
-        theLog.log("Closing %s",fileName.c_str());
-        fclose(fp);
-        fp=NULL;
+};
+
+
+
+
+// record data blocks to file. Blocks can be distributed to several directories, each written by its own stream,
+// with an index file to rebuild the original order.
+class ConsumerFileRecorder: public Consumer {
+  public:
+  ConsumerFileRecorder(ConfigFile &cfg, std::string cfgEntryPoint):Consumer(cfg,cfgEntryPoint) {
+    indexFp=NULL;
+    nextStream=0;
+    counterBlocks=0;
+    recordingEnabled=0;
+
+    ConfigFileSection cfgSection(cfg,cfgEntryPoint);
+    std::string fileName=cfg.getValue<std::string>(cfgEntryPoint + ".fileName");
+    FileRecorderStream::Parameters parameters;
+    cfgSection.bind("fileBufferSize",parameters.bufferSize);
+    cfgSection.bind("fileNumberOfBuffers",parameters.numberOfBuffers);
+    cfgSection.bind("fileDirectIO",parameters.directIO);
+    cfgSection.bind("fileMaxSize",parameters.fileMaxSize);
+    cfgSection.bind("fileMaxTime",parameters.fileMaxTime);
+    getThreadPlacementFromConfig(cfgSection,"thread",parameters.placement);
+    parameters.backoff.sleepMin=100;
+    parameters.backoff.sleepMax=1000;
+    getThreadIdleBackoffFromConfig(cfgSection,"thread",parameters.backoff);
+    std::string directories;
+    cfgSection.bind("fileDirectories",directories,std::string(""));
+    if (fileName.length()==0) {
+      theLog.log("Recording disabled");
+      return;
+    }
+
+    // one stream per directory, file named as the last part of fileName
+    std::vector<std::string> fileNames;
+    if (directories.length()==0) {
+      fileNames.push_back(fileName);
+    } else {
+      std::string baseName=fileName.substr(fileName.find_last_of('/')+1);
+      size_t ix=0;
+      for (int k=0;ix<=directories.length();k++) {
+        size_t ixEnd=directories.find(',',ix);
+        if (ixEnd==std::string::npos) {
+          ixEnd=directories.length();
+        }
+        std::string dir=directories.substr(ix,ixEnd-ix);
+        ix=ixEnd+1;
+        if (dir.length()==0) {
+          continue;
+        }
+        fileNames.push_back(dir + "/" + baseName + "-" + std::to_string(k));
+      }
+    }
+
+    try {
+      for (auto &name : fileNames) {
+        streams.push_back(std::make_unique<FileRecorderStream>(theLog,name,(int)streams.size(),parameters));
+      }
+    }
+    catch (std::string err) {
+      theLog.log("%s",err.c_str());
+      streams.clear();
+      theLog.log("Recording disabled");
+      return;
+    }
+
+    if (streams.size()>1) {
+      indexFileName=fileName + ".index";
+      indexFp=fopen(indexFileName.c_str(),"wb");
+      if (indexFp==NULL) {
+        theLog.log("Failed to create %s",indexFileName.c_str());
+        streams.clear();
+        theLog.log("Recording disabled");
+        return;
+      }
+      theLog.log("Recording index to %s",indexFileName.c_str());
+    }
+    recordingEnabled=1;
+    theLog.log("Recording enabled - %d streams",(int)streams.size());
+  }
+
+  ~ConsumerFileRecorder() {
+    streams.clear();
+    if (indexFp!=NULL) {
+      theLog.log("Closing %s - %llu blocks",indexFileName.c_str(),counterBlocks);
+      fclose(indexFp);
+    }
+  }
+
+  int pushData(const DataBlockContainerReference &b) {
+    if (!recordingEnabled) {
+      return 0;
+    }
+    void *header=&b->getData()->header;
+    size_t headerSize=b->getData()->header.headerSize;
+    void *data=b->getData()->data;
+    size_t dataSize=b->getData()->header.dataSize;
+    if (data==nullptr) {
+      dataSize=0;
+    }
+
+    // blocks are distributed to the streams in turn
+    int stream=nextStream;
+    nextStream++;
+    if (nextStream>=(int)streams.size()) {
+      nextStream=0;
+    }
+    FileRecordIndexEntry entry;
+    entry.blockId=b->getData()->header.id;
+    entry.stream=stream;
+    entry.size=headerSize+dataSize;
+    if (streams[stream]->write(header,headerSize,data,dataSize,entry.fileIndex,entry.offset)) {
+      recordingEnabled=0;
+      theLog.log("Recording disabled after write error");
+      return -1;
+    }
+    if (indexFp!=NULL) {
+      if (fwrite(&entry,sizeof(entry),1,indexFp)!=1) {
+        recordingEnabled=0;
+        theLog.log("Recording disabled after index write error");
+        return -1;
       }
     }
+    counterBlocks++;
+    return 0;
+  }
+
+  private:
+  // entry of the index file, one per block, in the order blocks were received
+  struct FileRecordIndexEntry {
+    uint64_t blockId; // id of block
+    uint64_t offset; // offset of block header in file
+    uint32_t size; // size of block, header included
+    int32_t stream; // index of stream (order of fileDirectories)
+    int32_t fileIndex; // index of file in stream, when rotation enabled
+    int32_t reserved=0;
+  };
+
+  std::vector<std::unique_ptr<FileRecorderStream>> streams;
+  int nextStream; // stream for next block
+  int recordingEnabled;
+  std::string indexFileName;
+  FILE *indexFp; // index file, when several streams
+  unsigned long long counterBlocks;
 };
 
 
@@ -0,0 +1,45 @@
+#include "Consumer.h"
+
+
+// pass data pages to another process attached to the equipment memory pool, without copy
+// only blocks stored in a MemPool page in shared memory can be sent
+class ConsumerSharedMemory: public Consumer {
+  public:
+
+  unsigned long long pagesSent;
+  unsigned long long pagesDropped; // reader queue full
+  unsigned long long blocksSkipped; // block not in shared memory
+
+  ConsumerSharedMemory(ConfigFile &cfg, std::string cfgEntryPoint):Consumer(cfg,cfgEntryPoint) {
+    pagesSent=0;
+    pagesDropped=0;
+    blocksSkipped=0;
+  }
+  ~ConsumerSharedMemory() {
+    theLog.log("Shared memory consumer: %llu pages sent, %llu dropped (reader queue full), %llu blocks not in shared memory",pagesSent,pagesDropped,blocksSkipped);
+  }
+  int pushData(const DataBlockContainerReference &b) {
+    DataBlockContainerFromMemPool *c=dynamic_cast<DataBlockContainerFromMemPool *>(b.get());
+    MemPool *mp=(c!=nullptr) ? c->getMemPool() : nullptr;
+    if ((mp==nullptr)||(mp->getStorage()!=MemPoolStorage::SharedMemory)||(!mp->isPageValid(b->getData()))) {
+      blocksSkipped++;
+      return -1;
+    }
+    // the reader gets its own reference to the page, released on its side
+    void *page=b->getData();
+    mp->addPageReference(page);
+    if (mp->pushHandOff(page)) {
+      mp->releasePage(page);
+      pagesDropped++;
+      return -1;
+    }
+    pagesSent++;
+    return 0;
+  }
+  private:
+};
+
+
+std::unique_ptr<Consumer> getUniqueConsumerSharedMemory(ConfigFile &cfg, std::string cfgEntryPoint) {
+  return std::make_unique<ConsumerSharedMemory>(cfg, cfgEntryPoint);
+}
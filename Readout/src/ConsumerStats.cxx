@@ -7,6 +7,7 @@
 #include <memory>
 
 #include <math.h>
+#include <Common/Histogram.h>
 #include <Common/Timer.h>
 
 
@@ -50,6 +51,9 @@ class ConsumerStats: public Consumer {
   uint64_t counterBytesDiff;
   AliceO2::Common::Timer runningTime;
   AliceO2::Common::Timer t;
+  AliceO2::Common::Histogram blockSize; // distribution of block payload size, in bytes
+  AliceO2::Common::Histogram blockInterval; // distribution of time between blocks, in nanoseconds
+  uint64_t lastBlockTime; // time of previous block, in nanoseconds
   int monitoringEnabled;
   int monitoringUpdatePeriod;
   std::unique_ptr<Collector> monitoringCollector;
@@ -88,6 +92,7 @@ class ConsumerStats: public Consumer {
     counterBytesHeader=0;
     counterBlocks=0;
     counterBytesDiff=0;
+    lastBlockTime=0;
     runningTime.reset();
     theLog.log("Starting stats clock");
   }
@@ -98,22 +103,31 @@ class ConsumerStats: public Consumer {
     theLog.log("Stats: %llu blocks, %.2f MB, %.2f%% header overhead",(unsigned long long)counterBlocks,counterBytesTotal/(1024*1024.0),counterBytesHeader*100.0/counterBytesTotal);
     theLog.log("Stats: average block size=%llu bytes",(unsigned long long)counterBytesTotal/counterBlocks);
     theLog.log("Stats: average throughput = %s",NumberOfBytesToString(counterBytesTotal/elapsedTime,"B/s").c_str());
+    theLog.log("Stats: block size %s",blockSize.toString(" bytes").c_str());
+    theLog.log("Stats: time between blocks %s",blockInterval.toString(" ns").c_str());
     publishStats();
     } else {
       theLog.log("Stats: no data received");
     }
   }
-  int pushData(DataBlockContainerReference b) {
+  int pushData(const DataBlockContainerReference &b) {
     counterBlocks++;
     int newBytes=b->getData()->header.dataSize;
     counterBytesTotal+=newBytes;
     counterBytesDiff+=newBytes;
     counterBytesHeader+=b->getData()->header.headerSize;
 
+    blockSize.record(newBytes);
+    uint64_t now=AliceO2::Common::TimerClock::now();
+    if (lastBlockTime) {
+      blockInterval.record(now-lastBlockTime);
+    }
+    lastBlockTime=now;
+
 //    printf("Stats: got %p (%d)\n",b,b.use_count());
     if (monitoringEnabled) {
-      // todo: do not check time every push() if it goes fast...      
-      if (t.isTimeout()) {
+      // checked on every push(): use cheap clock, precision of a few milliseconds is enough here
+      if (t.isTimeoutCoarse()) {
         publishStats();
         t.increment();
       }
@@ -0,0 +1,132 @@
+#include "Consumer.h"
+#include "ReadoutUtils.h"
+
+#include <Common/FifoMPMC.h>
+#include <Common/Thread.h>
+#include <Common/Timer.h>
+
+#include <unistd.h>
+
+
+// run a consumer in a dedicated thread, fed through its own queue
+// so that a slow consumer does not delay the others
+class ConsumerThread: public Consumer {
+  public:
+
+  // what to do when queue is full
+  enum BackpressurePolicy {Block, DropOldest, DropNew};
+
+  ConsumerThread(ConfigFile &cfg, std::string cfgEntryPoint, std::unique_ptr<Consumer> vConsumer):Consumer(cfg,cfgEntryPoint) {
+    consumer=std::move(vConsumer);
+    name=cfgEntryPoint;
+    blocksIn=0;
+    blocksDropped=0;
+    blockedTime=0;
+
+    ConfigFileSection cfgSection(cfg,cfgEntryPoint);
+    int queueSize=1000;
+    cfgSection.bind("threadQueueSize",queueSize);
+    queue=std::make_unique<AliceO2::Common::FifoMPMC<DataBlockContainerReference>>(queueSize);
+    queue->enableBlockingWait(); // producer sleeps until consumer makes room, with Block policy
+
+    std::string cfgPolicy="block";
+    cfgSection.bind("threadBackpressure",cfgPolicy);
+    if (cfgPolicy=="block") {
+      policy=BackpressurePolicy::Block;
+    } else if (cfgPolicy=="dropOldest") {
+      policy=BackpressurePolicy::DropOldest;
+    } else if (cfgPolicy=="dropNew") {
+      policy=BackpressurePolicy::DropNew;
+    } else {
+      throw std::string("Invalid threadBackpressure " + cfgPolicy);
+    }
+
+    consumerThread=std::make_unique<AliceO2::Common::Thread>(ConsumerThread::threadCallback,this,name,100);
+    AliceO2::Common::ThreadPlacement placement;
+    getThreadPlacementFromConfig(cfgSection,"thread",placement);
+    consumerThread->setPlacement(placement);
+    AliceO2::Common::ThreadIdleBackoff backoff;
+    backoff.sleepMin=100;
+    backoff.sleepMax=100;
+    getThreadIdleBackoffFromConfig(cfgSection,"thread",backoff);
+    consumerThread->setIdleBackoff(backoff);
+
+    consumerThread->start();
+    theLog.log("Consumer %s : thread on %s, queue of %d blocks, backpressure %s",name.c_str(),consumerThread->getPlacement().c_str(),queueSize,cfgPolicy.c_str());
+  }
+
+  ~ConsumerThread() {
+    // let consumer process pending blocks, then release whatever is left before deleting consumer
+    for (int i=0;(i<1000)&&(!queue->isEmpty());i++) {
+      usleep(1000);
+    }
+    consumerThread->stop();
+    consumerThread->join();
+    DataBlockContainerReference b;
+    while (queue->pop(b)==0) {
+      blocksDropped++;
+    }
+    b=nullptr;
+    theLog.log("Consumer %s : %llu blocks in, %llu dropped, producer blocked %.3f s",name.c_str(),blocksIn,blocksDropped,blockedTime);
+    theLog.log("Consumer %s : thread %s",name.c_str(),getThreadStatsDescription(*consumerThread).c_str());
+    consumer=nullptr;
+  }
+
+  int pushData(const DataBlockContainerReference &b) {
+    blocksIn++;
+    if (queue->push(b)==0) {
+      return 0;
+    }
+    switch (policy) {
+      case BackpressurePolicy::DropNew:
+        blocksDropped++;
+        return -1;
+      case BackpressurePolicy::DropOldest:
+        // make room by removing the oldest block pending (unless consumer just took it)
+        for (;;) {
+          DataBlockContainerReference old;
+          if (queue->pop(old)==0) {
+            blocksDropped++;
+          }
+          if (queue->push(b)==0) {
+            return 0;
+          }
+        }
+      case BackpressurePolicy::Block:
+      default: {
+        // wait consumer makes room
+        AliceO2::Common::Timer t;
+        queue->push(b,-1);
+        blockedTime+=t.getTime();
+        return 0;
+      }
+    }
+  }
+
+  private:
+  static AliceO2::Common::Thread::CallbackResult threadCallback(void *arg) {
+    ConsumerThread *c=static_cast<ConsumerThread *>(arg);
+    DataBlockContainerReference b;
+    if (c->queue->pop(b)) {
+      return AliceO2::Common::Thread::CallbackResult::Idle;
+    }
+    c->consumer->pushData(b);
+    return AliceO2::Common::Thread::CallbackResult::Ok;
+  }
+
+  std::unique_ptr<Consumer> consumer; // the consumer run in thread
+  std::string name;
+  std::unique_ptr<AliceO2::Common::FifoMPMC<DataBlockContainerReference>> queue; // blocks to be processed by consumer. Read by consumer thread, and by producer to drop oldest.
+  BackpressurePolicy policy;
+  std::unique_ptr<AliceO2::Common::Thread> consumerThread;
+
+  // counters, updated by producer
+  unsigned long long blocksIn; // number of blocks pushed
+  unsigned long long blocksDropped; // number of blocks not processed because queue full
+  double blockedTime; // time spent waiting for space in queue, in seconds
+};
+
+
+std::unique_ptr<Consumer> getUniqueConsumerThread(ConfigFile &cfg, std::string cfgEntryPoint, std::unique_ptr<Consumer> consumer) {
+  return std::make_unique<ConsumerThread>(cfg, cfgEntryPoint, std::move(consumer));
+}
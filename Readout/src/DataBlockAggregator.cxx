@@ -1,12 +1,111 @@
 #include "DataBlockAggregator.h"
 
 
-DataBlockAggregator::DataBlockAggregator(AliceO2::Common::Fifo<DataSetReference> *v_output, std::string name){
-  output=v_output;
-  aggregateThread=std::make_unique<Thread>(DataBlockAggregator::threadCallback,this,name,100);
+// aggregation state of a partition of slice ids
+struct DataBlockAggregatorShard {
+  int index; // slices with id modulo number of shards equal to index
+  DataBlockAggregator *aggregator;
+  std::unique_ptr<Thread> thread;
+
+  // inputs of slices: the aggregator inputs for a single shard, otherwise the blocks dispatched from each of them
+  std::vector<AliceO2::Common::Fifo<DataBlockContainerReference> *> inputs;
+  std::vector<std::unique_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>> dispatchedInputs;
+  std::vector<int> readInputs; // indexes of aggregator inputs read by this shard, when several shards
+
+  // slices output: the aggregator output for a single shard, otherwise merged to it
+  AliceO2::Common::Fifo<DataSetReference> *output;
+  std::unique_ptr<AliceO2::Common::Fifo<DataSetReference>> shardOutput;
+  std::unique_ptr<DataSetPool> dataSetPool; // recycled DataSets for output, created on first use when number of inputs is known
+
+  AliceO2::Common::Timer incompletePendingTimer;
+  int isIncompletePending=0;
+
+  // inputs with data are kept sorted by id of their first block, so that next slice is found without scanning all inputs.
+  // Empty inputs are polled. The first block of an input only changes when the aggregator pops it, so entries stay valid.
+  // Inputs are grouped by id: when inputs are in sync, a slice takes the last group and adds one.
+  struct InputGroup {
+    DataBlockId id; // id of first block
+    std::vector<int> inputs; // indexes of inputs
+  };
+  std::vector<InputGroup> inputHeads; // inputs with data, grouped by id of their first block, sorted by decreasing id
+  std::vector<std::vector<int>> spareInputLists; // recycled lists for inputHeads, to avoid allocations
+  std::vector<int> emptyInputs; // indexes of inputs not in inputHeads
+  std::vector<int> sliceInputs; // indexes of inputs selected for current slice
+  int isInputIndexInitialized=0; // set once emptyInputs filled with all inputs
+  DataBlockId lastSliceId=0; // id of last slice output
+
+  DataBlockAggregatorStats stats;
+
+  void addInputHead(DataBlockId id, int input); // add input to inputHeads
+  void clear(); // reset state, when inputs are empty
+};
+
+
+void DataBlockAggregatorShard::addInputHead(DataBlockId id, int input) {
+  // search from the end: inputs usually get the next id, which is the lowest
+  int k=(int)inputHeads.size();
+  while ((k>0)&&(inputHeads[k-1].id<id)) {
+    k--;
+  }
+  if ((k==0)||(inputHeads[k-1].id!=id)) {
+    InputGroup g;
+    g.id=id;
+    if (!spareInputLists.empty()) {
+      g.inputs.swap(spareInputLists.back());
+      spareInputLists.pop_back();
+    }
+    inputHeads.insert(inputHeads.begin()+k,std::move(g));
+    k++;
+  }
+  inputHeads[k-1].inputs.push_back(input);
+}
+
+void DataBlockAggregatorShard::clear() {
+  for (auto &f : dispatchedInputs) {
+    f->clear();
+  }
+  if (shardOutput!=nullptr) {
+    DataSetReference bc=nullptr;
+    while (!shardOutput->pop(bc)) {
+      bc->clear();
+    }
+    shardOutput->clear();
+  }
+  inputHeads.clear();
+  emptyInputs.clear();
+  isInputIndexInitialized=0;
   isIncompletePending=0;
 }
 
+
+DataBlockAggregator::DataBlockAggregator(AliceO2::Common::Fifo<DataSetReference> *v_output, std::string name, int numberOfThreads){
+  output=v_output;
+  sliceTimeout=500000;
+  incompleteSlicePolicy=IncompleteSlicePolicy::Send;
+  outputOrder=OutputOrder::Ordered;
+  isMergePending=0;
+  lastMergedId=0;
+  slicesOutOfOrder=0;
+
+  if (numberOfThreads<1) {
+    numberOfThreads=1;
+  }
+  for (int i=0;i<numberOfThreads;i++) {
+    auto s=std::make_unique<DataBlockAggregatorShard>();
+    s->index=i;
+    s->aggregator=this;
+    if (numberOfThreads==1) {
+      s->thread=std::make_unique<Thread>(DataBlockAggregator::threadCallback,this,name,100);
+      s->output=output;
+    } else {
+      s->thread=std::make_unique<Thread>(DataBlockAggregator::shardCallback,s.get(),name + "-" + std::to_string(i),100);
+      s->shardOutput=std::make_unique<AliceO2::Common::Fifo<DataSetReference>>(output->getNumberOfFreeSlots()+output->getNumberOfUsedSlots());
+      s->output=s->shardOutput.get();
+    }
+    shards.push_back(std::move(s));
+  }
+}
+
 DataBlockAggregator::~DataBlockAggregator() {
   // todo: flush out FIFOs ?
 }
@@ -14,6 +113,17 @@ DataBlockAggregator::~DataBlockAggregator() {
 int DataBlockAggregator::addInput(std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>input) {
   //inputs.push_back(input);
   inputs.push_back(input);
+  if (shards.size()==1) {
+    shards[0]->inputs.push_back(input.get());
+    return 0;
+  }
+  // each shard gets a FIFO for the blocks of this input in its partition, and inputs are read in turn by the shards
+  int fifoSize=input->getNumberOfFreeSlots()+input->getNumberOfUsedSlots();
+  for (auto &s : shards) {
+    s->dispatchedInputs.push_back(std::make_unique<AliceO2::Common::Fifo<DataBlockContainerReference>>(fifoSize));
+    s->inputs.push_back(s->dispatchedInputs.back().get());
+  }
+  shards[(inputs.size()-1)%shards.size()]->readInputs.push_back(inputs.size()-1);
   return 0;
 }
 
@@ -22,100 +132,308 @@ Thread::CallbackResult DataBlockAggregator::threadCallback(void *arg) {
   if (dPtr==NULL) {
     return Thread::CallbackResult::Error;
   }
-   
-  if (dPtr->output->isFull()) {
-    return Thread::CallbackResult::Idle;
+  if (dPtr->shards.size()==1) {
+    return dPtr->aggregateSlice(*dPtr->shards[0]);
   }
-   
-   
-  int someEmpty=0;
-  int allEmpty=1;
-  int allSame=1;
-  DataBlockId minId=0;
-  DataBlockId lastId=0;
-  // todo: add invalidId instead of 0 for undefined value
-  
-  for (unsigned int i=0; i<dPtr->inputs.size(); i++) {
-    if (!dPtr->inputs[i]->isEmpty()) {
-      allEmpty=0;
-      DataBlockContainerReference bc=nullptr;
-      dPtr->inputs[i]->front(bc);
-      DataBlock *b=bc->getData();
-      DataBlockId newId=b->header.id;
-      if ((minId==0)||(newId<minId)) {
-        minId=newId;
-      }
-      if ((lastId!=0)&&(newId!=lastId)) {
-        allSame=0;
+  int isActive=0;
+  for (auto &s : dPtr->shards) {
+    if (dPtr->dispatchInputs(*s)) {
+      isActive=1;
+    }
+  }
+  for (auto &s : dPtr->shards) {
+    Thread::CallbackResult r=dPtr->aggregateSlice(*s);
+    if (r==Thread::CallbackResult::Error) {
+      return r;
+    }
+    if (r==Thread::CallbackResult::Ok) {
+      isActive=1;
+    }
+  }
+  if (dPtr->mergeOutputs()) {
+    isActive=1;
+  }
+  return isActive ? Thread::CallbackResult::Ok : Thread::CallbackResult::Idle;
+}
+
+Thread::CallbackResult DataBlockAggregator::shardCallback(void *arg) {
+  DataBlockAggregatorShard *s=(DataBlockAggregatorShard*)arg;
+  if (s==NULL) {
+    return Thread::CallbackResult::Error;
+  }
+  DataBlockAggregator *dPtr=s->aggregator;
+  int nDispatched=dPtr->dispatchInputs(*s);
+  Thread::CallbackResult r=dPtr->aggregateSlice(*s);
+  int nMerged=dPtr->mergeOutputs();
+  if (r==Thread::CallbackResult::Error) {
+    return r;
+  }
+  if ((nDispatched)||(nMerged)||(r==Thread::CallbackResult::Ok)) {
+    return Thread::CallbackResult::Ok;
+  }
+  return Thread::CallbackResult::Idle;
+}
+
+int DataBlockAggregator::dispatchInputs(DataBlockAggregatorShard &shard) {
+  // limit blocks moved per input in one iteration, so that this shard aggregates its own slices in the meantime
+  const int maxBlocks=64;
+  int nShards=(int)shards.size();
+  int nMoved=0;
+  for (int i : shard.readInputs) {
+    for (int k=0;(k<maxBlocks)&&(!inputs[i]->isEmpty());k++) {
+      DataBlockId id=(*inputs[i]->frontPtr())->getData()->header.id;
+      AliceO2::Common::Fifo<DataBlockContainerReference> *f=shards[id%nShards]->dispatchedInputs[i].get();
+      if (f->isFull()) {
+        // keep blocks of input in order
+        break;
       }
-      lastId=newId;
+      DataBlockContainerReference b=nullptr;
+      inputs[i]->pop(b);
+      f->push(std::move(b));
+      nMoved++;
+    }
+  }
+  return nMoved;
+}
+
+Thread::CallbackResult DataBlockAggregator::aggregateSlice(DataBlockAggregatorShard &s) {
+  if (s.output->isFull()) {
+    return Thread::CallbackResult::Idle;
+  }
+
+  if (!s.isInputIndexInitialized) {
+    for (unsigned int i=0; i<s.inputs.size(); i++) {
+      s.emptyInputs.push_back(i);
+    }
+    s.sliceInputs.reserve(s.inputs.size());
+    s.isInputIndexInitialized=1;
+  }
+
+  // move inputs which received data to inputHeads
+  for (unsigned int k=0; k<s.emptyInputs.size();) {
+    int i=s.emptyInputs[k];
+    if (!s.inputs[i]->isEmpty()) {
+      // access block in place, to avoid a reference count update
+      DataBlockId newId=(*s.inputs[i]->frontPtr())->getData()->header.id;
+      s.addInputHead(newId,i);
+      s.emptyInputs[k]=s.emptyInputs.back();
+      s.emptyInputs.pop_back();
     } else {
-      someEmpty=1;
-      allSame=0;
+      k++;
     }
   }
 
-  if (allEmpty) {
+  if (s.inputHeads.empty()) {
     return Thread::CallbackResult::Idle;
   }
-  
-  if (someEmpty) {
-    if (!dPtr->isIncompletePending) {
-      dPtr->incompletePendingTimer.reset(500000);
-      dPtr->isIncompletePending=1;
+
+  // select inputs with the lowest id
+  DataBlockAggregatorShard::InputGroup &minHead=s.inputHeads.back();
+  DataBlockId minId=minHead.id;
+  int allSame=(minHead.inputs.size()==s.inputs.size());
+  int someEmpty=!s.emptyInputs.empty();
+
+  // empty inputs may still provide a block for this slice: wait for them, up to the timeout
+  // (inputs with a higher id do not have a block for this slice)
+  if ((someEmpty)&&(sliceTimeout>0)) {
+    if (!s.isIncompletePending) {
+      s.incompletePendingTimer.reset(sliceTimeout);
+      s.isIncompletePending=1;
     }
 
-    if (dPtr->isIncompletePending && (!dPtr->incompletePendingTimer.isTimeout())) {
+    if (s.isIncompletePending && (!s.incompletePendingTimer.isTimeout())) {
       return Thread::CallbackResult::Idle;
     }
   }
 
   if (allSame) {
-    dPtr->isIncompletePending=0;
+    s.isIncompletePending=0;
   } 
   
   DataSetReference bcv=nullptr;
-  try {
-    bcv=std::make_shared<DataSet>();
-  }
-  catch(...) {
-    return Thread::CallbackResult::Error;
-  }
-  
-  
-  for (unsigned int i=0; i<dPtr->inputs.size(); i++) {
-    if (!dPtr->inputs[i]->isEmpty()) {    
-      DataBlockContainerReference b=nullptr;
-      dPtr->inputs[i]->front(b);
-      DataBlockId newId=b->getData()->header.id;
-      if (newId==minId) {
-        bcv->push_back(b);
-        dPtr->inputs[i]->pop(b);
-        //printf("1 block for event %llu from input %d @ %p\n",(unsigned long long)newId,b);
-	//printf("aggregating %p into dataSet %p\n",b->getData()->data,bcv.get());
+  int isDropped=((!allSame)&&(incompleteSlicePolicy==IncompleteSlicePolicy::Drop));
+  if (!isDropped) {
+    try {
+      if (s.dataSetPool==nullptr) {
+        // enough sets for output FIFOs, plus the ones being filled or consumed
+        int nSets=s.output->getNumberOfFreeSlots()+s.output->getNumberOfUsedSlots()+4;
+        if (s.output!=output) {
+          nSets+=output->getNumberOfFreeSlots()+output->getNumberOfUsedSlots();
+        }
+        s.dataSetPool=std::make_unique<DataSetPool>(nSets,(int)s.inputs.size());
       }
+      bcv=s.dataSetPool->getDataSet();
+    }
+    catch(...) {
+      return Thread::CallbackResult::Error;
     }
   }
+
+  // take selected inputs out of inputHeads, keeping their list for reuse
+  s.sliceInputs.clear();
+  s.sliceInputs.swap(minHead.inputs);
+  s.spareInputLists.push_back(std::move(minHead.inputs));
+  s.inputHeads.pop_back();
   
+  // take first block of selected inputs, and put back inputs in inputHeads or empty list
+  for (int i : s.sliceInputs) {
+    DataBlockContainerReference b=nullptr;
+    s.inputs[i]->pop(b);
+    if (!isDropped) {
+      bcv->push_back(std::move(b));
+    }
+    //printf("1 block for event %llu from input %d @ %p\n",(unsigned long long)newId,b);
+    //printf("aggregating %p into dataSet %p\n",b->getData()->data,bcv.get());
+    if (!s.inputs[i]->isEmpty()) {
+      DataBlockId newId=(*s.inputs[i]->frontPtr())->getData()->header.id;
+      s.addInputHead(newId,i);
+    } else {
+      s.emptyInputs.push_back(i);
+    }
+  }
+
+  // update counters
+  if ((s.lastSliceId!=0)&&(minId<=s.lastSliceId)) {
+    s.stats.blocksLate+=s.sliceInputs.size();
+  } else {
+    s.lastSliceId=minId;
+  }
+  if (!allSame) {
+    s.stats.slicesIncomplete++;
+    if ((someEmpty)&&(sliceTimeout>0)) {
+      s.stats.slicesTimeout++;
+    }
+  }
+  if (isDropped) {
+    s.stats.slicesDropped++;
+    return Thread::CallbackResult::Ok;
+  }
+  s.stats.slices++;
+
   //if (!allSame) {printf("!incomplete block pushed\n");}
   // todo: add error check
-  dPtr->output->push(bcv);
+  s.output->push(std::move(bcv));
   
 //  printf("readout output: pushed %llu\n",dPtr->output->getNumberIn());
-  // todo: add timeout for standalone pieces - or wait if some FIFOs empty
   // add flag in output data to say it is incomplete
   //printf("agg: new block\n");
   return Thread::CallbackResult::Ok;
 }
- 
+
+int DataBlockAggregator::mergeOutputs() {
+  // only one thread merges at a time, the others go on with their slices
+  std::unique_lock<std::mutex> lock(mergeLock,std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return 0;
+  }
+  int nMerged=0;
+  while (!output->isFull()) {
+    // select shard output with the lowest slice id
+    AliceO2::Common::Fifo<DataSetReference> *next=nullptr;
+    DataBlockId nextId=0;
+    int someEmpty=0;
+    for (auto &s : shards) {
+      DataSetReference *bc=s->shardOutput->frontPtr();
+      if (bc==nullptr) {
+        someEmpty=1;
+        continue;
+      }
+      DataBlockId id=(*bc)->at(0)->getData()->header.id;
+      if ((next==nullptr)||(id<nextId)) {
+        next=s->shardOutput.get();
+        nextId=id;
+      }
+    }
+    if (next==nullptr) {
+      break;
+    }
+    // when ordered, an empty shard may still provide a lower id: wait for it, up to the slice timeout,
+    // unless this slice follows the last one
+    if ((outputOrder==OutputOrder::Ordered)&&(someEmpty)&&(nextId!=lastMergedId+1)&&(sliceTimeout>0)) {
+      if (!isMergePending) {
+        mergeTimer.reset(sliceTimeout);
+        isMergePending=1;
+      }
+      if (!mergeTimer.isTimeout()) {
+        break;
+      }
+    }
+    isMergePending=0;
+    DataSetReference bc=nullptr;
+    next->pop(bc);
+    output->push(std::move(bc));
+    if ((lastMergedId!=0)&&(nextId<lastMergedId)) {
+      slicesOutOfOrder++;
+    } else {
+      lastMergedId=nextId;
+    }
+    nMerged++;
+  }
+  return nMerged;
+}
+
 void DataBlockAggregator::start() {
-  aggregateThread->start();
+  for (auto &s : shards) {
+    s->thread->start();
+  }
+}
+
+void DataBlockAggregator::setThreadPlacement(const ThreadPlacement &placement) {
+  for (auto &s : shards) {
+    s->thread->setPlacement(placement);
+  }
+}
+
+std::string DataBlockAggregator::getThreadPlacement() {
+  return shards[0]->thread->getPlacement();
+}
+
+void DataBlockAggregator::setThreadIdleBackoff(const ThreadIdleBackoff &backoff) {
+  for (auto &s : shards) {
+    s->thread->setIdleBackoff(backoff);
+  }
+}
+
+int DataBlockAggregator::getNumberOfThreads() {
+  return (int)shards.size();
+}
+
+Thread *DataBlockAggregator::getThread(int index) {
+  return shards[index]->thread.get();
+}
+
+void DataBlockAggregator::setSliceTimeout(int timeout) {
+  sliceTimeout=timeout;
+}
+
+void DataBlockAggregator::setIncompleteSlicePolicy(IncompleteSlicePolicy policy) {
+  incompleteSlicePolicy=policy;
+}
+
+void DataBlockAggregator::setOutputOrder(OutputOrder order) {
+  outputOrder=order;
+}
+
+void DataBlockAggregator::getStats(DataBlockAggregatorStats &stats) {
+  stats=DataBlockAggregatorStats();
+  for (auto &s : shards) {
+    stats.slices+=s->stats.slices;
+    stats.slicesIncomplete+=s->stats.slicesIncomplete;
+    stats.slicesTimeout+=s->stats.slicesTimeout;
+    stats.slicesDropped+=s->stats.slicesDropped;
+    stats.blocksLate+=s->stats.blocksLate;
+  }
+  stats.slicesOutOfOrder=slicesOutOfOrder;
 }
 
 void DataBlockAggregator::stop(int waitStop) {
-  aggregateThread->stop();
+  for (auto &s : shards) {
+    s->thread->stop();
+  }
   if (waitStop) {
-    aggregateThread->join();
+    for (auto &s : shards) {
+      s->thread->join();
+    }
   }
   for (unsigned int i=0; i<inputs.size(); i++) {
 
@@ -124,6 +442,11 @@ void DataBlockAggregator::stop(int waitStop) {
     
     inputs[i]->clear();
   }
+  // inputs are empty: rebuild input heads on next start
+  for (auto &s : shards) {
+    s->clear();
+  }
+  isMergePending=0;
 //  printf("Aggregator FIFO out after clear: %d items\n",output->getNumberOfUsedSlots());
   /* todo: do we really need to clear? should be automatic */
   
@@ -6,30 +6,78 @@
 #include <DataFormat/DataBlock.h>
 #include <DataFormat/DataBlockContainer.h>
 #include <DataFormat/DataSet.h>
+#include <DataFormat/DataSetPool.h>
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 
 using namespace AliceO2::Common;
 
+// counters of aggregator activity
+struct DataBlockAggregatorStats {
+  unsigned long long slices=0; // number of slices output
+  unsigned long long slicesIncomplete=0; // number of slices output with blocks missing from some inputs
+  unsigned long long slicesTimeout=0; // number of incomplete slices output after waiting the slice timeout
+  unsigned long long slicesDropped=0; // number of incomplete slices discarded
+  unsigned long long blocksLate=0; // number of blocks received after a slice with same or higher id was output
+  unsigned long long slicesOutOfOrder=0; // number of slices merged before a slice with lower id, when several threads
+};
+
+struct DataBlockAggregatorShard;
+
 class DataBlockAggregator {
   public:
-  DataBlockAggregator(AliceO2::Common::Fifo<DataSetReference> *output, std::string name="Aggregator");
+  // with several threads, each thread aggregates the slices with id modulo number of threads equal to its index
+  DataBlockAggregator(AliceO2::Common::Fifo<DataSetReference> *output, std::string name="Aggregator", int numberOfThreads=1);
   ~DataBlockAggregator();
   
   int addInput(std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>> input); // add a FIFO to be used as input
   
-  void start(); // starts processing thread
-  void stop(int waitStopped=1);  // stop processing thread (and possibly wait it terminates)
+  void start(); // starts processing threads
+  void stop(int waitStopped=1);  // stop processing threads (and possibly wait they terminate)
+
+  void setThreadPlacement(const ThreadPlacement &placement); // CPU affinity and scheduling of processing threads, to be called before start()
+  std::string getThreadPlacement(); // effective placement of first processing thread, once started
+  void setThreadIdleBackoff(const ThreadIdleBackoff &backoff); // idle behavior of processing threads, to be called before start()
+  int getNumberOfThreads();
+  Thread *getThread(int index=0); // processing thread, e.g. to get its statistics
 
+  // what to do with a slice which does not have a block from each input
+  enum IncompleteSlicePolicy {Send, Drop};
+  void setSliceTimeout(int timeout); // time to wait for missing blocks of a slice when some inputs are empty, in microseconds. 0 to never wait.
+  void setIncompleteSlicePolicy(IncompleteSlicePolicy policy); // to be called before start()
+  // order of slices in output, when several processing threads
+  enum OutputOrder {Ordered, Unordered};
+  void setOutputOrder(OutputOrder order); // to be called before start()
+  void getStats(DataBlockAggregatorStats &stats); // get counters, to be called when processing threads stopped
 
+
+  // one iteration of all processing steps, for all threads
   static Thread::CallbackResult  threadCallback(void *arg);  
  
   private:
   std::vector<std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>> inputs;
   AliceO2::Common::Fifo<DataSetReference> *output;    //todo: unique_ptr
   
-  std::unique_ptr<Thread> aggregateThread;
-  AliceO2::Common::Timer incompletePendingTimer;
-  int isIncompletePending;
+  int sliceTimeout; // time to wait for missing blocks, in microseconds
+  IncompleteSlicePolicy incompleteSlicePolicy;
+  OutputOrder outputOrder;
+
+  // each shard aggregates a partition of slice ids in its own thread.
+  // With a single shard, the shard reads inputs and writes output directly.
+  // Otherwise, each shard also reads a subset of inputs and dispatches their blocks to the shards by id,
+  // and the outputs of shards are merged to the aggregator output by whichever shard thread holds mergeLock.
+  std::vector<std::unique_ptr<DataBlockAggregatorShard>> shards;
+  static Thread::CallbackResult shardCallback(void *arg); // thread loop of a shard, when several shards
+  int dispatchInputs(DataBlockAggregatorShard &shard); // move blocks of the inputs read by shard to the shards they belong to. Returns number of blocks moved.
+  Thread::CallbackResult aggregateSlice(DataBlockAggregatorShard &shard); // output next slice of shard, if any
+  int mergeOutputs(); // move slices from shard outputs to aggregator output. Returns number of slices moved.
+
+  std::mutex mergeLock; // held while merging shard outputs
+  AliceO2::Common::Timer mergeTimer; // time waited for a shard output, when ordered
+  int isMergePending; // set when waiting for a shard output
+  DataBlockId lastMergedId; // id of last slice merged
+  unsigned long long slicesOutOfOrder; // number of slices merged before a slice with lower id
 };
@@ -1,4 +1,9 @@
 #include "ReadoutEquipment.h"
+#include "ReadoutUtils.h"
+
+#include <InfoLogger/InfoLogger.hxx>
+using namespace AliceO2::InfoLogger;
+extern InfoLogger theLog;
 
 
 ReadoutEquipment::ReadoutEquipment(ConfigFile &cfg, std::string cfgEntryPoint) {
@@ -10,37 +15,88 @@ ReadoutEquipment::ReadoutEquipment(ConfigFile &cfg, std::string cfgEntryPoint) {
   //}
 
   
+  ConfigFileSection cfgSection(cfg,cfgEntryPoint);
+
   // by default, name the equipment as the config node entry point
-  cfg.getOptionalValue<std::string>(cfgEntryPoint + ".name", name, cfgEntryPoint);
+  cfgSection.bind<std::string>("name", name, cfgEntryPoint);
 
   // target readout rate in Hz, -1 for unlimited (default)
   cfg.getOptionalValue<double>("readout.rate",readoutRate,-1.0);
 
 
   readoutThread=std::make_unique<Thread>(ReadoutEquipment::threadCallback,this,name,1000);
+  ThreadPlacement placement;
+  getThreadPlacementFromConfig(cfgSection,"thread",placement);
+  readoutThread->setPlacement(placement);
+  idleBackoff.sleepMin=1000;
+  idleBackoff.sleepMax=1000;
+  getThreadIdleBackoffFromConfig(cfgSection,"thread",idleBackoff);
+  readoutThread->setIdleBackoff(idleBackoff);
 
   int outFifoSize=1000;
   
   dataOut=std::make_shared<AliceO2::Common::Fifo<DataBlockContainerReference>>(outFifoSize);
   nBlocksOut=0;
+
+  // containers are created in readout thread and released in consumer thread, use thread cache to recycle them
+  // number of elements should cover the data blocks in flight, heap is used beyond that
+  int containerPoolSize=10000;
+  cfgSection.bind("containerPoolSize", containerPoolSize);
+  containerPool=std::make_unique<MemPool>(containerPoolSize,containerPageSize,64);
+  containerPool->setThreadCacheSize(64);
+
+  // periodic publication of memory usage
+  cfgSection.bind("monitoringEnabled", monitoringEnabled, 0);
+  if (monitoringEnabled) {
+    cfgSection.bind("monitoringUpdatePeriod", monitoringUpdatePeriod, 10);
+    std::string configFile;
+    cfgSection.bind("monitoringConfig", configFile, std::string(""));
+    if (configFile.length()==0) {
+      throw std::string("Equipment " + name + " : monitoringConfig not defined");
+    }
+    theLog.log("Equipment %s : monitoring enabled - period %ds - using configuration %s",name.c_str(),monitoringUpdatePeriod,configFile.c_str());
+    monitoringCollector=AliceO2::Monitoring::MonitoringFactory::Create(configFile);
+  }
 }
 
 const std::string & ReadoutEquipment::getName() {
   return name;
 }
 
+void ReadoutEquipment::setExecutor(Executor *e) {
+  executor=e;
+}
+
 void ReadoutEquipment::start() {
-  readoutThread->start();
+  if (executor!=nullptr) {
+    executorTaskId=executor->addTask(ReadoutEquipment::threadCallback,this,name,idleBackoff);
+    theLog.log("Equipment %s : readout loop on executor",name.c_str());
+  } else {
+    readoutThread->start();
+    theLog.log("Equipment %s : readout thread on %s",name.c_str(),readoutThread->getPlacement().c_str());
+  }
   if (readoutRate>0) {
     clk.reset(1000000.0/readoutRate);
   }
   clk0.reset();
+  if (monitoringEnabled) {
+    monitoringTimer.reset(monitoringUpdatePeriod*1000000);
+  }
 }
 
 void ReadoutEquipment::stop() {
+  if (executor!=nullptr) {
+    ThreadStats stats;
+    executor->getTaskStats(executorTaskId,stats);
+    executor->removeTask(executorTaskId);
+    executorTaskId=-1;
+    theLog.log("Equipment %s : readout loop %s",name.c_str(),getThreadStatsDescription(stats).c_str());
+    return;
+  }
   readoutThread->stop();
   //printf("%llu blocks in %.3lf seconds => %.1lf block/s\n",nBlocksOut,clk0.getTimer(),nBlocksOut/clk0.getTime());
   readoutThread->join();
+  theLog.log("Equipment %s : readout thread %s",name.c_str(),getThreadStatsDescription(*readoutThread).c_str());
 }
 
 ReadoutEquipment::~ReadoutEquipment() {
@@ -50,6 +106,32 @@ ReadoutEquipment::~ReadoutEquipment() {
 
 
 
+void ReadoutEquipment::publishMemoryStats(AliceO2::Monitoring::Collector *collector) {
+  publishMemPoolStats(collector,"readout." + name + ".containerPool",containerPool.get());
+}
+
+void ReadoutEquipment::publishThreadStats(AliceO2::Monitoring::Collector *collector) {
+  ThreadStats stats;
+  if (executor!=nullptr) {
+    executor->getTaskStats(executorTaskId,stats);
+  } else {
+    readoutThread->getStats(stats);
+  }
+  collector->send(stats.busyTime, "readout." + name + ".threadBusyTime");
+  collector->send(stats.idleTime, "readout." + name + ".threadIdleTime");
+}
+
+void ReadoutEquipment::publishMemPoolStats(AliceO2::Monitoring::Collector *collector, std::string const &metricPrefix, MemPool *pool) {
+  MemPoolStats stats;
+  pool->getStats(stats);
+  collector->send(stats.numberOfPages, metricPrefix + ".pagesTotal");
+  collector->send(stats.pagesInUse, metricPrefix + ".pagesInUse");
+  collector->send(stats.pagesInUseMax, metricPrefix + ".pagesInUseMax");
+  collector->send((uint64_t)stats.failedGets, metricPrefix + ".failedGets");
+  collector->send(stats.waitTime, metricPrefix + ".waitTime");
+}
+
+
 DataBlockContainerReference ReadoutEquipment::getBlock() {
   DataBlockContainerReference b=nullptr;
   dataOut->pop(b);
@@ -61,6 +143,14 @@ Thread::CallbackResult  ReadoutEquipment::threadCallback(void *arg) {
   //printf("cb = %p\n",arg);
   //return TTHREAD_LOOP_CB_IDLE;
   
+  if (ptr->monitoringEnabled) {
+    if (ptr->monitoringTimer.isTimeoutCoarse()) {
+      ptr->publishMemoryStats(ptr->monitoringCollector.get());
+      ptr->publishThreadStats(ptr->monitoringCollector.get());
+      ptr->monitoringTimer.increment();
+    }
+  }
+
   // todo: check rate reached
     
   if (ptr->readoutRate>0) {
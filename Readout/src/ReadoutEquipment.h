@@ -1,14 +1,18 @@
 #include <Common/Configuration.h>
+#include <Common/Executor.h>
 #include <Common/Fifo.h>
 #include <Common/Thread.h>
 #include <Common/Timer.h>
 
 #include <DataFormat/DataBlock.h>
 #include <DataFormat/DataBlockContainer.h>
+#include <DataFormat/MemPoolAllocator.h>
 #include <DataFormat/DataSet.h>
 
 #include <memory>
 
+#include <Monitoring/MonitoringFactory.h>
+
 
 using namespace AliceO2::Common;
 
@@ -23,12 +27,19 @@ class ReadoutEquipment {
   void stop();
   const std::string & getName();
 
+  static const int containerPageSize=256; // size of containerPool pages. Containers bigger than that (with their reference counter) are allocated from heap.
+
+  void setExecutor(Executor *executor); // run readout loop as a task of given executor, instead of a dedicated thread. To be called before start().
+
 //  protected: 
 // todo: give direct access to output FIFO?
   std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>> dataOut;
 
   private:
   std::unique_ptr<Thread> readoutThread;  
+  ThreadIdleBackoff idleBackoff; // behavior of readout loop when idle
+  Executor *executor=nullptr; // when set, readout loop runs in this executor instead of readoutThread
+  int executorTaskId=-1; // id of readout loop task in executor
   static Thread::CallbackResult  threadCallback(void *arg);
   virtual Thread::CallbackResult  populateFifoOut()=0;  // function called iteratively in dedicated thread to populate FIFO
   AliceO2::Common::Timer clk;
@@ -36,8 +47,19 @@ class ReadoutEquipment {
   
   unsigned long long nBlocksOut;
   double readoutRate;
+
+  int monitoringEnabled;
+  int monitoringUpdatePeriod;
+  std::unique_ptr<AliceO2::Monitoring::Collector> monitoringCollector;
+  AliceO2::Common::Timer monitoringTimer;
+  void publishThreadStats(AliceO2::Monitoring::Collector *collector); // publish readout thread busy/idle time, when monitoring enabled
+
   protected:
+  virtual void publishMemoryStats(AliceO2::Monitoring::Collector *collector); // function called periodically in readout thread to publish memory usage, when monitoring enabled
+  void publishMemPoolStats(AliceO2::Monitoring::Collector *collector, std::string const &metricPrefix, MemPool *pool); // publish statistics of given mempool
+
   std::string name;
+  std::unique_ptr<MemPool> containerPool; // memory for data block containers (and their reference counter), see makeSharedFromMemPool(). Containers must be released before the equipment is destroyed.
 };
 
 
@@ -1,5 +1,13 @@
 #include "ReadoutEquipment.h"
 
+#include <InfoLogger/InfoLogger.hxx>
+using namespace AliceO2::InfoLogger;
+extern InfoLogger theLog;
+
+// containers are allocated in pages of the equipment container pool
+static_assert(sizeof(DataBlockContainerFromMemPool)+memPoolSharedOverhead<=ReadoutEquipment::containerPageSize,"DataBlockContainerFromMemPool does not fit in a container page");
+static_assert(sizeof(DataBlockContainerFromMemPoolSubAllocator)+memPoolSharedOverhead<=ReadoutEquipment::containerPageSize,"DataBlockContainerFromMemPoolSubAllocator does not fit in a container page");
+
 
 class ReadoutEquipmentDummy : public ReadoutEquipment {
 
@@ -9,10 +17,13 @@ class ReadoutEquipmentDummy : public ReadoutEquipment {
   
   private:
     std::shared_ptr<MemPool> mp;
+    std::shared_ptr<MemPoolSubAllocator> mpa; // when set, blocks are packed in mempool pages
     Thread::CallbackResult  populateFifoOut();
+    void publishMemoryStats(AliceO2::Monitoring::Collector *collector);
     DataBlockId currentId;
     int eventMaxSize;
     int eventMinSize;    
+    int memPoolGetTimeout; // time to wait for a free page when pool exhausted, in microseconds
 };
 
 
@@ -20,32 +31,100 @@ ReadoutEquipmentDummy::ReadoutEquipmentDummy(ConfigFile &cfg, std::string cfgEnt
 
   int memPoolNumberOfElements=10000;
   int memPoolElementSize=0.01*1024*1024;
+  int memPoolThreadCacheSize=0;
+  int memPoolPackBlocks=0;
+  std::string memPoolStorage="malloc";
+  MemPoolOptions memPoolOptions;
+
+  ConfigFileSection cfgSection(cfg,cfgEntryPoint);
+  cfgSection.bind("memPoolNumberOfElements", memPoolNumberOfElements)
+    .bind("memPoolElementSize", memPoolElementSize)
+    .bind("memPoolThreadCacheSize", memPoolThreadCacheSize)
+    .bind("memPoolPackBlocks", memPoolPackBlocks)
+    .bind("memPoolStorage", memPoolStorage)
+    .bind("memPoolHugeTlbFsPath", memPoolOptions.hugeTlbFsPath, "/var/lib/hugetlbfs/global/pagesize-2MB/readout." + name)
+    .bind("memPoolSharedMemoryName", memPoolOptions.sharedMemoryName, "/readout." + name)
+    .bind("memPoolNumaNode", memPoolOptions.numaNode)
+    .bind("memPoolPrefault", memPoolOptions.prefault)
+    .bind("memPoolPrefaultThreads", memPoolOptions.prefaultThreads)
+    .bind("memPoolLockMemory", memPoolOptions.lockMemory)
+    .bind("memPoolGetTimeout", memPoolGetTimeout, 0)
+    .bind("eventMaxSize", eventMaxSize, 1024)
+    .bind("eventMinSize", eventMinSize, 1024);
+
+  if (!memPoolStorage.compare("malloc")) {
+    memPoolOptions.storage=MemPoolStorage::Malloc;
+  } else if (!memPoolStorage.compare("hugepage2M")) {
+    memPoolOptions.storage=MemPoolStorage::HugePage2M;
+  } else if (!memPoolStorage.compare("hugepage1G")) {
+    memPoolOptions.storage=MemPoolStorage::HugePage1G;
+  } else if (!memPoolStorage.compare("hugetlbfs")) {
+    memPoolOptions.storage=MemPoolStorage::HugeTlbFs;
+  } else if (!memPoolStorage.compare("sharedMemory")) {
+    memPoolOptions.storage=MemPoolStorage::SharedMemory;
+  } else {
+    throw std::string("Unknown memPoolStorage " + memPoolStorage);
+  }
 
-  cfg.getOptionalValue<int>(cfgEntryPoint + ".memPoolNumberOfElements", memPoolNumberOfElements);
-  cfg.getOptionalValue<int>(cfgEntryPoint + ".memPoolElementSize", memPoolElementSize);
-
-  mp=std::make_shared<MemPool>(memPoolNumberOfElements,memPoolElementSize);
+  mp=std::make_shared<MemPool>(memPoolNumberOfElements,memPoolElementSize,memPoolOptions);
+  theLog.log("Equipment %s : mempool %d pages x %d bytes using %s, created in %.3f s",name.c_str(),memPoolNumberOfElements,memPoolElementSize,mp->getStorageDescription().c_str(),mp->getSetupTime());
+  if (memPoolThreadCacheSize>0) {
+    mp->setThreadCacheSize(memPoolThreadCacheSize);
+  }
+  if (memPoolPackBlocks) {
+    mpa=std::make_shared<MemPoolSubAllocator>(mp);
+    theLog.log("Equipment %s : blocks packed in mempool pages, max %d bytes per block",name.c_str(),mpa->getMaxBlockSize());
+  }
   currentId=0;
-  
-  cfg.getOptionalValue<int>(cfgEntryPoint + ".eventMaxSize", eventMaxSize, (int)1024);
-  cfg.getOptionalValue<int>(cfgEntryPoint + ".eventMinSize", eventMinSize, (int)1024);
 }
 
 ReadoutEquipmentDummy::~ReadoutEquipmentDummy() {
+  unsigned long long getHits,getMisses,releaseHits,releaseMisses;
+  mp->getThreadCacheStats(getHits,getMisses,releaseHits,releaseMisses);
+  if (getHits+getMisses+releaseHits+releaseMisses>0) {
+    theLog.log("Equipment %s : mempool thread cache hit rate %.1f%% get, %.1f%% release",name.c_str(),
+      (getHits+getMisses) ? getHits*100.0/(getHits+getMisses) : 0.0,
+      (releaseHits+releaseMisses) ? releaseHits*100.0/(releaseHits+releaseMisses) : 0.0);
+  }
+  MemPoolStats stats;
+  mp->getStats(stats);
+  theLog.log("Equipment %s : mempool max %d/%d pages used, %llu failed requests",name.c_str(),stats.pagesInUseMax,stats.numberOfPages,stats.failedGets);
+  if (stats.numberOfWaits>0) {
+    theLog.log("Equipment %s : waited %llu times for a free page, total %.3f s",name.c_str(),stats.numberOfWaits,stats.waitTime);
+  }
+
+  // release current page of allocator, if any
+  mpa=nullptr;
   // check if mempool still referenced
   if (!mp.unique()) {
     printf("Warning: mempool still %d references\n",(int)mp.use_count());
   }
 } 
 
+void ReadoutEquipmentDummy::publishMemoryStats(AliceO2::Monitoring::Collector *collector) {
+  ReadoutEquipment::publishMemoryStats(collector);
+  publishMemPoolStats(collector,"readout." + name + ".memPool",mp.get());
+}
+
 Thread::CallbackResult  ReadoutEquipmentDummy::populateFifoOut() {
   if (dataOut->isFull()) {
     return Thread::CallbackResult::Idle;
   }
 
+  int dSize=(int)(eventMinSize+(int)((eventMaxSize-eventMinSize)*(rand()*1.0/RAND_MAX)));
+
   DataBlockContainerReference d=NULL;
   try {
-    d=std::make_shared<DataBlockContainerFromMemPool>(mp);
+    if (mpa!=nullptr) {
+      // allocate only the space needed for this block
+      int maxDataSize=mpa->getMaxBlockSize()-(int)sizeof(DataBlock);
+      if (dSize>maxDataSize) {
+        dSize=maxDataSize;
+      }
+      d=makeSharedFromMemPool<DataBlockContainerFromMemPoolSubAllocator>(containerPool.get(),mpa,(int)sizeof(DataBlock)+dSize,memPoolGetTimeout);
+    } else {
+      d=makeSharedFromMemPool<DataBlockContainerFromMemPool>(containerPool.get(),mp,nullptr,memPoolGetTimeout);
+    }
   }
   catch (...) {
   //printf("full\n");
@@ -59,8 +138,6 @@ Thread::CallbackResult  ReadoutEquipmentDummy::populateFifoOut() {
   
   DataBlock *b=d->getData();
   
-  int dSize=(int)(eventMinSize+(int)((eventMaxSize-eventMinSize)*(rand()*1.0/RAND_MAX)));
-  
   
   //dSize=100;
   //printf("%d\n",dSize);
@@ -82,7 +159,7 @@ Thread::CallbackResult  ReadoutEquipmentDummy::populateFifoOut() {
   
   
  
-  for (int k=0;k<100;k++) {
+  for (int k=0;(k<100)&&(k<dSize);k++) {
     //printf("[%d]=%p\n",k,&(b->data[k]));
     b->data[k]=(char)k;
   }
@@ -92,7 +169,7 @@ Thread::CallbackResult  ReadoutEquipmentDummy::populateFifoOut() {
   //usleep(10000);
   
   // push new page to mem
-  dataOut->push(d); 
+  dataOut->push(std::move(d));
 
 //  printf("readout dummy loop FIFO out= %d items\n",dataOut->getNumberOfUsedSlots());
 
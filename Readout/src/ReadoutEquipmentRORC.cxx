@@ -8,6 +8,8 @@
 
 #include <string>
 
+#include <Common/FifoMPSC.h>
+
 
 #include <InfoLogger/InfoLogger.hxx>
 using namespace AliceO2::InfoLogger;
@@ -19,9 +21,10 @@ class ReadoutMemoryHandler {
   public:
   size_t memorySize;  // total size of buffer
   int pageSize;       // size of each superpage in buffer (not the one of getpagesize())
+  int numberOfPages;  // number of superpages in buffer
   uint8_t * baseAddress; // base address of buffer
 
-  std::unique_ptr<AliceO2::Common::Fifo<long>> pagesAvailable;  // a buffer to keep track of individual pages. storing offset (with respect to base address) of pages available
+  std::unique_ptr<AliceO2::Common::FifoMPSC<long>> pagesAvailable;  // a buffer to keep track of individual pages. storing offset (with respect to base address) of pages available. Pages are given back by any thread releasing them.
   
   private:
   std::unique_ptr<AliceO2::roc::MemoryMappedFile> mMemoryMappedFile;
@@ -69,8 +72,9 @@ class ReadoutMemoryHandler {
     
     pageSize=vPageSize;
     int nPages=memorySize/pageSize;
+    numberOfPages=nPages;
     theLog.log("Got %d pages, each %d bytes",nPages,pageSize);       
-    pagesAvailable=std::make_unique<AliceO2::Common::Fifo<long>>(nPages);
+    pagesAvailable=std::make_unique<AliceO2::Common::FifoMPSC<long>>(nPages);
     
     for (int i=0;i<nPages;i++) {
       long offset=i*pageSize;
@@ -95,6 +99,7 @@ class DataBlockContainerFromRORC : public DataBlockContainer {
   AliceO2::roc::ChannelFactory::DmaChannelSharedPtr mChannel;
   AliceO2::roc::Superpage mSuperpage;
   std::shared_ptr<ReadoutMemoryHandler> mReadoutMemoryHandler;  // todo: store this in superpage user data
+  DataBlock mDataBlock; // block header, stored in container to avoid a separate allocation
   
   public:
   DataBlockContainerFromRORC(AliceO2::roc::ChannelFactory::DmaChannelSharedPtr channel, AliceO2::roc::Superpage  const & superpage, std::shared_ptr<ReadoutMemoryHandler> const & h) {
@@ -103,12 +108,7 @@ class DataBlockContainerFromRORC : public DataBlockContainer {
     mChannel=channel;
     mReadoutMemoryHandler=h;
 
-    data=nullptr;
-    try {
-       data=new DataBlock;
-    } catch (...) {
-      throw __LINE__;
-    }   
+    data=&mDataBlock;
 
 
     data->header.blockType=DataBlockType::H_BASE;
@@ -131,17 +131,16 @@ class DataBlockContainerFromRORC : public DataBlockContainer {
   }
   
   ~DataBlockContainerFromRORC() {
-    // todo: add lock
     // if constructor fails, do we make page available again or leave it to caller?
     mReadoutMemoryHandler->pagesAvailable->push(mSuperpage.getOffset());
     
     //printf("released superpage %ld\n",mSuperpage.getOffset());
-    if (data!=nullptr) {
-      delete data;
-    }
   }
 };
 
+// containers are allocated in pages of the equipment container pool
+static_assert(sizeof(DataBlockContainerFromRORC)+memPoolSharedOverhead<=ReadoutEquipment::containerPageSize,"DataBlockContainerFromRORC does not fit in a container page");
+
 
 
 
@@ -163,6 +162,7 @@ class ReadoutEquipmentRORC : public ReadoutEquipment {
   
   private:
     Thread::CallbackResult  populateFifoOut();
+    void publishMemoryStats(AliceO2::Monitoring::Collector *collector);
     DataBlockId currentId;
     AliceO2::roc::ChannelFactory::DmaChannelSharedPtr channel;
     std::shared_ptr<ReadoutMemoryHandler> mReadoutMemoryHandler;
@@ -170,6 +170,7 @@ class ReadoutEquipmentRORC : public ReadoutEquipment {
     
     int pageCount=0;
     int isInitialized=0;
+    int superpagesAvailableMin=-1; // minimum number of superpages available for the driver
 
     unsigned long long loopCount;
 };
@@ -242,6 +243,9 @@ ReadoutEquipmentRORC::~ReadoutEquipmentRORC() {
   }
 
   theLog.log("Equipment %s : %d pages read",name.c_str(),(int)pageCount);
+  if (isInitialized) {
+    theLog.log("Equipment %s : min %d/%d superpages available",name.c_str(),superpagesAvailableMin,mReadoutMemoryHandler->numberOfPages);
+  }
   theLog.log("Equipment %s : %llu loop count",name.c_str(),loopCount);
 }
 
@@ -277,6 +281,10 @@ Thread::CallbackResult  ReadoutEquipmentRORC::populateFifoOut() {
       break;
     }
   }
+  int superpagesAvailable=mReadoutMemoryHandler->pagesAvailable->getNumberOfUsedSlots();
+  if ((superpagesAvailableMin<0)||(superpagesAvailable<superpagesAvailableMin)) {
+    superpagesAvailableMin=superpagesAvailable;
+  }
     
   // check for completed pages
   while ((!dataOut->isFull()) && (channel->getReadyQueueSize()>0)) {
@@ -284,14 +292,13 @@ Thread::CallbackResult  ReadoutEquipmentRORC::populateFifoOut() {
     if (superpage.isFilled()) {
       std::shared_ptr<DataBlockContainerFromRORC>d=nullptr;
       try {
-        d=std::make_shared<DataBlockContainerFromRORC>(channel, superpage, mReadoutMemoryHandler);
+        d=makeSharedFromMemPool<DataBlockContainerFromRORC>(containerPool.get(), channel, superpage, mReadoutMemoryHandler);
       }
       catch (...) {
         break;
       }
       channel->popSuperpage();
-      dataOut->push(d); 
-      //d=nullptr;
+      dataOut->push(std::move(d));
       
       pageCount++;
       //printf("read page %ld - %d\n",superpage.getOffset(),d.use_count());
@@ -311,6 +318,17 @@ Thread::CallbackResult  ReadoutEquipmentRORC::populateFifoOut() {
 
 
 
+void ReadoutEquipmentRORC::publishMemoryStats(AliceO2::Monitoring::Collector *collector) {
+  ReadoutEquipment::publishMemoryStats(collector);
+  if (!isInitialized) {
+    return;
+  }
+  collector->send(mReadoutMemoryHandler->numberOfPages, "readout." + name + ".superpagesTotal");
+  collector->send(mReadoutMemoryHandler->pagesAvailable->getNumberOfUsedSlots(), "readout." + name + ".superpagesAvailable");
+  collector->send(superpagesAvailableMin, "readout." + name + ".superpagesAvailableMin");
+}
+
+
 std::unique_ptr<ReadoutEquipment> getReadoutEquipmentRORC(ConfigFile &cfg, std::string cfgEntryPoint) {
   return std::make_unique<ReadoutEquipmentRORC>(cfg,cfgEntryPoint);
 }
@@ -0,0 +1,45 @@
+#ifndef READOUT_UTILS
+#define READOUT_UTILS
+
+#include <Common/Configuration.h>
+#include <Common/Thread.h>
+
+#include <string>
+#include <stdio.h>
+
+
+// read thread placement parameters from a configuration section, with keys [keyPrefix]Cpus, [keyPrefix]NumaNode, [keyPrefix]RealtimePriority, [keyPrefix]RealtimeRoundRobin
+// e.g. keyPrefix="thread" in section "equipment-1"
+inline void getThreadPlacementFromConfig(ConfigFileSection &cfg, const std::string &keyPrefix, AliceO2::Common::ThreadPlacement &placement) {
+  cfg.bind(keyPrefix + "Cpus", placement.cpus, std::string(""));
+  cfg.bind(keyPrefix + "NumaNode", placement.numaNode, -1);
+  cfg.bind(keyPrefix + "RealtimePriority", placement.realtimePriority, 0);
+  cfg.bind(keyPrefix + "RealtimeRoundRobin", placement.realtimeRoundRobin, 0);
+}
+
+
+// read idle backoff parameters of a thread from a configuration section, with keys [keyPrefix]IdleSpinCount, [keyPrefix]IdleYieldCount, [keyPrefix]IdleSleepMin, [keyPrefix]IdleSleepMax
+// values not defined are left unchanged
+inline void getThreadIdleBackoffFromConfig(ConfigFileSection &cfg, const std::string &keyPrefix, AliceO2::Common::ThreadIdleBackoff &backoff) {
+  cfg.bind(keyPrefix + "IdleSpinCount", backoff.spinCount);
+  cfg.bind(keyPrefix + "IdleYieldCount", backoff.yieldCount);
+  cfg.bind(keyPrefix + "IdleSleepMin", backoff.sleepMin);
+  cfg.bind(keyPrefix + "IdleSleepMax", backoff.sleepMax);
+}
+
+// describe thread activity, e.g. for final log
+inline std::string getThreadStatsDescription(const AliceO2::Common::ThreadStats &stats) {
+  double totalTime=stats.busyTime+stats.idleTime;
+  char buffer[256];
+  snprintf(buffer,sizeof(buffer),"busy %.1f%% of %.1f s - %llu busy / %llu idle iterations",
+    (totalTime>0) ? stats.busyTime*100.0/totalTime : 0.0,totalTime,stats.busyIterations,stats.idleIterations);
+  return buffer;
+}
+
+inline std::string getThreadStatsDescription(AliceO2::Common::Thread &thread) {
+  AliceO2::Common::ThreadStats stats;
+  thread.getStats(stats);
+  return getThreadStatsDescription(stats);
+}
+
+#endif
@@ -23,6 +23,7 @@
   
 #include <Common/Timer.h>
 #include <Common/Fifo.h>
+#include <Common/Executor.h>
 #include <Common/Thread.h>
 
 #ifdef WITH_DATASAMPLING
@@ -33,6 +34,7 @@
 #include "ReadoutEquipment.h"
 #include "DataBlockAggregator.h"
 #include "Consumer.h"
+#include "ReadoutUtils.h"
 
 
 using namespace AliceO2::InfoLogger;
@@ -151,18 +153,66 @@ int main(int argc, char* argv[])
     }   
   }
 
+  // optionally, run equipment readout loops on a pool of threads instead of one thread each
+  int cfgExecutorThreads=0;
+  cfg.getOptionalValue<int>("readout.executorThreads",cfgExecutorThreads);
+  std::unique_ptr<AliceO2::Common::Executor> equipmentExecutor=nullptr;
+  if (cfgExecutorThreads>0) {
+    equipmentExecutor=std::make_unique<AliceO2::Common::Executor>(cfgExecutorThreads,"readout");
+    std::string cfgExecutorCpus="";
+    cfg.getOptionalValue<std::string>("readout.executorCpus",cfgExecutorCpus);
+    if (cfgExecutorCpus.length()>0) {
+      if (equipmentExecutor->pinWorkers(cfgExecutorCpus)) {
+        theLog.log("Invalid CPU list for executor: %s",cfgExecutorCpus.c_str());
+      }
+    }
+    for (auto && readoutDevice : readoutDevices) {
+      readoutDevice->setExecutor(equipmentExecutor.get());
+    }
+    theLog.log("Equipments running on executor with %d threads",cfgExecutorThreads);
+  }
+
 
   // aggregator
   theLog.log("Creating aggregator");
   AliceO2::Common::Fifo<DataSetReference> agg_output(1000);
+  agg_output.enableBlockingWait(); // main loop sleeps until aggregator output available
   int nEquipmentsAggregated=0;
-  DataBlockAggregator agg(&agg_output,"Aggregator");
+  int cfgAggregatorThreads=1;
+  cfg.getOptionalValue<int>("readout.aggregatorThreads",cfgAggregatorThreads);
+  DataBlockAggregator agg(&agg_output,"Aggregator",cfgAggregatorThreads);
   for (auto && readoutDevice : readoutDevices) {
       //theLog.log("Adding equipment: %s",readoutDevice->getName().c_str());
       agg.addInput(readoutDevice->dataOut);
       nEquipmentsAggregated++;
   }
-  theLog.log("Aggregator: %d equipments", nEquipmentsAggregated);
+  theLog.log("Aggregator: %d equipments, %d threads", nEquipmentsAggregated, agg.getNumberOfThreads());
+  ConfigFileSection cfgReadout(cfg,"readout");
+  ThreadPlacement aggregatorPlacement;
+  getThreadPlacementFromConfig(cfgReadout,"aggregatorThread",aggregatorPlacement);
+  agg.setThreadPlacement(aggregatorPlacement);
+  ThreadIdleBackoff aggregatorBackoff;
+  aggregatorBackoff.sleepMin=100;
+  aggregatorBackoff.sleepMax=100;
+  getThreadIdleBackoffFromConfig(cfgReadout,"aggregatorThread",aggregatorBackoff);
+  agg.setThreadIdleBackoff(aggregatorBackoff);
+  int cfgSliceTimeout=500;
+  cfg.getOptionalValue<int>("readout.aggregatorSliceTimeout",cfgSliceTimeout);
+  agg.setSliceTimeout(cfgSliceTimeout*1000);
+  std::string cfgIncompleteSlices="send";
+  cfg.getOptionalValue<std::string>("readout.aggregatorIncompleteSlices",cfgIncompleteSlices);
+  if (cfgIncompleteSlices=="drop") {
+    agg.setIncompleteSlicePolicy(DataBlockAggregator::IncompleteSlicePolicy::Drop);
+  } else if (cfgIncompleteSlices!="send") {
+    theLog.log("Invalid aggregatorIncompleteSlices %s, using send",cfgIncompleteSlices.c_str());
+  }
+  std::string cfgOutputOrder="ordered";
+  cfg.getOptionalValue<std::string>("readout.aggregatorOutputOrder",cfgOutputOrder);
+  if (cfgOutputOrder=="unordered") {
+    agg.setOutputOrder(DataBlockAggregator::OutputOrder::Unordered);
+  } else if (cfgOutputOrder!="ordered") {
+    theLog.log("Invalid aggregatorOutputOrder %s, using ordered",cfgOutputOrder.c_str());
+  }
 
 
   // configuration of data sampling
@@ -190,11 +240,7 @@ int main(int argc, char* argv[])
 
     // skip disabled
     int enabled=1;
-    try {
-      enabled=cfg.getValue<int>(kName + ".enabled");
-    }
-    catch (...) {
-    }
+    cfg.getOptionalValue<int>(kName + ".enabled",enabled);
     if (!enabled) {continue;}
 
     // instanciate consumer of appropriate type         
@@ -216,14 +262,27 @@ int main(int argc, char* argv[])
         newConsumer=getUniqueConsumerFileRecorder(cfg, kName);
       } else if (!cfgType.compare("checker")) {
         newConsumer=getUniqueConsumerDataChecker(cfg, kName);
+      } else if (!cfgType.compare("sharedMemory")) {
+        newConsumer=getUniqueConsumerSharedMemory(cfg, kName);
       } else {
         theLog.log("Unknown consumer type '%s' for [%s]",cfgType.c_str(),kName.c_str());
       }
+
+      // optionally, run consumer in its own thread
+      int cfgThreadEnabled=0;
+      cfg.getOptionalValue<int>(kName + ".threadEnabled",cfgThreadEnabled);
+      if ((cfgThreadEnabled)&&(newConsumer!=nullptr)) {
+        newConsumer=getUniqueConsumerThread(cfg, kName, std::move(newConsumer));
+      }
     } 
     catch (const std::exception& ex) {
         theLog.log("Failed to configure consumer %s : %s",kName.c_str(), ex.what());
         continue;
     } 
+    catch (std::string errMsg) {
+        theLog.log("Failed to configure consumer %s : %s",kName.c_str(),errMsg.c_str());
+        continue;
+    }
     catch (...) {
         theLog.log("Failed to configure consumer %s",kName.c_str());
         continue;
@@ -238,8 +297,15 @@ int main(int argc, char* argv[])
 
   theLog.log("Starting aggregator");
   agg.start();
+  theLog.log("Aggregator thread on %s",agg.getThreadPlacement().c_str());
   
   theLog.log("Starting readout equipments");
+  if (equipmentExecutor!=nullptr) {
+    equipmentExecutor->start();
+    for (int i=0;i<equipmentExecutor->getNumberOfWorkers();i++) {
+      theLog.log("Executor thread %d on %s",i,equipmentExecutor->getWorkerPlacement(i).c_str());
+    }
+  }
   for (auto && readoutDevice : readoutDevices) {
       readoutDevice->start();
   }
@@ -275,6 +341,9 @@ int main(int argc, char* argv[])
         for (auto && readoutDevice : readoutDevices) {
           readoutDevice->stop();
         }
+        if (equipmentExecutor!=nullptr) {
+          equipmentExecutor->stop();
+        }
         theLog.log("Readout stopped");
         t.reset(1000000);  // add a delay before stopping aggregator - continune to empty FIFOs
       }
@@ -284,8 +353,9 @@ int main(int argc, char* argv[])
       }
     }
 
+    // wait for data, but come back regularly to check for timeout
     DataSetReference bc=nullptr;
-    agg_output.pop(bc);    
+    agg_output.pop(bc,1000);
     
 
     if (bc!=nullptr) {
@@ -306,7 +376,7 @@ int main(int argc, char* argv[])
         printf("pop %d\n",i);
         printf("%p : %d use count\n",(void *)bc->at(i).get(), (int)bc->at(i).use_count());
 */
-        DataBlockContainerReference b=bc->at(i);
+        DataBlockContainerReference &b=bc->at(i);
 
 /*
         nBlocks++;
@@ -330,14 +400,19 @@ int main(int argc, char* argv[])
       }
       // todo: check if following needed or not... in principle not as it is a shared_ptr
       // delete bc;
-    } else {
-      usleep(1000);
     }
 
   }
 
   theLog.log("Stopping aggregator");
   agg.stop();
+  for (int i=0;i<agg.getNumberOfThreads();i++) {
+    theLog.log("Aggregator thread %d %s",i,getThreadStatsDescription(*agg.getThread(i)).c_str());
+  }
+  DataBlockAggregatorStats aggregatorStats;
+  agg.getStats(aggregatorStats);
+  theLog.log("Aggregator: %llu slices, %llu incomplete (%llu after timeout), %llu dropped, %llu late blocks, %llu out of order",
+    aggregatorStats.slices,aggregatorStats.slicesIncomplete,aggregatorStats.slicesTimeout,aggregatorStats.slicesDropped,aggregatorStats.blocksLate,aggregatorStats.slicesOutOfOrder);
 
 
 //  t1=t0.getTime();
@@ -362,18 +437,20 @@ int main(int argc, char* argv[])
 
 //  printf("agg: in=%llu  out=%llu\n",agg_output.getNumberIn(),agg_output.getNumberOut());
 
-  theLog.log("Closing readout devices");
-  for (size_t i = 0, size = readoutDevices.size(); i != size; ++i) {
-    readoutDevices[i]=nullptr;  // effectively deletes the device
-  }
-  readoutDevices.clear(); // to do it all in one go
-
 #ifdef WITH_DATASAMPLING
+  // samples may still reference data blocks
   if(dataSamplingInjector) {
     delete dataSamplingInjector;
   }
 #endif
 
+  // all data block containers are released: equipments (owner of container and data memory) can be closed
+  theLog.log("Closing readout devices");
+  for (size_t i = 0, size = readoutDevices.size(); i != size; ++i) {
+    readoutDevices[i]=nullptr;  // effectively deletes the device
+  }
+  readoutDevices.clear(); // to do it all in one go
+
 /*
   theLog.log("%llu blocks in %.3lf seconds => %.1lf block/s",nBlocks,t1,nBlocks/t1);
   theLog.log("%.1lf MB received",nBytes/(1024.0*1024.0));
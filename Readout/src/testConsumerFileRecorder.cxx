@@ -0,0 +1,333 @@
+// test of ConsumerFileRecorder
+// blocks of various sizes are recorded to a temporary directory, and files are read back and compared to the blocks sent:
+// single file, rotation by size and by time, striping to several directories with index, and write errors
+
+#include "Consumer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+
+// container with block header and payload stored inside
+class DataBlockContainerTest : public DataBlockContainer {
+  public:
+  DataBlockContainerTest(DataBlockId id, int size) {
+    memset(&block,0,sizeof(block)); // header padding is recorded too
+    block.header.blockType=DataBlockType::H_BASE;
+    block.header.headerSize=sizeof(DataBlockHeaderBase);
+    block.header.dataSize=size;
+    block.header.id=id;
+    payload.resize(size);
+    for (int i=0;i<size;i++) {
+      payload[i]=(char)(id*7+i);
+    }
+    block.data=payload.data();
+    data=&block;
+  }
+  private:
+  DataBlock block;
+  std::vector<char> payload;
+};
+
+
+// index file entry, as documented in configDummy.cfg
+struct IndexEntry {
+  uint64_t blockId;
+  uint64_t offset;
+  uint32_t size;
+  int32_t stream;
+  int32_t fileIndex;
+  int32_t reserved;
+};
+
+
+// bytes recorded for a block: header followed by payload
+static std::string getBlockBytes(const DataBlockContainerReference &b) {
+  DataBlock *d=b->getData();
+  return std::string((char *)&d->header,d->header.headerSize) + std::string(d->data,d->header.dataSize);
+}
+
+// read whole file. Returns 0 on success.
+static int readFile(const std::string &path, std::string &content) {
+  content.clear();
+  FILE *fp=fopen(path.c_str(),"rb");
+  if (fp==NULL) {
+    return -1;
+  }
+  char buffer[65536];
+  size_t n;
+  while ((n=fread(buffer,1,sizeof(buffer),fp))>0) {
+    content.append(buffer,n);
+  }
+  fclose(fp);
+  return 0;
+}
+
+// name of a rotated file
+static std::string getRotatedFileName(const std::string &path, int index) {
+  char suffix[16];
+  snprintf(suffix,sizeof(suffix),".%04d",index);
+  return path + suffix;
+}
+
+// check file content is a sequence of complete blocks. Returns number of blocks, or -1 on error.
+static int countBlocks(const std::string &content) {
+  size_t ix=0;
+  int n=0;
+  while (ix<content.length()) {
+    if (ix+sizeof(DataBlockHeaderBase)>content.length()) {
+      return -1;
+    }
+    const DataBlockHeaderBase *h=(const DataBlockHeaderBase *)&content[ix];
+    ix+=h->headerSize+h->dataSize;
+    n++;
+  }
+  return (ix==content.length()) ? n : -1;
+}
+
+
+// test directory, and config file for recorder
+std::string testDir;
+
+static std::unique_ptr<Consumer> createRecorder(ConfigFile &cfg, const std::string &settings) {
+  std::string cfgPath=testDir + "/test.cfg";
+  FILE *fp=fopen(cfgPath.c_str(),"w");
+  if (fp==NULL) {
+    return nullptr;
+  }
+  fprintf(fp,"[recorder]\n%s",settings.c_str());
+  fclose(fp);
+  cfg.load("file:" + cfgPath);
+  unlink(cfgPath.c_str());
+  return getUniqueConsumerFileRecorder(cfg,"recorder");
+}
+
+// blocks with sizes not multiple of the recording alignment, some bigger than a buffer
+static std::vector<DataBlockContainerReference> makeBlocks(int nBlocks) {
+  std::vector<DataBlockContainerReference> blocks;
+  for (int i=0;i<nBlocks;i++) {
+    int size=(i%10==9) ? 70000 : 1000+(i*3777)%9000;
+    blocks.push_back(std::make_shared<DataBlockContainerTest>(i+1,size));
+  }
+  return blocks;
+}
+
+
+// record to a single file, and to files rotated by size
+// returns number of errors
+int testSingleStream(int fileMaxSize) {
+  int nErr=0;
+  std::string path=testDir + "/single";
+  auto blocks=makeBlocks(100);
+  std::string expected;
+  {
+    ConfigFile cfg;
+    std::string settings="fileName=" + path + "\nfileBufferSize=16384\nfileNumberOfBuffers=4\n";
+    if (fileMaxSize) {
+      settings+="fileMaxSize=" + std::to_string(fileMaxSize) + "\n";
+    }
+    auto c=createRecorder(cfg,settings);
+    for (auto &b : blocks) {
+      if (c->pushData(b)) {
+        nErr++;
+      }
+      expected+=getBlockBytes(b);
+    }
+  }
+
+  std::string content;
+  if (fileMaxSize==0) {
+    // one file, ending with an unaligned tail
+    if (readFile(path,content)) {
+      printf("Failed to read %s\n",path.c_str());
+      return nErr+1;
+    }
+    unlink(path.c_str());
+    if (expected.length()%4096==0) {
+      nErr++;
+    }
+  } else {
+    // files start on block boundaries, and do not exceed maximum size unless holding a single block
+    int nFiles=0;
+    std::string file;
+    for (;readFile(getRotatedFileName(path,nFiles),file)==0;nFiles++) {
+      unlink(getRotatedFileName(path,nFiles).c_str());
+      int n=countBlocks(file);
+      if ((n<=0)||((n>1)&&(file.length()>(size_t)fileMaxSize))) {
+        printf("File %d : %d blocks, %d bytes\n",nFiles,n,(int)file.length());
+        nErr++;
+      }
+      content+=file;
+    }
+    printf("Rotation by size : %d bytes in %d files\n",(int)content.length(),nFiles);
+    if (nFiles<(int)(expected.length()/fileMaxSize)) {
+      nErr++;
+    }
+  }
+  if (content!=expected) {
+    printf("Recorded data differ : %d bytes, expected %d\n",(int)content.length(),(int)expected.length());
+    nErr++;
+  }
+  return nErr;
+}
+
+
+// record to files rotated by time
+// returns number of errors
+int testRotationByTime() {
+  int nErr=0;
+  std::string path=testDir + "/timed";
+  auto blocks=makeBlocks(20);
+  std::string expected;
+  {
+    ConfigFile cfg;
+    auto c=createRecorder(cfg,"fileName=" + path + "\nfileBufferSize=16384\nfileMaxTime=0.05\n");
+    for (auto &b : blocks) {
+      if (c->pushData(b)) {
+        nErr++;
+      }
+      expected+=getBlockBytes(b);
+      usleep(10000);
+    }
+  }
+  std::string content;
+  std::string file;
+  int nFiles=0;
+  for (;readFile(getRotatedFileName(path,nFiles),file)==0;nFiles++) {
+    unlink(getRotatedFileName(path,nFiles).c_str());
+    if (countBlocks(file)<=0) {
+      nErr++;
+    }
+    content+=file;
+  }
+  printf("Rotation by time : %d files\n",nFiles);
+  // about 200ms of data in files of 50ms
+  if ((nFiles<2)||(nFiles>10)) {
+    nErr++;
+  }
+  if (content!=expected) {
+    nErr++;
+  }
+  return nErr;
+}
+
+
+// record to several directories, and read blocks back in order from the index
+// returns number of errors
+int testStriping() {
+  int nErr=0;
+  const int nStreams=3;
+  std::string directories;
+  for (int k=0;k<nStreams;k++) {
+    std::string dir=testDir + "/dir" + std::to_string(k);
+    mkdir(dir.c_str(),0755);
+    directories+=((k>0) ? "," : "") + dir;
+  }
+  std::string path=testDir + "/striped";
+  auto blocks=makeBlocks(100);
+  {
+    ConfigFile cfg;
+    auto c=createRecorder(cfg,"fileName=" + path + "\nfileDirectories=" + directories + "\nfileBufferSize=16384\nfileMaxSize=100000\n");
+    for (auto &b : blocks) {
+      if (c->pushData(b)) {
+        nErr++;
+      }
+    }
+  }
+
+  std::string index;
+  if (readFile(path + ".index",index)) {
+    return nErr+1;
+  }
+  unlink((path + ".index").c_str());
+  if (index.length()!=blocks.size()*sizeof(IndexEntry)) {
+    printf("Index : %d bytes\n",(int)index.length());
+    nErr++;
+  }
+  // files read once, by (stream,file index)
+  std::vector<std::vector<std::string>> files(nStreams);
+  for (size_t i=0;(i<blocks.size())&&(i*sizeof(IndexEntry)<index.length());i++) {
+    const IndexEntry *e=(const IndexEntry *)&index[i*sizeof(IndexEntry)];
+    if ((e->blockId!=blocks[i]->getData()->header.id)||(e->stream<0)||(e->stream>=nStreams)||(e->fileIndex<0)) {
+      nErr++;
+      break;
+    }
+    std::string base=testDir + "/dir" + std::to_string(e->stream) + "/striped-" + std::to_string(e->stream);
+    auto &streamFiles=files[e->stream];
+    while ((int)streamFiles.size()<=e->fileIndex) {
+      std::string name=getRotatedFileName(base,streamFiles.size());
+      streamFiles.push_back("");
+      readFile(name,streamFiles.back());
+      unlink(name.c_str());
+    }
+    const std::string &file=streamFiles[e->fileIndex];
+    if ((e->offset+e->size>file.length())||(file.compare(e->offset,e->size,getBlockBytes(blocks[i])))) {
+      printf("Block %llu not found at index position\n",(unsigned long long)e->blockId);
+      nErr++;
+    }
+  }
+  for (int k=0;k<nStreams;k++) {
+    printf("Stream %d : %d files\n",k,(int)files[k].size());
+    rmdir((testDir + "/dir" + std::to_string(k)).c_str());
+  }
+  return nErr;
+}
+
+
+// recording stops on write error, without blocking the caller
+// returns number of errors
+int testWriteError() {
+  if (access("/dev/full",W_OK)) {
+    printf("Write error : /dev/full not available, skipped\n");
+    return 0;
+  }
+  int nErr=0;
+  ConfigFile cfg;
+  auto c=createRecorder(cfg,"fileName=/dev/full\nfileBufferSize=16384\nfileNumberOfBuffers=2\nfileDirectIO=0\n");
+  auto blocks=makeBlocks(100);
+  int nBlocksOk=0;
+  for (int k=0;k<100;k++) {
+    if (c->pushData(blocks[k%blocks.size()])) {
+      break;
+    }
+    nBlocksOk++;
+    usleep(1000);
+  }
+  printf("Write error : recording stopped after %d blocks\n",nBlocksOk);
+  if (nBlocksOk==100) {
+    nErr++;
+  }
+  // disabled after error
+  if (c->pushData(blocks[0])!=0) {
+    nErr++;
+  }
+  return nErr;
+}
+
+
+int main() {
+  char dirTemplate[]="/tmp/testConsumerFileRecorder.XXXXXX";
+  if (mkdtemp(dirTemplate)==NULL) {
+    printf("Failed to create test directory\n");
+    return 1;
+  }
+  testDir=dirTemplate;
+
+  int nErr=0;
+  nErr+=testSingleStream(0);
+  nErr+=testSingleStream(100000);
+  nErr+=testRotationByTime();
+  nErr+=testStriping();
+  nErr+=testWriteError();
+
+  rmdir(testDir.c_str());
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
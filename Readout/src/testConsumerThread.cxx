@@ -0,0 +1,152 @@
+// test of ConsumerThread backpressure policies
+// a consumer is held busy while blocks are pushed to its thread queue, and the blocks received are checked
+// (which ones are dropped, and order)
+
+#include "Consumer.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// container with block header stored inside
+class DataBlockContainerTest : public DataBlockContainer {
+  public:
+  DataBlockContainerTest(DataBlockId id) {
+    block.header.blockType=DataBlockType::H_BASE;
+    block.header.headerSize=sizeof(DataBlockHeaderBase);
+    block.header.dataSize=0;
+    block.header.id=id;
+    block.data=NULL;
+    data=&block;
+  }
+  private:
+  DataBlock block;
+};
+
+
+// blocks received by the test consumer
+struct ConsumerTestState {
+  std::atomic<int> isOpen{0}; // consumer waits until set, before taking a block
+  std::atomic<int> nReceived{0};
+  std::mutex lock;
+  std::vector<DataBlockId> ids; // ids received, in order
+};
+
+// consumer recording the id of blocks received. Stays busy with first block until state is open.
+class ConsumerTest: public Consumer {
+  public:
+  ConsumerTest(ConfigFile &cfg, std::string cfgEntryPoint, ConsumerTestState *v_state):Consumer(cfg,cfgEntryPoint) {
+    state=v_state;
+  }
+  int pushData(const DataBlockContainerReference &b) {
+    {
+      std::lock_guard<std::mutex> lock(state->lock);
+      state->ids.push_back(b->getData()->header.id);
+    }
+    state->nReceived++;
+    while (!state->isOpen) {
+      usleep(100);
+    }
+    return 0;
+  }
+  private:
+  ConsumerTestState *state;
+};
+
+
+const int queueSize=4;
+const int nBlocks=20;
+
+
+// push nBlocks to a consumer thread with given policy, the first one keeping the consumer busy until all are pushed
+// checks blocks received, and values returned by pushData()
+// returns number of errors
+int testPolicy(const std::string &policy, const std::vector<DataBlockId> &idsExpected, int nRejectedExpected) {
+  int nErr=0;
+  std::string cfgPath="/tmp/testConsumerThread." + std::to_string(getpid()) + ".cfg";
+  FILE *fp=fopen(cfgPath.c_str(),"w");
+  if (fp==NULL) {
+    return 1;
+  }
+  fprintf(fp,"[consumer-test]\nthreadQueueSize=%d\nthreadBackpressure=%s\n",queueSize,policy.c_str());
+  fclose(fp);
+  ConfigFile cfg;
+  cfg.load("file:" + cfgPath);
+  unlink(cfgPath.c_str());
+
+  ConsumerTestState state;
+  std::unique_ptr<Consumer> c=std::make_unique<ConsumerTest>(cfg,"consumer-test",&state);
+  c=getUniqueConsumerThread(cfg,"consumer-test",std::move(c));
+
+  // first block, consumer stays busy with it
+  c->pushData(std::make_shared<DataBlockContainerTest>(1));
+  while (state.nReceived==0) {
+    usleep(100);
+  }
+
+  int nRejected=0;
+  std::atomic<int> nPushed(1);
+  std::thread producer([&]() {
+    for (int i=2;i<=nBlocks;i++) {
+      if (c->pushData(std::make_shared<DataBlockContainerTest>(i))) {
+        nRejected++;
+      }
+      nPushed++;
+    }
+  });
+  if (policy=="block") {
+    // producer waits for space after filling queue
+    usleep(20000);
+    if (nPushed!=1+queueSize) {
+      printf("%s : %d blocks pushed while consumer busy, expected %d\n",policy.c_str(),nPushed.load(),1+queueSize);
+      nErr++;
+    }
+  }
+  state.isOpen=1;
+  producer.join();
+  c=nullptr; // processes pending blocks
+
+  if (state.ids!=idsExpected) {
+    printf("%s : unexpected blocks received:",policy.c_str());
+    for (auto id : state.ids) {
+      printf(" %llu",(unsigned long long)id);
+    }
+    printf("\n");
+    nErr++;
+  }
+  if (nRejected!=nRejectedExpected) {
+    printf("%s : %d blocks rejected, expected %d\n",policy.c_str(),nRejected,nRejectedExpected);
+    nErr++;
+  }
+  printf("%s : %d blocks pushed, %d received, %d rejected\n",policy.c_str(),nBlocks,(int)state.ids.size(),nRejected);
+  return nErr;
+}
+
+
+int main() {
+  int nErr=0;
+
+  // all blocks, in order
+  std::vector<DataBlockId> all;
+  for (int i=1;i<=nBlocks;i++) {
+    all.push_back(i);
+  }
+  nErr+=testPolicy("block",all,0);
+
+  // first ones kept, new ones rejected
+  nErr+=testPolicy("dropNew",{1,2,3,4,5},nBlocks-1-queueSize);
+
+  // last ones kept, accepted but old ones dropped
+  nErr+=testPolicy("dropOldest",{1,17,18,19,20},0);
+
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}
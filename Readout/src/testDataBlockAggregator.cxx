@@ -0,0 +1,233 @@
+// benchmark of DataBlockAggregator
+// measures the time needed to aggregate slices of blocks from a given number of inputs
+// and checks slices built from inputs out of sync, or by several threads
+
+#include "DataBlockAggregator.h"
+
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+
+
+// container with block header stored inside
+class DataBlockContainerBenchmark : public DataBlockContainer {
+  public:
+  DataBlockContainerBenchmark(DataBlockId id) {
+    block.header.blockType=DataBlockType::H_BASE;
+    block.header.headerSize=sizeof(DataBlockHeaderBase);
+    block.header.dataSize=0;
+    block.header.id=id;
+    block.data=NULL;
+    data=&block;
+  }
+  private:
+  DataBlock block;
+};
+
+
+// returns number of errors
+int benchmark(int nInputs) {
+  const int fifoSize=1000;
+  const int nRounds=200;
+  int nErr=0;
+
+  AliceO2::Common::Fifo<DataSetReference> output(fifoSize);
+  DataBlockAggregator agg(&output,"Aggregator");
+  std::vector<std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>> inputs;
+  for (int i=0;i<nInputs;i++) {
+    inputs.push_back(std::make_shared<AliceO2::Common::Fifo<DataBlockContainerReference>>(fifoSize));
+    agg.addInput(inputs.back());
+  }
+
+  // same blocks used for each round
+  std::vector<std::vector<DataBlockContainerReference>> blocks(nInputs);
+  for (int i=0;i<nInputs;i++) {
+    for (int k=0;k<fifoSize;k++) {
+      blocks[i].push_back(std::make_shared<DataBlockContainerBenchmark>(k+1));
+    }
+  }
+
+  // aggregator loop called directly, to measure CPU time only (no idle sleep)
+  std::chrono::duration<double> dt(0);
+  unsigned long long nSlices=0;
+  for (int r=0;r<nRounds;r++) {
+    for (int i=0;i<nInputs;i++) {
+      for (auto &b : blocks[i]) {
+        inputs[i]->push(b);
+      }
+    }
+    auto t0=std::chrono::steady_clock::now();
+    for (int k=0;k<fifoSize;k++) {
+      if (DataBlockAggregator::threadCallback(&agg)!=Thread::CallbackResult::Ok) {
+        nErr++;
+      }
+      DataSetReference bc=nullptr;
+      output.pop(bc);
+      if ((bc==nullptr)||((int)bc->size()!=nInputs)) {
+        nErr++;
+      }
+      nSlices++;
+    }
+    dt+=std::chrono::steady_clock::now()-t0;
+  }
+  printf("%2d inputs : %.1f ns per slice, %.0f slices/s\n",nInputs,dt.count()*1000000000.0/nSlices,nSlices/dt.count());
+  return nErr;
+}
+
+
+// inputs out of sync, without slice timeout: last input only has even ids, and first input gets a late block
+// returns number of errors
+int outOfSync(DataBlockAggregator::IncompleteSlicePolicy policy) {
+  const int nInputs=4;
+  const int nIds=100;
+  int nErr=0;
+
+  AliceO2::Common::Fifo<DataSetReference> output(nIds*2);
+  DataBlockAggregator agg(&output,"Aggregator");
+  agg.setSliceTimeout(0);
+  agg.setIncompleteSlicePolicy(policy);
+  std::vector<std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>> inputs;
+  for (int i=0;i<nInputs;i++) {
+    inputs.push_back(std::make_shared<AliceO2::Common::Fifo<DataBlockContainerReference>>(nIds*2));
+    agg.addInput(inputs.back());
+  }
+  for (int k=1;k<=nIds;k++) {
+    for (int i=0;i<nInputs;i++) {
+      if ((i==nInputs-1)&&(k%2)) {
+        continue;
+      }
+      inputs[i]->push(std::make_shared<DataBlockContainerBenchmark>(k));
+    }
+  }
+  int nSlices=0;
+  while (DataBlockAggregator::threadCallback(&agg)==Thread::CallbackResult::Ok) {
+    nSlices++;
+  }
+  // late block, output on its own
+  inputs[0]->push(std::make_shared<DataBlockContainerBenchmark>(nIds/2));
+  while (DataBlockAggregator::threadCallback(&agg)==Thread::CallbackResult::Ok) {
+    nSlices++;
+  }
+
+  int nIncomplete=0;
+  DataSetReference bc=nullptr;
+  DataBlockId lastId=0;
+  while (output.pop(bc)==0) {
+    DataBlockId id=bc->at(0)->getData()->header.id;
+    if ((int)bc->size()!=nInputs) {
+      nIncomplete++;
+    }
+    for (auto &b : *bc) {
+      if (b->getData()->header.id!=id) {
+        nErr++;
+      }
+    }
+    if ((id<=lastId)&&(bc->size()!=1)) {
+      nErr++;
+    }
+    lastId=id;
+  }
+
+  DataBlockAggregatorStats stats;
+  agg.getStats(stats);
+  int isDrop=(policy==DataBlockAggregator::IncompleteSlicePolicy::Drop);
+  int nExpectedIncomplete=nIds/2+1;
+  if ((nSlices!=nIds+1)||(stats.slicesIncomplete!=(unsigned)nExpectedIncomplete)||(stats.blocksLate!=1)||(stats.slicesTimeout!=0)) {
+    nErr++;
+  }
+  if (isDrop) {
+    if ((stats.slicesDropped!=(unsigned)nExpectedIncomplete)||(nIncomplete!=0)||(stats.slices!=(unsigned)(nIds-nExpectedIncomplete+1))) {
+      nErr++;
+    }
+  } else {
+    if ((stats.slicesDropped!=0)||(nIncomplete!=nExpectedIncomplete)||(stats.slices!=(unsigned)(nIds+1))) {
+      nErr++;
+    }
+  }
+  printf("out of sync, %s incomplete slices : %llu slices, %llu incomplete, %llu dropped, %llu late blocks\n",isDrop?"drop":"send",stats.slices,stats.slicesIncomplete,stats.slicesDropped,stats.blocksLate);
+  return nErr;
+}
+
+
+// slices built by several aggregator threads: iterations called directly, or in running threads
+// returns number of errors
+int sharded(int nThreads, DataBlockAggregator::OutputOrder order, int isRunning) {
+  const int nInputs=4;
+  const int nIds=900;
+  int nErr=0;
+
+  AliceO2::Common::Fifo<DataSetReference> output(nIds);
+  DataBlockAggregator agg(&output,"Aggregator",nThreads);
+  agg.setOutputOrder(order);
+  std::vector<std::shared_ptr<AliceO2::Common::Fifo<DataBlockContainerReference>>> inputs;
+  for (int i=0;i<nInputs;i++) {
+    inputs.push_back(std::make_shared<AliceO2::Common::Fifo<DataBlockContainerReference>>(nIds));
+    agg.addInput(inputs.back());
+  }
+  if (isRunning) {
+    agg.start();
+  }
+  for (int k=1;k<=nIds;k++) {
+    for (int i=0;i<nInputs;i++) {
+      inputs[i]->push(std::make_shared<DataBlockContainerBenchmark>(k));
+    }
+  }
+  if (isRunning) {
+    for (int i=0;(i<5000)&&(output.getNumberOfUsedSlots()<nIds);i++) {
+      usleep(1000);
+    }
+    agg.stop(1);
+  } else {
+    while (DataBlockAggregator::threadCallback(&agg)==Thread::CallbackResult::Ok) {
+    }
+  }
+
+  // stop() clears output: count slices from stats
+  DataBlockAggregatorStats stats;
+  agg.getStats(stats);
+  if ((stats.slices!=nIds)||(stats.slicesIncomplete!=0)) {
+    nErr++;
+  }
+  if (!isRunning) {
+    DataSetReference bc=nullptr;
+    DataBlockId lastId=0;
+    int nSlices=0;
+    while (output.pop(bc)==0) {
+      DataBlockId id=bc->at(0)->getData()->header.id;
+      if ((int)bc->size()!=nInputs) {
+        nErr++;
+      }
+      if ((order==DataBlockAggregator::OutputOrder::Ordered)&&(id!=lastId+1)) {
+        nErr++;
+      }
+      lastId=id;
+      nSlices++;
+    }
+    if ((nSlices!=nIds)||(stats.slicesOutOfOrder!=0)) {
+      nErr++;
+    }
+  }
+  printf("%d threads, %s, %s : %llu slices, %llu out of order\n",nThreads,(order==DataBlockAggregator::OutputOrder::Ordered)?"ordered":"unordered",
+    isRunning?"running":"direct calls",stats.slices,stats.slicesOutOfOrder);
+  return nErr;
+}
+
+
+int main() {
+  int nErr=0;
+  for (int nInputs : {1, 4, 24, 64}) {
+    nErr+=benchmark(nInputs);
+  }
+  nErr+=outOfSync(DataBlockAggregator::IncompleteSlicePolicy::Send);
+  nErr+=outOfSync(DataBlockAggregator::IncompleteSlicePolicy::Drop);
+  for (int nThreads : {2, 3}) {
+    nErr+=sharded(nThreads,DataBlockAggregator::OutputOrder::Ordered,0);
+    nErr+=sharded(nThreads,DataBlockAggregator::OutputOrder::Unordered,0);
+    nErr+=sharded(nThreads,DataBlockAggregator::OutputOrder::Ordered,1);
+  }
+  if (nErr) {
+    printf("%d errors\n",nErr);
+  }
+  return nErr;
+}